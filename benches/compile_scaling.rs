@@ -0,0 +1,163 @@
+//! Compile time scaling benchmark. Run with `cargo bench`, or `cargo bench -- <workload name>` to run only some workloads.
+//!
+//! `sus_compiler` is a binary, so this runs it on the projects of [sus_generator] with `--stats-json`,
+//! and reports the median time per phase (see `src/stats.rs`) for each size. The number of runs per size
+//! can be set with the `SUS_BENCH_RUNS` environment variable.
+
+mod sus_generator;
+
+use std::{
+    fs,
+    path::{Path, PathBuf},
+    process::{Command, Stdio},
+    time::{Duration, Instant},
+};
+
+use sus_generator::{Workload, WORKLOADS};
+
+const DEFAULT_RUNS: usize = 5;
+
+/// The phases reported by the compiler that we show, in order
+const PHASES: &[&str] = &[
+    "parse",
+    "gather",
+    "flatten",
+    "typecheck",
+    "lints",
+    "instantiate",
+    "latency counting",
+    "codegen",
+];
+
+/// The totals reported by the compiler that we show, to check that the workloads grow as intended
+const COUNTERS: &[&str] = &["instructions", "wires", "latency_edges"];
+
+/// The statistics of a single run of the compiler
+struct RunStats {
+    wall_time: Duration,
+    phase_times_ms: Vec<f64>,
+    counters: Vec<usize>,
+}
+
+/// Finds the first `"key":<number>` in `json`. The statistics JSON is flat and written by us, so this suffices
+fn find_number<T: std::str::FromStr>(json: &str, key: &str) -> Option<T> {
+    let pattern = format!("\"{key}\":");
+    let start = json.find(&pattern)? + pattern.len();
+    let rest = &json[start..];
+    let end = rest.find([',', '}'])?;
+    rest[..end].parse().ok()
+}
+
+fn parse_stats(json: &str, wall_time: Duration) -> RunStats {
+    let (phases_json, rest) = json
+        .split_once("\"items\":")
+        .expect("Statistics JSON must have items");
+    let phase_times_ms = PHASES
+        .iter()
+        .map(
+            |phase| match phases_json.find(&format!("\"name\":\"{phase}\"")) {
+                Some(idx) => find_number(&phases_json[idx..], "time_ms").unwrap(),
+                None => 0.0, // Phase didn't run, for instance a workload without latency counting
+            },
+        )
+        .collect();
+    let totals_json = &rest[rest
+        .find("\"totals\":")
+        .expect("Statistics JSON must have totals")..];
+    let counters = COUNTERS
+        .iter()
+        .map(|counter| find_number(totals_json, counter).unwrap())
+        .collect();
+    RunStats {
+        wall_time,
+        phase_times_ms,
+        counters,
+    }
+}
+
+fn run_compiler(dir: &Path, files: &[PathBuf]) -> RunStats {
+    let stats_path = dir.join("stats.json");
+    let start = Instant::now();
+    let status = Command::new(env!("CARGO_BIN_EXE_sus_compiler"))
+        .current_dir(dir)
+        .args(["--codegen", "--ci", "--nocolor", "--stats-json"])
+        .arg(&stats_path)
+        .args(files)
+        .stdout(Stdio::null())
+        .stderr(Stdio::null())
+        .status()
+        .expect("Could not start sus_compiler");
+    let wall_time = start.elapsed();
+    assert!(status.success(), "sus_compiler failed on {}", dir.display());
+
+    parse_stats(&fs::read_to_string(&stats_path).unwrap(), wall_time)
+}
+
+fn median(mut values: Vec<f64>) -> f64 {
+    values.sort_by(f64::total_cmp);
+    values[values.len() / 2]
+}
+
+fn bench_workload(workload: &Workload, num_runs: usize) {
+    println!("== {} (size = {}) ==", workload.name, workload.size_meaning);
+    print!("{:>8} {:>10}", "size", "wall (ms)");
+    for phase in PHASES {
+        print!(" {phase:>12}");
+    }
+    for counter in COUNTERS {
+        print!(" {counter:>13}");
+    }
+    println!();
+
+    for &size in workload.sizes {
+        let dir = Path::new(env!("CARGO_TARGET_TMPDIR"))
+            .join("compile_scaling")
+            .join(format!("{}_{size}", workload.name));
+        fs::create_dir_all(&dir).unwrap();
+        let files: Vec<PathBuf> = (workload.generate)(size)
+            .into_iter()
+            .map(|(name, text)| {
+                let path = dir.join(name);
+                fs::write(&path, text).unwrap();
+                path
+            })
+            .collect();
+
+        let runs: Vec<RunStats> = (0..num_runs).map(|_| run_compiler(&dir, &files)).collect();
+
+        let wall_ms = median(
+            runs.iter()
+                .map(|r| r.wall_time.as_secs_f64() * 1000.0)
+                .collect(),
+        );
+        print!("{size:>8} {wall_ms:>10.2}");
+        for phase_idx in 0..PHASES.len() {
+            let phase_ms = median(runs.iter().map(|r| r.phase_times_ms[phase_idx]).collect());
+            print!(" {phase_ms:>12.3}");
+        }
+        // Counters don't differ between runs
+        for counter in &runs[0].counters {
+            print!(" {counter:>13}");
+        }
+        println!();
+    }
+    println!();
+}
+
+fn main() {
+    let num_runs = match std::env::var("SUS_BENCH_RUNS") {
+        Ok(runs) => runs.parse().expect("SUS_BENCH_RUNS must be a number"),
+        Err(_) => DEFAULT_RUNS,
+    };
+    // cargo bench passes flags such as --bench, the remaining arguments filter the workloads
+    let filters: Vec<String> = std::env::args()
+        .skip(1)
+        .filter(|arg| !arg.starts_with("--"))
+        .collect();
+
+    for workload in WORKLOADS {
+        if filters.is_empty() || filters.iter().any(|f| workload.name.contains(f.as_str())) {
+            bench_workload(workload, num_runs);
+        }
+    }
+}
@@ -0,0 +1,181 @@
+//! Generates synthetic SUS projects that scale along a single size parameter.
+//!
+//! Each [Workload] stresses a different part of the compiler, such that [super] can show how each phase scales.
+
+use std::fmt::Write;
+
+/// A generated `.sus` file: (file name, file text)
+pub type GeneratedFile = (String, String);
+
+pub struct Workload {
+    pub name: &'static str,
+    /// What the size parameter means for this workload
+    pub size_meaning: &'static str,
+    pub sizes: &'static [usize],
+    pub generate: fn(usize) -> Vec<GeneratedFile>,
+}
+
+pub const WORKLOADS: &[Workload] = &[
+    Workload {
+        name: "deep_hierarchy",
+        size_meaning: "levels of submodules",
+        sizes: &[4, 16, 64, 256],
+        generate: deep_hierarchy,
+    },
+    Workload {
+        name: "wide_for_loop",
+        size_meaning: "NxN matrix-vector multiply",
+        sizes: &[4, 8, 16, 32],
+        generate: wide_for_loop,
+    },
+    Workload {
+        name: "large_state_array",
+        size_meaning: "elements of state",
+        sizes: &[64, 256, 1024, 4096],
+        generate: large_state_array,
+    },
+    Workload {
+        name: "many_port_fifo",
+        size_meaning: "latency-annotated ports",
+        sizes: &[8, 32, 128, 512],
+        generate: many_port_fifo,
+    },
+    Workload {
+        name: "many_files",
+        size_meaning: "files",
+        sizes: &[4, 16, 64, 256],
+        generate: many_files,
+    },
+];
+
+fn single_file(name: &str, text: String) -> Vec<GeneratedFile> {
+    vec![(format!("{name}.sus"), text)]
+}
+
+/// A chain of modules, where each level instantiates the level below it twice
+fn deep_hierarchy(depth: usize) -> Vec<GeneratedFile> {
+    let mut text = String::from(
+        "module level_0 {\n\
+         \tinterface level_0 : int a, int b -> int r\n\
+         \treg r = a * b + a\n\
+         }\n",
+    );
+    for level in 1..depth {
+        let below = level - 1;
+        write!(
+            text,
+            "\nmodule level_{level} {{\n\
+             \tinterface level_{level} : int a, int b -> int r\n\
+             \tint x = level_{below}(a, b)\n\
+             \tint y = level_{below}(b, x)\n\
+             \treg r = x + y\n\
+             }}\n"
+        )
+        .unwrap();
+    }
+    single_file("deep_hierarchy", text)
+}
+
+/// Nested generative `for` loops, producing `size * size` multiplications
+fn wide_for_loop(size: usize) -> Vec<GeneratedFile> {
+    let text = format!(
+        "module wide_for_loop {{\n\
+         \tinterface wide_for_loop : int[{size}][{size}] mat, int[{size}] vec -> int[{size}] result\n\
+         \n\
+         \tfor int row in 0..{size} {{\n\
+         \t\tint[{size}] row_products\n\
+         \t\tfor int col in 0..{size} {{\n\
+         \t\t\trow_products[col] = mat[row][col] * vec[col]\n\
+         \t\t}}\n\
+         \t\tresult[row] = +row_products\n\
+         \t}}\n\
+         }}\n"
+    );
+    single_file("wide_for_loop", text)
+}
+
+/// A memory of `size` ints, next to a shift register of `size` bools
+fn large_state_array(size: usize) -> Vec<GeneratedFile> {
+    let text = format!(
+        "module large_state_array {{\n\
+         \tinterface large_state_array : bool write, int addr, int data -> int[{size}] snapshot, bool shifted_out\n\
+         \n\
+         \tstate int[{size}] mem\n\
+         \tstate bool[{size}] shift\n\
+         \n\
+         \twhen write {{\n\
+         \t\tmem[addr] = data\n\
+         \t}}\n\
+         \tshift[0] = write\n\
+         \tfor int i in 1..{size} {{\n\
+         \t\tshift[i] = shift[i - 1]\n\
+         \t}}\n\
+         \tshifted_out = shift[{last}]\n\
+         \n\
+         \tfor int i in 0..{size} {{\n\
+         \t\tsnapshot[i] = mem[i]\n\
+         \t}}\n\
+         }}\n",
+        last = size - 1
+    );
+    single_file("large_state_array", text)
+}
+
+/// Like the FIFO-shaped graphs of the latency counting tests: many inputs with specified latencies,
+/// and outputs whose latencies must be inferred from neighbouring inputs
+fn many_port_fifo(num_ports: usize) -> Vec<GeneratedFile> {
+    let inputs: Vec<String> = (0..num_ports)
+        .map(|i| format!("int in_{i}'{}", i % 4))
+        .collect();
+    let outputs: Vec<String> = (0..num_ports).map(|i| format!("int out_{i}")).collect();
+
+    let mut text = format!(
+        "module many_port_fifo {{\n\
+         \tinterface many_port_fifo : {} -> {}\n\n",
+        inputs.join(", "),
+        outputs.join(", ")
+    );
+    for i in 0..num_ports {
+        let next = (i + 1) % num_ports;
+        writeln!(text, "\tint d_{i} = in_{i} + in_{next}").unwrap();
+        writeln!(text, "\treg out_{i} = d_{i}").unwrap();
+    }
+    text.push_str("}\n");
+    single_file("many_port_fifo", text)
+}
+
+/// Each file declares a few modules, and uses the top module of the file before it
+fn many_files(num_files: usize) -> Vec<GeneratedFile> {
+    (0..num_files)
+        .map(|f| {
+            let mut text = format!(
+                "module file_{f}_mul {{\n\
+                 \tinterface file_{f}_mul : int a, int b -> int r\n\
+                 \treg r = a * b\n\
+                 }}\n\
+                 \n\
+                 module file_{f}_add {{\n\
+                 \tinterface file_{f}_add : int a, int b -> int r\n\
+                 \treg r = a + b\n\
+                 }}\n\
+                 \n\
+                 module file_{f}_top {{\n\
+                 \tinterface file_{f}_top : int a, int b -> int r\n\
+                 \tint m = file_{f}_mul(a, b)\n"
+            );
+            if f == 0 {
+                text.push_str("\tr = file_0_add(m, b)\n");
+            } else {
+                let prev = f - 1;
+                write!(
+                    text,
+                    "\tint p = file_{prev}_top(m, a)\n\
+                     \tr = file_{f}_add(p, b)\n"
+                )
+                .unwrap();
+            }
+            text.push_str("}\n");
+            (format!("file_{f}.sus"), text)
+        })
+        .collect()
+}
@@ -1,8 +1,23 @@
 use std::{
+    collections::hash_map::DefaultHasher,
     fs,
+    hash::{Hash, Hasher},
     path::{Path, PathBuf},
 };
 
+/// Everything the compiler is built from. Paths that don't exist, like the workspace crates in a published package, are skipped
+const BUILD_INPUTS: &[&str] = &[
+    "src",
+    "std",
+    "build.rs",
+    "Cargo.toml",
+    "Cargo.lock",
+    "sus-proc-macro/src",
+    "sus-proc-macro/Cargo.toml",
+    "tree-sitter-sus/src",
+    "tree-sitter-sus/grammar.js",
+];
+
 fn main() {
     let mut install_dir = get_sus_dir();
     install_dir.push(env!("CARGO_PKG_VERSION"));
@@ -17,6 +32,38 @@ fn main() {
         "cargo:rustc-env=SUS_COMPILER_STD_LIB_PATH={}",
         install_dir.display()
     );
+
+    // Identifies this build of the compiler, for the keys of --cache-dir entries
+    let mut hasher = DefaultHasher::new();
+    for input in BUILD_INPUTS {
+        let path = Path::new(input);
+        // Cargo would rerun this script on every build for paths that don't exist
+        if path.exists() {
+            println!("cargo:rerun-if-changed={input}");
+        }
+        hash_path(path, &mut hasher).expect("Failed to hash the compiler sources");
+    }
+    println!(
+        "cargo:rustc-env=SUS_COMPILER_BUILD_ID={:016x}",
+        hasher.finish()
+    );
+}
+
+/// Hashes the names and contents of all files under `path`, in sorted order
+fn hash_path(path: &Path, hasher: &mut DefaultHasher) -> std::io::Result<()> {
+    if path.is_dir() {
+        let mut entries: Vec<PathBuf> = fs::read_dir(path)?
+            .map(|entry| entry.map(|e| e.path()))
+            .collect::<Result<_, _>>()?;
+        entries.sort();
+        for entry in &entries {
+            hash_path(entry, hasher)?;
+        }
+    } else if path.is_file() {
+        path.hash(hasher);
+        fs::read(path)?.hash(hasher);
+    }
+    Ok(())
 }
 
 fn get_sus_dir() -> PathBuf {
@@ -556,6 +556,12 @@ impl<T, IndexMarker> FlatAlloc<T, IndexMarker> {
     pub fn clear(&mut self) {
         self.data.clear();
     }
+    pub fn capacity(&self) -> usize {
+        self.data.capacity()
+    }
+    pub fn shrink_to_fit(&mut self) {
+        self.data.shrink_to_fit();
+    }
     pub fn iter(&self) -> FlatAllocIter<'_, T, IndexMarker> {
         self.into_iter()
     }
@@ -681,6 +687,13 @@ impl<'a, T, IndexMarker> Iterator for FlatAllocIter<'a, T, IndexMarker> {
         self.iter.size_hint()
     }
 }
+impl<T, IndexMarker> DoubleEndedIterator for FlatAllocIter<'_, T, IndexMarker> {
+    fn next_back(&mut self) -> Option<Self::Item> {
+        self.iter
+            .next_back()
+            .map(|(id, v)| (UUID(id, PhantomData), v))
+    }
+}
 impl<T, IndexMarker> ExactSizeIterator for FlatAllocIter<'_, T, IndexMarker> {
     fn len(&self) -> usize {
         self.iter.len()
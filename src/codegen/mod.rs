@@ -1,3 +1,4 @@
+mod output_file;
 mod shared;
 pub mod system_verilog;
 pub mod vhdl;
@@ -5,17 +6,24 @@ pub mod vhdl;
 pub use system_verilog::VerilogCodegenBackend;
 pub use vhdl::VHDLCodegenBackend;
 
-use crate::{InstantiatedModule, Linker, Module};
+use crate::{config::config, stats, InstantiatedModule, Linker, Module};
 
 use std::{
+    collections::{hash_map::DefaultHasher, HashSet},
     fs::{self, File},
+    hash::{Hash, Hasher},
     io::Write,
-    path::PathBuf,
-    rc::Rc,
+    path::{Path, PathBuf},
+    sync::atomic::{AtomicUsize, Ordering},
+    sync::{Arc, Mutex},
 };
 
+use output_file::{OutputFile, TeeWriter};
+
 /// Implemented for SystemVerilog [self::system_verilog] or VHDL [self::vhdl]
-pub trait CodeGenBackend {
+///
+/// Backends are shared between the threads of [CodeGenBackend::codegen_to_files], hence [Sync]
+pub trait CodeGenBackend: Sync {
     fn file_extension(&self) -> &str;
     fn output_dir_name(&self) -> &str;
     fn codegen(
@@ -24,17 +32,24 @@ pub trait CodeGenBackend {
         instance: &InstantiatedModule,
         linker: &Linker,
         use_latency: bool,
-    ) -> String;
+        out: &mut dyn Write,
+    );
 
-    fn make_output_file(&self, name: &str) -> File {
+    /// Where [CodeGenBackend::make_output_file] writes the file called `name`
+    fn output_file_path(&self, name: &str) -> PathBuf {
         let mut path = PathBuf::with_capacity(
             name.len() + self.output_dir_name().len() + self.file_extension().len() + 2,
         );
         path.push(self.output_dir_name());
-        fs::create_dir_all(&path).unwrap();
         path.push(name);
         path.set_extension(self.file_extension());
-        let mut file = File::create(path).unwrap();
+        path
+    }
+
+    /// The file only replaces the existing one on [OutputFile::finish] if its contents differ
+    fn make_output_file(&self, name: &str) -> OutputFile {
+        fs::create_dir_all(self.output_dir_name()).unwrap();
+        let mut file = OutputFile::create(self.output_file_path(name)).unwrap();
 
         file.write_fmt(format_args!(
             "// DO NOT EDIT THIS FILE\n// This file was generated with SUS Compiler {}\n",
@@ -45,64 +60,186 @@ pub trait CodeGenBackend {
         file
     }
 
+    /// Where the generated code of an instance is kept between runs with `--cache-dir`.
+    /// Besides the instance, the output depends on the backend and the codegen flags
+    fn codegen_cache_entry(&self, cache_dir: &Path, inst: &InstantiatedModule) -> Option<PathBuf> {
+        let mut hasher = DefaultHasher::new();
+        inst.cache_key?.hash(&mut hasher);
+        self.file_extension().hash(&mut hasher);
+        config().shift_registers.hash(&mut hasher);
+        Some(cache_dir.join(format!(
+            "{}-{:016x}.{}",
+            inst.mangled_name,
+            hasher.finish(),
+            self.file_extension()
+        )))
+    }
+
+    /// What should be printed about the instance is added to `messages`, such that [CodeGenBackend::codegen_to_files] can print it in module order
     fn codegen_instance(
         &self,
         inst: &InstantiatedModule,
         md: &Module,
         linker: &Linker,
-        out_file: &mut File,
+        out_file: &mut dyn Write,
+        messages: &mut Vec<String>,
     ) {
         let inst_name = &inst.name;
         if inst.errors.did_error {
-            println!("Instantiating error: {inst_name}");
+            messages.push(format!("Instantiating error: {inst_name}"));
             return; // Continue
         }
-        println!("Instantiating success: {inst_name}");
-        let code = self.codegen(md, inst, linker, true); // hardcode use_latency = true for now. Maybe forever, we'll see
-        write!(out_file, "{code}").unwrap();
+        messages.push(format!("Instantiating success: {inst_name}"));
+        let cache_entry = config()
+            .cache_dir
+            .as_deref()
+            .and_then(|cache_dir| self.codegen_cache_entry(cache_dir, inst));
+        let Some(cache_entry) = cache_entry else {
+            self.codegen(md, inst, linker, true, out_file); // hardcode use_latency = true for now. Maybe forever, we'll see
+            return;
+        };
+
+        // Instances whose key is unchanged generate exactly the same code, so it needn't be generated again
+        if let Ok(mut cached) = File::open(&cache_entry) {
+            std::io::copy(&mut cached, out_file).unwrap();
+            return;
+        }
+        let mut report_error = |err: std::io::Error| {
+            messages.push(format!(
+                "Could not write codegen cache entry {}: {err}",
+                cache_entry.display()
+            ))
+        };
+        match OutputFile::create(cache_entry.clone()) {
+            Ok(mut cache_file) => {
+                let mut both = TeeWriter(out_file, &mut cache_file);
+                self.codegen(md, inst, linker, true, &mut both);
+                if let Err(err) = cache_file.finish() {
+                    report_error(err);
+                }
+            }
+            Err(err) => {
+                report_error(err);
+                self.codegen(md, inst, linker, true, out_file);
+            }
+        }
     }
 
-    fn codegen_to_file(&self, md: &Module, linker: &Linker) {
+    fn codegen_to_file(&self, md: &Module, linker: &Linker, messages: &mut Vec<String>) {
+        let timer = stats::ItemTimer::start("codegen");
         let mut out_file = self.make_output_file(&md.link_info.name);
+        // Sorted, such that the file only changes when the instances do
+        let mut instances: Vec<Arc<InstantiatedModule>> = Vec::new();
         md.instantiations.for_each_instance(|_template_args, inst| {
-            self.codegen_instance(inst.as_ref(), md, linker, &mut out_file)
+            instances.push(inst.clone());
+        });
+        instances.sort_by(|a, b| a.name.cmp(&b.name));
+        for inst in &instances {
+            self.codegen_instance(inst, md, linker, &mut out_file, messages);
+        }
+        out_file.finish().unwrap();
+        timer.finish(|| md.link_info.name.clone());
+    }
+
+    /// Calls [CodeGenBackend::codegen_to_file] for each module.
+    /// With [crate::config::ConfigStruct::jobs] > 1, the files are written on multiple threads.
+    /// This is safe, because instances are no longer modified after instantiation
+    ///
+    /// The messages of each module are printed in the order of `modules`, also when using multiple threads
+    fn codegen_to_files(&self, modules: &[&Module], linker: &Linker) {
+        if config().jobs <= 1 || modules.len() <= 1 {
+            for md in modules {
+                let mut messages = Vec::new();
+                self.codegen_to_file(md, linker, &mut messages);
+                print_messages(messages);
+            }
+            return;
+        }
+
+        let module_messages: Vec<Mutex<Vec<String>>> =
+            modules.iter().map(|_| Mutex::default()).collect();
+        let module_messages = &module_messages;
+        let next_module = &AtomicUsize::new(0);
+        let num_threads = usize::min(config().jobs, modules.len());
+        std::thread::scope(|scope| {
+            for _ in 0..num_threads {
+                scope.spawn(move || loop {
+                    let idx = next_module.fetch_add(1, Ordering::Relaxed);
+                    let Some(md) = modules.get(idx) else {
+                        break;
+                    };
+                    let mut messages = module_messages[idx].lock().unwrap();
+                    self.codegen_to_file(md, linker, &mut messages);
+                });
+            }
         });
+        for messages in module_messages {
+            print_messages(std::mem::take(&mut *messages.lock().unwrap()));
+        }
     }
 
     fn codegen_with_dependencies(&self, linker: &Linker, md: &Module, file_name: &str) {
         let mut out_file = self.make_output_file(file_name);
-        let mut top_level_instances: Vec<Rc<InstantiatedModule>> = Vec::new();
+        let mut top_level_instances: Vec<Arc<InstantiatedModule>> = Vec::new();
         md.instantiations.for_each_instance(|_template_args, inst| {
             top_level_instances.push(inst.clone());
         });
-        let mut to_process_queue: Vec<(&InstantiatedModule, &Module)> = top_level_instances
+        top_level_instances.sort_by(|a, b| a.name.cmp(&b.name));
+        /// Instances are emitted on [Visit::Exit], after all their submodules have been
+        enum Visit<'l> {
+            Enter(&'l InstantiatedModule, &'l Module),
+            Exit(&'l InstantiatedModule, &'l Module),
+        }
+
+        let mut visited: HashSet<*const InstantiatedModule> = HashSet::new();
+        let mut messages = Vec::new();
+        let mut to_visit: Vec<Visit> = top_level_instances
             .iter()
-            .map(|v| (v.as_ref(), md))
+            .rev()
+            .map(|v| Visit::Enter(v.as_ref(), md))
             .collect();
 
-        let mut cur_idx = 0;
-
-        while cur_idx < to_process_queue.len() {
-            let (cur_instance, cur_md) = to_process_queue[cur_idx];
-
-            for (_, sub_mod) in &cur_instance.submodules {
-                let new_inst = sub_mod.instance.get().unwrap().as_ref();
-
-                // Skip duplicates
-                // Yeah yeah I know O(n²) but this list shouldn't grow too big. Fix if needed
-                if to_process_queue
-                    .iter()
-                    .any(|existing| std::ptr::eq(existing.0, new_inst))
-                {
-                    continue;
+        // Depth first, emitting leaves first. Downstream tools can then read the output in a single pass
+        while let Some(visit) = to_visit.pop() {
+            match visit {
+                Visit::Enter(cur_instance, cur_md) => {
+                    if !visited.insert(cur_instance) {
+                        continue; // Already emitted, or will be emitted before the instance that contains it
+                    }
+                    to_visit.push(Visit::Exit(cur_instance, cur_md));
+                    // Reversed, such that submodules are emitted in the order they appear in
+                    for (_, sub_mod) in cur_instance.submodules.iter().rev() {
+                        // Instances that errored may contain submodules that failed to instantiate
+                        if let Some(new_inst) = sub_mod.instance.get() {
+                            to_visit.push(Visit::Enter(
+                                new_inst.as_ref(),
+                                &linker.modules[sub_mod.module_uuid],
+                            ));
+                        }
+                    }
+                }
+                Visit::Exit(cur_instance, cur_md) => {
+                    self.codegen_instance(
+                        cur_instance,
+                        cur_md,
+                        linker,
+                        &mut out_file,
+                        &mut messages,
+                    );
+                    print_messages(messages.drain(..));
                 }
-
-                to_process_queue.push((new_inst, &linker.modules[sub_mod.module_uuid]));
             }
-
-            self.codegen_instance(cur_instance, cur_md, linker, &mut out_file);
-
-            cur_idx += 1;
         }
+        println!(
+            "Emitted {} unique instances into {file_name}",
+            visited.len()
+        );
+        out_file.finish().unwrap();
+    }
+}
+
+fn print_messages(messages: impl IntoIterator<Item = String>) {
+    for msg in messages {
+        println!("{msg}");
     }
 }
@@ -0,0 +1,143 @@
+//! Generated files are streamed to a temporary file next to their target, and only moved over it when their contents changed.
+//! Unchanged outputs then keep their modification time, such that downstream simulation and synthesis flows don't rebuild them.
+//!
+//! Neither the new nor the old contents are ever held in memory as a whole: the new contents are hashed while they are written,
+//! and the old file is only hashed, in chunks, if its length matches.
+
+use std::collections::hash_map::DefaultHasher;
+use std::ffi::OsString;
+use std::fs::{self, File};
+use std::hash::Hasher;
+use std::io::{self, BufWriter, Read, Write};
+use std::path::{Path, PathBuf};
+
+/// Chunk size for hashing the old contents of a file
+const HASH_CHUNK_SIZE: usize = 64 * 1024;
+
+pub struct OutputFile {
+    path: PathBuf,
+    tmp_path: PathBuf,
+    file: BufWriter<File>,
+    hasher: DefaultHasher,
+    len: u64,
+}
+
+impl OutputFile {
+    /// Writes go to a temporary file, [OutputFile::finish] puts it in place of `path`
+    pub fn create(path: PathBuf) -> io::Result<Self> {
+        // Includes the process id, such that concurrent compiler runs don't write to the same temporary file
+        let mut tmp_path = OsString::from(path.as_os_str());
+        tmp_path.push(format!(".tmp{}", std::process::id()));
+        let tmp_path = PathBuf::from(tmp_path);
+        let file = BufWriter::new(File::create(&tmp_path)?);
+        Ok(Self {
+            path,
+            tmp_path,
+            file,
+            hasher: DefaultHasher::new(),
+            len: 0,
+        })
+    }
+
+    /// Replaces the file at the target path, unless it already had exactly these contents.
+    /// The temporary file is removed in that case. Either way, other tools never see a half-written file
+    ///
+    /// Returns whether the file was replaced
+    pub fn finish(self) -> io::Result<bool> {
+        let Self {
+            path,
+            tmp_path,
+            file,
+            hasher,
+            len,
+        } = self;
+        // Closes the file before it is renamed or removed
+        file.into_inner().map_err(|err| err.into_error())?;
+
+        let is_unchanged = fs::metadata(&path).is_ok_and(|m| m.len() == len)
+            && hash_file_contents(&path).is_ok_and(|old_hash| old_hash == hasher.finish());
+        if is_unchanged {
+            fs::remove_file(&tmp_path)?;
+        } else {
+            fs::rename(&tmp_path, &path)?;
+        }
+        Ok(!is_unchanged)
+    }
+}
+
+impl Write for OutputFile {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        let written = self.file.write(buf)?;
+        self.hasher.write(&buf[..written]);
+        self.len += written as u64;
+        Ok(written)
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        self.file.flush()
+    }
+}
+
+/// Hashes like [OutputFile] does, [Hasher::write] doesn't depend on how the bytes are split up
+fn hash_file_contents(path: &Path) -> io::Result<u64> {
+    let mut file = File::open(path)?;
+    let mut hasher = DefaultHasher::new();
+    let mut chunk = vec![0; HASH_CHUNK_SIZE];
+    loop {
+        match file.read(&mut chunk) {
+            Ok(0) => return Ok(hasher.finish()),
+            Ok(num_read) => hasher.write(&chunk[..num_read]),
+            Err(err) if err.kind() == io::ErrorKind::Interrupted => {}
+            Err(err) => return Err(err),
+        }
+    }
+}
+
+/// Writes everything to both writers. Used to fill the codegen cache while generating an output file
+pub struct TeeWriter<'a>(pub &'a mut dyn Write, pub &'a mut dyn Write);
+
+impl Write for TeeWriter<'_> {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.0.write_all(buf)?;
+        self.1.write_all(buf)?;
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        self.0.flush()?;
+        self.1.flush()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn write_output(path: &Path, chunks: &[&str]) -> bool {
+        let mut out = OutputFile::create(path.to_owned()).unwrap();
+        for chunk in chunks {
+            out.write_all(chunk.as_bytes()).unwrap();
+        }
+        out.finish().unwrap()
+    }
+
+    #[test]
+    fn unchanged_files_are_not_replaced() {
+        let dir = std::env::temp_dir().join(format!("sus_output_file_test{}", std::process::id()));
+        fs::create_dir_all(&dir).unwrap();
+        let path = dir.join("out.sv");
+
+        assert!(write_output(&path, &["module a;", " endmodule\n"]));
+        // Split differently, hashing must not depend on that
+        assert!(!write_output(&path, &["module a; endmodule", "\n"]));
+        assert!(write_output(&path, &["module b; endmodule\n"]));
+        assert_eq!(fs::read_to_string(&path).unwrap(), "module b; endmodule\n");
+        assert_eq!(
+            fs::read_dir(&dir).unwrap().count(),
+            1,
+            "Temporary files must be removed"
+        );
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
@@ -1,6 +1,8 @@
 //! Shared utilities
 
 use std::borrow::Cow;
+use std::fmt;
+use std::io;
 
 use crate::instantiation::RealWire;
 
@@ -17,10 +19,19 @@ pub fn wire_name_with_latency(
             Cow::Owned(format!("_{}_D{}", wire.name, absolute_latency))
         }
     } else {
-        Cow::Borrowed(&wire.name)
+        Cow::Borrowed(wire.name.as_str())
     }
 }
 
 pub fn wire_name_self_latency(wire: &RealWire, use_latency: bool) -> Cow<str> {
     wire_name_with_latency(wire, wire.absolute_latency, use_latency)
 }
+
+/// Lets the code generators, which produce text through [fmt::Write], stream directly into an [io::Write] like a file
+pub struct IoWriteAdapter<'w>(pub &'w mut dyn io::Write);
+
+impl fmt::Write for IoWriteAdapter<'_> {
+    fn write_str(&mut self, s: &str) -> fmt::Result {
+        self.0.write_all(s.as_bytes()).map_err(|_| fmt::Error)
+    }
+}
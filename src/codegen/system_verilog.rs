@@ -1,6 +1,7 @@
 use std::borrow::Cow;
 use std::ops::Deref;
 
+use crate::config::config;
 use crate::linker::{IsExtern, LinkInfo};
 use crate::prelude::*;
 
@@ -8,8 +9,9 @@ use crate::flattening::{DeclarationKind, Instruction, Module, Port};
 use crate::instantiation::{
     InstantiatedModule, RealWire, RealWireDataSource, RealWirePathElem, CALCULATE_LATENCY_LATER,
 };
+use crate::typing::concrete_type::{ConcreteType, InstanceType};
 use crate::typing::template::TVec;
-use crate::{typing::concrete_type::ConcreteType, value::Value};
+use crate::value::Value;
 
 use super::shared::*;
 use std::fmt::Write;
@@ -30,8 +32,9 @@ impl super::CodeGenBackend for VerilogCodegenBackend {
         instance: &InstantiatedModule,
         linker: &Linker,
         use_latency: bool,
-    ) -> String {
-        gen_verilog_code(md, instance, linker, use_latency)
+        out: &mut dyn std::io::Write,
+    ) {
+        gen_verilog_code(md, instance, linker, use_latency, &mut IoWriteAdapter(out));
     }
 }
 
@@ -61,20 +64,57 @@ fn typ_to_declaration(mut typ: &ConcreteType, var_name: &str) -> String {
     }
 }
 
-struct CodeGenerationContext<'g> {
-    /// Generate code to this variable
-    program_text: String,
+/// The array holding the delayed copies of `wire`, for [crate::config::ConfigStruct::shift_registers]
+fn shift_register_name(wire: &RealWire) -> String {
+    format!("_{}_delay", wire.name)
+}
+
+/// Shift registers are indexed by absolute latency, so negative indices are normal
+fn shift_register_ref(array_name: &str, latency: i64) -> String {
+    format!("{array_name}[{latency}]")
+}
+
+/// Declares the copies of `from` at the absolute latencies `first..=last`, and shifts them by one every cycle
+fn write_shift_register(
+    out: &mut impl Write,
+    typ: &ConcreteType,
+    array_name: &str,
+    from: &str,
+    clk_name: &str,
+    first: i64,
+    last: i64,
+) -> std::fmt::Result {
+    let var_decl = typ_to_declaration(typ, &format!("{array_name}[{first}:{last}]"));
+    write!(
+        out,
+        "/*latency*/ logic {var_decl}; always_ff @(posedge {clk_name}) begin {array_name}[{first}] <= {from};"
+    )?;
+    if first < last {
+        write!(
+            out,
+            " for(int i = {}; i <= {last}; i = i + 1) {array_name}[i] <= {array_name}[i - 1];",
+            first + 1
+        )?;
+    }
+    writeln!(out, " end")
+}
+
+struct CodeGenerationContext<'g, 'out, Stream: std::fmt::Write> {
+    /// Generate code to this stream
+    program_text: &'out mut Stream,
 
     md: &'g Module,
     instance: &'g InstantiatedModule,
     linker: &'g Linker,
 
     use_latency: bool,
+    /// See [crate::config::ConfigStruct::shift_registers]
+    use_shift_registers: bool,
 
     needed_untils: FlatAlloc<i64, WireIDMarker>,
 }
 
-impl<'g> CodeGenerationContext<'g> {
+impl<'g, Stream: std::fmt::Write> CodeGenerationContext<'g, '_, Stream> {
     /// This is for making the resulting Verilog a little nicer to read
     fn can_inline(&self, wire: &RealWire) -> bool {
         match &wire.source {
@@ -97,6 +137,14 @@ impl<'g> CodeGenerationContext<'g> {
         let wire = &self.instance.wires[wire_id];
         if self.can_inline(wire) {
             self.operation_to_string(wire)
+        } else if self.use_shift_registers
+            && self.use_latency
+            && wire.absolute_latency != requested_latency
+        {
+            Cow::Owned(shift_register_ref(
+                &shift_register_name(wire),
+                requested_latency,
+            ))
         } else {
             wire_name_with_latency(wire, requested_latency, self.use_latency)
         }
@@ -124,6 +172,10 @@ impl<'g> CodeGenerationContext<'g> {
             // Can do 0 iterations, when w.needed_until == w.absolute_latency. Meaning it's only needed this cycle
             assert!(w.absolute_latency != CALCULATE_LATENCY_LATER);
             assert!(self.needed_untils[wire_id] != CALCULATE_LATENCY_LATER);
+            if self.use_shift_registers {
+                self.add_latency_shift_register(wire_id, w);
+                return Ok(());
+            }
             for i in w.absolute_latency..self.needed_untils[wire_id] {
                 let from = wire_name_with_latency(w, i, self.use_latency);
                 let to = wire_name_with_latency(w, i + 1, self.use_latency);
@@ -140,10 +192,42 @@ impl<'g> CodeGenerationContext<'g> {
         Ok(())
     }
 
-    fn comment_out(&mut self, f: impl FnOnce(&mut Self)) {
-        let store_program_text_temporary = std::mem::take(&mut self.program_text);
-        f(self);
-        let added_text = std::mem::replace(&mut self.program_text, store_program_text_temporary);
+    /// Like the registers of [Self::add_latency_registers], but as a single array indexed by absolute latency,
+    /// such that the output size doesn't grow with the pipeline depth. [Self::wire_name] refers into this array
+    fn add_latency_shift_register(&mut self, wire_id: WireID, w: &RealWire) {
+        let first = w.absolute_latency + 1;
+        let last = self.needed_untils[wire_id];
+        if first > last {
+            return;
+        }
+        let from = wire_name_self_latency(w, self.use_latency);
+        let clk_name = self.md.get_clock_name();
+        write_shift_register(
+            self.program_text,
+            &w.typ,
+            &shift_register_name(w),
+            &from,
+            clk_name,
+            first,
+            last,
+        )
+        .unwrap();
+    }
+
+    /// Code generated by `f` is written as a comment. It's generated separately, so it can be prefixed with `//`
+    fn comment_out(&mut self, f: impl FnOnce(&mut CodeGenerationContext<'g, '_, String>)) {
+        let mut added_text = String::new();
+        let mut commented_ctx = CodeGenerationContext {
+            program_text: &mut added_text,
+            md: self.md,
+            instance: self.instance,
+            linker: self.linker,
+            use_latency: self.use_latency,
+            use_shift_registers: self.use_shift_registers,
+            needed_untils: std::mem::take(&mut self.needed_untils),
+        };
+        f(&mut commented_ctx);
+        self.needed_untils = commented_ctx.needed_untils;
 
         writeln!(
             self.program_text,
@@ -155,7 +239,7 @@ impl<'g> CodeGenerationContext<'g> {
 
     fn write_verilog_code(&mut self) {
         self.comment_out(|new_self| {
-            let name = &self.instance.name;
+            let name = &new_self.instance.name;
             write!(new_self.program_text, "{name}").unwrap();
         });
         match self.md.link_info.is_extern {
@@ -219,10 +303,10 @@ impl<'g> CodeGenerationContext<'g> {
                 let v_str = value.inline_constant_to_string();
                 writeln!(self.program_text, "{to} = {v_str};").unwrap();
             }
-            Value::Array(arr) => {
-                for (idx, v) in arr.iter().enumerate() {
+            Value::Array(_) | Value::BoolArray(_) | Value::IntArray(_) => {
+                for (idx, v) in value.array_iter().enumerate() {
                     let new_to = format!("{to}[{idx}]");
-                    self.write_constant(&new_to, v);
+                    self.write_constant(&new_to, &v);
                 }
             }
             Value::Error => unreachable!("Error values should never have reached codegen!"),
@@ -341,14 +425,14 @@ impl<'g> CodeGenerationContext<'g> {
     fn write_template_args(
         &mut self,
         link_info: &LinkInfo,
-        concrete_template_args: &TVec<ConcreteType>,
+        concrete_template_args: &TVec<InstanceType>,
     ) {
         self.program_text.write_str(&link_info.name).unwrap();
         self.program_text.write_str(" #(").unwrap();
         let mut first = true;
         concrete_template_args.iter().for_each(|(arg_id, arg)| {
             let arg_name = &link_info.template_parameters[arg_id].name;
-            let arg_value = match arg {
+            let arg_value = match &**arg {
                 ConcreteType::Named(..) | ConcreteType::Array(..) => {
                     unreachable!("No extern module type arguments. Should have been caught by Lint")
                 }
@@ -477,7 +561,9 @@ impl Value {
             Value::Bool(b) => Cow::Borrowed(if *b { "1'b1" } else { "1'b0" }),
             Value::Integer(v) => Cow::Owned(v.to_string()),
             Value::Unset => Cow::Borrowed("'x"),
-            Value::Array(_) => unreachable!("Not an inline constant!"),
+            Value::Array(_) | Value::BoolArray(_) | Value::IntArray(_) => {
+                unreachable!("Not an inline constant!")
+            }
             Value::Error => unreachable!("Error values should never have reached codegen!"),
         }
     }
@@ -515,16 +601,57 @@ fn gen_verilog_code(
     instance: &InstantiatedModule,
     linker: &Linker,
     use_latency: bool,
-) -> String {
+    program_text: &mut impl std::fmt::Write,
+) {
     let mut ctx = CodeGenerationContext {
         md,
         instance,
         linker,
-        program_text: String::new(),
+        program_text,
         use_latency,
+        use_shift_registers: config().shift_registers,
         needed_untils: instance.compute_needed_untils(),
     };
     ctx.write_verilog_code();
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::typing::concrete_type::{BOOL_CONCRETE_TYPE, INT_CONCRETE_TYPE};
 
-    ctx.program_text
+    fn shift_register_text(typ: &ConcreteType, from: &str, first: i64, last: i64) -> String {
+        let mut text = String::new();
+        let array_name = format!("_{from}_delay");
+        write_shift_register(&mut text, typ, &array_name, from, "clk", first, last).unwrap();
+        text
+    }
+
+    #[test]
+    fn shift_register_shifts_all_copies() {
+        assert_eq!(
+            shift_register_text(&INT_CONCRETE_TYPE, "x", 1, 3),
+            "/*latency*/ logic [31:0] _x_delay[1:3]; always_ff @(posedge clk) begin _x_delay[1] <= x; \
+            for(int i = 2; i <= 3; i = i + 1) _x_delay[i] <= _x_delay[i - 1]; end\n"
+        );
+        assert_eq!(shift_register_ref("_x_delay", 3), "_x_delay[3]");
+    }
+
+    #[test]
+    fn shift_register_with_negative_latencies() {
+        assert_eq!(
+            shift_register_text(&BOOL_CONCRETE_TYPE, "b", -4, -2),
+            "/*latency*/ logic  _b_delay[-4:-2]; always_ff @(posedge clk) begin _b_delay[-4] <= b; \
+            for(int i = -3; i <= -2; i = i + 1) _b_delay[i] <= _b_delay[i - 1]; end\n"
+        );
+        assert_eq!(shift_register_ref("_b_delay", -2), "_b_delay[-2]");
+    }
+
+    #[test]
+    fn shift_register_of_one_copy_has_no_loop() {
+        assert_eq!(
+            shift_register_text(&INT_CONCRETE_TYPE, "y", -1, -1),
+            "/*latency*/ logic [31:0] _y_delay[-1:-1]; always_ff @(posedge clk) begin _y_delay[-1] <= y; end\n"
+        );
+    }
 }
@@ -25,8 +25,9 @@ impl super::CodeGenBackend for VHDLCodegenBackend {
         instance: &InstantiatedModule,
         _linker: &Linker,
         use_latency: bool,
-    ) -> String {
-        gen_vhdl_code(md, instance, use_latency)
+        out: &mut dyn std::io::Write,
+    ) {
+        gen_vhdl_code(md, instance, use_latency, &mut IoWriteAdapter(out));
     }
 }
 
@@ -165,18 +166,20 @@ impl<Stream: std::fmt::Write> CodeGenerationContext<'_, '_, Stream> {
 
 // TODO This should be removed as soon as this feature is usable
 #[allow(unreachable_code)]
-fn gen_vhdl_code(_md: &Module, _instance: &InstantiatedModule, _use_latency: bool) -> String {
+fn gen_vhdl_code(
+    _md: &Module,
+    _instance: &InstantiatedModule,
+    _use_latency: bool,
+    program_text: &mut impl std::fmt::Write,
+) {
     todo!("VHDl codegen is unfinshed");
-    let mut program_text = String::new();
 
     let mut ctx = CodeGenerationContext {
         md: _md,
         instance: _instance,
         use_latency: _use_latency,
-        program_text: &mut program_text,
+        program_text,
         _needed_untils: _instance.compute_needed_untils(),
     };
     ctx.write_vhdl_code();
-
-    program_text
 }
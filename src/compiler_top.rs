@@ -1,17 +1,20 @@
+use std::cell::RefCell;
+use std::collections::HashSet;
 use std::ffi::OsStr;
 use std::path::{Path, PathBuf};
 use std::str::FromStr;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
 
 use crate::config::EarlyExitUpTo;
 use crate::linker::AFTER_INITIAL_PARSE_CP;
 use crate::prelude::*;
 
 use sus_proc_macro::{get_builtin_const, get_builtin_type};
-use tree_sitter::Parser;
+use tree_sitter::{InputEdit, Parser, Point, Tree};
 
 use crate::{
     config::config, debug::SpanDebugger, errors::ErrorStore, file_position::FileText,
-    linker::FileData,
+    linker::FileData, stats, tree_sitter_alloc,
 };
 
 use crate::flattening::{
@@ -20,6 +23,109 @@ use crate::flattening::{
 
 const STD_LIB_PATH: &str = env!("SUS_COMPILER_STD_LIB_PATH");
 
+thread_local! {
+    /// Creating a [Parser] and setting its language is not free, so every thread keeps one for all files it parses
+    static PARSER: RefCell<Parser> = RefCell::new({
+        let mut parser = Parser::new();
+        parser.set_language(&tree_sitter_sus::language()).unwrap();
+        parser
+    });
+}
+
+/// `old_tree` must already have been [Tree::edit]ed to match `text`
+///
+/// Each parse is a statistics item, which counts the parse tree memory it allocated. See [tree_sitter_alloc]
+fn parse_sus(text: &str, old_tree: Option<&Tree>, file_name: impl FnOnce() -> String) -> Tree {
+    let timer = stats::ItemTimer::start("parse");
+    let (tree, tree_bytes) = tree_sitter_alloc::measure_allocated(|| {
+        PARSER.with_borrow_mut(|parser| parser.parse(text, old_tree).unwrap())
+    });
+    stats::count(|c| c.heap_bytes += tree_bytes);
+    timer.finish(file_name);
+    tree
+}
+
+/// Reads and parses the files on [crate::config::ConfigStruct::jobs] threads. The results are in the order of `paths`
+fn read_and_parse_files(paths: &[PathBuf]) -> Vec<std::io::Result<(String, Tree)>> {
+    let read_and_parse = |path: &PathBuf| {
+        let text = std::fs::read_to_string(path)?;
+        let tree = parse_sus(&text, None, || path.to_string_lossy().into_owned());
+        Ok((text, tree))
+    };
+
+    if config().jobs <= 1 || paths.len() <= 1 {
+        return paths.iter().map(read_and_parse).collect();
+    }
+
+    let next_file = &AtomicUsize::new(0);
+    let num_threads = usize::min(config().jobs, paths.len());
+    let mut results: Vec<(usize, std::io::Result<(String, Tree)>)> = std::thread::scope(|scope| {
+        let workers: Vec<_> = (0..num_threads)
+            .map(|_| {
+                scope.spawn(move || {
+                    let mut parsed = Vec::new();
+                    loop {
+                        let idx = next_file.fetch_add(1, Ordering::Relaxed);
+                        let Some(path) = paths.get(idx) else {
+                            break parsed;
+                        };
+                        parsed.push((idx, read_and_parse(path)));
+                    }
+                })
+            })
+            .collect();
+        workers
+            .into_iter()
+            .flat_map(|worker| worker.join().unwrap())
+            .collect()
+    });
+    results.sort_by_key(|(idx, _)| *idx);
+    results.into_iter().map(|(_, result)| result).collect()
+}
+
+/// Finds the single edit that turns `old` into `new`, by stripping their common prefix and suffix.
+///
+/// This lets [tree_sitter::Tree::edit] prepare the old tree for incremental reparsing.
+fn compute_input_edit(old: &FileText, new: &FileText) -> InputEdit {
+    let old_bytes = old.file_text.as_bytes();
+    let new_bytes = new.file_text.as_bytes();
+
+    let mut prefix_len = old_bytes
+        .iter()
+        .zip(new_bytes)
+        .take_while(|(a, b)| a == b)
+        .count();
+    while !old.file_text.is_char_boundary(prefix_len) {
+        prefix_len -= 1;
+    }
+    let max_suffix_len = usize::min(old_bytes.len(), new_bytes.len()) - prefix_len;
+    let mut suffix_len = old_bytes
+        .iter()
+        .rev()
+        .zip(new_bytes.iter().rev())
+        .take(max_suffix_len)
+        .take_while(|(a, b)| a == b)
+        .count();
+    while !old.file_text.is_char_boundary(old_bytes.len() - suffix_len) {
+        suffix_len -= 1;
+    }
+
+    let old_end_byte = old_bytes.len() - suffix_len;
+    let new_end_byte = new_bytes.len() - suffix_len;
+    let to_point = |text: &FileText, byte: usize| {
+        let linecol = text.byte_to_line_byte_col(byte);
+        Point::new(linecol.line, linecol.col)
+    };
+    InputEdit {
+        start_byte: prefix_len,
+        old_end_byte,
+        new_end_byte,
+        start_position: to_point(old, prefix_len),
+        old_end_position: to_point(old, old_end_byte),
+        new_end_position: to_point(new, new_end_byte),
+    }
+}
+
 /// Any extra operations that should happen when files are added or removed from the linker. Such as caching line offsets.
 pub trait LinkerExtraFileInfoManager {
     /// This is there to give an acceptable identifier that can be printed
@@ -93,13 +199,34 @@ impl Linker {
             .collect::<Result<Vec<_>, std::io::Error>>()
             .unwrap();
         files.sort();
-        for file in files {
-            let file_path = file.canonicalize().unwrap();
-            if file_path.is_file() && file_path.extension() == Some(OsStr::new("sus")) {
-                let file_text = std::fs::read_to_string(&file_path).unwrap();
-                let file_identifier: String = info_mngr.convert_filename(&file_path);
-                self.add_file(file_identifier, file_text, info_mngr);
-            }
+        let sus_files: Vec<PathBuf> = files
+            .into_iter()
+            .map(|file| file.canonicalize().unwrap())
+            .filter(|file_path| {
+                file_path.is_file() && file_path.extension() == Some(OsStr::new("sus"))
+            })
+            .collect();
+        self.add_files(&sus_files, info_mngr);
+    }
+
+    /// The files are read and parsed in parallel (see [read_and_parse_files]), but added in the given order,
+    /// such that they get the same [FileUUID]s and global IDs as when adding them one by one
+    pub fn add_files<ExtraInfoManager: LinkerExtraFileInfoManager>(
+        &mut self,
+        file_paths: &[PathBuf],
+        info_mngr: &mut ExtraInfoManager,
+    ) {
+        let parsed_files = stats::time_phase("parse", || read_and_parse_files(file_paths));
+        for (file_path, parsed) in file_paths.iter().zip(parsed_files) {
+            let (file_text, tree) = match parsed {
+                Ok(parsed) => parsed,
+                Err(reason) => {
+                    let file_path_disp = file_path.display();
+                    panic!("Could not open file '{file_path_disp}' because {reason}")
+                }
+            };
+            let file_identifier: String = info_mngr.convert_filename(file_path);
+            self.add_parsed_file(file_identifier, file_text, tree, info_mngr);
         }
     }
 
@@ -108,6 +235,19 @@ impl Linker {
         file_identifier: String,
         text: String,
         info_mngr: &mut ExtraInfoManager,
+    ) -> FileUUID {
+        let tree = stats::time_phase("parse", || {
+            parse_sus(&text, None, || file_identifier.clone())
+        });
+        self.add_parsed_file(file_identifier, text, tree, info_mngr)
+    }
+
+    fn add_parsed_file<ExtraInfoManager: LinkerExtraFileInfoManager>(
+        &mut self,
+        file_identifier: String,
+        text: String,
+        tree: Tree,
+        info_mngr: &mut ExtraInfoManager,
     ) -> FileUUID {
         // File doesn't yet exist
         assert!(!self
@@ -115,10 +255,6 @@ impl Linker {
             .iter()
             .any(|fd| fd.1.file_identifier == file_identifier));
 
-        let mut parser = Parser::new();
-        parser.set_language(&tree_sitter_sus::language()).unwrap();
-        let tree = parser.parse(&text, None).unwrap();
-
         let file_id = self.files.reserve();
         self.files.alloc_reservation(
             file_id,
@@ -134,7 +270,7 @@ impl Linker {
         self.with_file_builder(file_id, |builder| {
             let mut span_debugger =
                 SpanDebugger::new("gather_initial_file_data in add_file", builder.file_data);
-            gather_initial_file_data(builder);
+            stats::time_phase("gather", || gather_initial_file_data(builder));
             span_debugger.defuse();
         });
 
@@ -143,8 +279,9 @@ impl Linker {
         file_id
     }
 
-    // When --feature lsp is not used, this gives a warning
-    #[allow(dead_code)]
+    /// Updating a file reuses the previous parse tree for incremental parsing.
+    /// Globals that lie before the first change keep their objects, such that they need not be recompiled.
+    /// See [Linker::recompile_incremental]
     pub fn add_or_update_file<ExtraInfoManager: LinkerExtraFileInfoManager>(
         &mut self,
         file_identifier: &str,
@@ -152,20 +289,52 @@ impl Linker {
         info_mngr: &mut ExtraInfoManager,
     ) {
         if let Some(file_id) = self.find_file(file_identifier) {
-            let file_data = self.remove_everything_in_file(file_id);
+            let new_file_text = FileText::new(text);
+
+            let file_data = &mut self.files[file_id];
+            let edit = compute_input_edit(&file_data.file_text, &new_file_text);
+            file_data.tree.edit(&edit);
+
+            let tree = stats::time_phase("parse", || {
+                parse_sus(&new_file_text.file_text, Some(&file_data.tree), || {
+                    file_identifier.to_owned()
+                })
+            });
+
+            // Text edits that don't change the tree structure aren't reported by changed_ranges
+            let first_change = file_data
+                .tree
+                .changed_ranges(&tree)
+                .map(|rng| rng.start_byte)
+                .fold(edit.start_byte, usize::min);
 
-            let mut parser = Parser::new();
-            parser.set_language(&tree_sitter_sus::language()).unwrap();
-            let tree = parser.parse(&text, None).unwrap();
+            let new_global_spans: Vec<Span> = {
+                let root = tree.root_node();
+                let mut tree_cursor = root.walk();
+                root.children_by_field_name("item", &mut tree_cursor)
+                    .map(|node| Span::from(node.byte_range()))
+                    .collect()
+            };
+            let num_to_keep = self.files[file_id]
+                .associated_values
+                .iter()
+                .zip(new_global_spans)
+                .take_while(|(global, new_span)| {
+                    let old_span = self.get_link_info(**global).span;
+                    old_span == *new_span && old_span.as_range().end < first_change
+                })
+                .count();
+
+            let file_data = self.remove_globals_in_file_after(file_id, num_to_keep);
 
             file_data.parsing_errors = ErrorStore::new();
-            file_data.file_text = FileText::new(text);
+            file_data.file_text = new_file_text;
             file_data.tree = tree;
 
             self.with_file_builder(file_id, |builder| {
                 let mut span_debugger =
                     SpanDebugger::new("gather_initial_file_data in update_file", builder.file_data);
-                gather_initial_file_data(builder);
+                stats::time_phase("gather", || gather_initial_file_data(builder));
                 span_debugger.defuse();
             });
 
@@ -180,6 +349,7 @@ impl Linker {
             .find(|_id, f| f.file_identifier == file_identifier)
     }
 
+    /// Resets all globals and recompiles everything from scratch
     pub fn recompile_all(&mut self) {
         // First reset all modules back to post-gather_initial_file_data
         for (_, md) in &mut self.modules {
@@ -198,11 +368,57 @@ impl Linker {
         for (_, cst) in &mut self.constants {
             cst.link_info.reset_to(AFTER_INITIAL_PARSE_CP);
         }
+        self.clear_changes();
+        self.interned_types.remove_unused();
+        self.names.remove_unused();
+
+        self.run_compilation_stages();
+    }
+
+    /// Only recompiles the globals affected by the files that were added, updated or removed since the last compilation.
+    ///
+    /// See [Linker::invalidate_changed_globals]
+    ///
+    /// Returns the files containing globals that were recompiled. Globals that were removed are not included,
+    /// their files were reported through [LinkerExtraFileInfoManager::on_file_updated] or [LinkerExtraFileInfoManager::before_file_remove]
+    pub fn recompile_incremental(&mut self) -> HashSet<FileUUID> {
+        let recompiled_files = self.recompile_incremental_before_instantiation();
+        let never_cancelled = AtomicBool::new(false);
+        self.instantiate_all_top_level_modules(&never_cancelled);
+        recompiled_files
+    }
+
+    /// Like [Linker::recompile_incremental], but leaves [Linker::instantiate_all_top_level_modules] to the caller.
+    /// The LSP does this on a separate thread, such that it can keep answering requests
+    // When --feature lsp is not used, this gives a warning
+    #[allow(dead_code)]
+    pub fn recompile_incremental_before_instantiation(&mut self) -> HashSet<FileUUID> {
+        let invalidated = self.invalidate_changed_globals();
+        // The instances of the invalidated globals are gone, and so are the only users of some of their types
+        self.interned_types.remove_unused();
+        self.names.remove_unused();
+        let recompiled_files = invalidated
+            .iter()
+            .map(|global| self.get_link_info(*global).file)
+            .collect();
+
+        self.run_stages_before_instantiation();
+        recompiled_files
+    }
+
+    fn run_compilation_stages(&mut self) {
+        self.run_stages_before_instantiation();
+        let never_cancelled = AtomicBool::new(false);
+        self.instantiate_all_top_level_modules(&never_cancelled);
+    }
+
+    /// Every stage only processes the globals that haven't gone through it yet. (See [crate::linker::LinkInfo::checkpoints])
+    fn run_stages_before_instantiation(&mut self) {
         if config().early_exit == EarlyExitUpTo::Initialize {
             return;
         }
 
-        flatten_all_globals(self);
+        stats::time_phase("flatten", || flatten_all_globals(self));
         config().for_each_debug_module(config().debug_print_module_contents, &self.modules, |md| {
             md.print_flattened_module(&self.files[md.link_info.file]);
         });
@@ -210,7 +426,7 @@ impl Linker {
             return;
         }
 
-        typecheck_all_modules(self);
+        stats::time_phase("typecheck", || typecheck_all_modules(self));
 
         config().for_each_debug_module(config().debug_print_module_contents, &self.modules, |md| {
             md.print_flattened_module(&self.files[md.link_info.file]);
@@ -219,27 +435,113 @@ impl Linker {
             return;
         }
 
-        perform_lints(self);
+        stats::time_phase("lints", || perform_lints(self));
+    }
 
-        if config().early_exit == EarlyExitUpTo::Lint {
-            return;
+    /// Checks that `--top` names a module that can be instantiated by itself. Only needs the files to be parsed,
+    /// such that a typo in `--top` is reported before the whole design is compiled
+    pub fn check_top_module(&self) -> Result<(), String> {
+        let Some(top_name) = &config().top_module else {
+            return Ok(());
+        };
+        let Some((_, md)) = self
+            .modules
+            .iter()
+            .find(|(_, md)| &md.link_info.name == top_name)
+        else {
+            return Err(format!("Unknown top module {top_name}"));
+        };
+        if !md.link_info.template_parameters.is_empty() {
+            return Err(format!(
+                "Top module {top_name} has template parameters. Only modules without template parameters can be the top module"
+            ));
         }
+        Ok(())
+    }
 
-        // Make an initial instantiation of all modules
-        // Won't be possible once we have template modules
-        for (_id, md) in &self.modules {
-            //md.print_flattened_module();
-            // Already instantiate any modules without parameters
-            // Currently this is all modules
-            let span_debug_message = format!("instantiating {}", &md.link_info.name);
-            let mut span_debugger =
-                SpanDebugger::new(&span_debug_message, &self.files[md.link_info.file]);
-            // Can immediately instantiate modules that have no template args
-            if md.link_info.template_parameters.is_empty() {
-                let _inst = md.instantiations.instantiate(md, self, FlatAlloc::new());
+    /// Make an initial instantiation of all modules
+    /// Won't be possible once we have template modules
+    ///
+    /// With `--top`, only that module is instantiated. Its submodules are instantiated on demand while it is being typechecked,
+    /// see [crate::instantiation::InstantiationCache::instantiate]
+    ///
+    /// With [crate::config::ConfigStruct::jobs] > 1 the modules are instantiated on multiple threads.
+    /// Submodules that are shared between them are only instantiated once, see [crate::instantiation::InstantiationCache]
+    ///
+    /// Once `cancel` is set, no new modules are started and running instantiations stop early.
+    /// Finished instances stay in their caches, so the next call only instantiates the remaining modules.
+    /// Returns `false` if it was cancelled.
+    pub fn instantiate_all_top_level_modules(&self, cancel: &AtomicBool) -> bool {
+        if matches!(
+            config().early_exit,
+            EarlyExitUpTo::Initialize
+                | EarlyExitUpTo::Flatten
+                | EarlyExitUpTo::AbstractTypecheck
+                | EarlyExitUpTo::Lint
+        ) {
+            return true;
+        }
+
+        stats::time_phase("instantiate", || {
+            self.instantiate_top_level_modules_until_cancelled(cancel)
+        })
+    }
+
+    fn instantiate_top_level_modules_until_cancelled(&self, cancel: &AtomicBool) -> bool {
+        // Can immediately instantiate modules that have no template args
+        // Currently this is all modules
+        let to_instantiate: Vec<ModuleUUID> = self
+            .modules
+            .iter()
+            .filter(|(_id, md)| md.link_info.template_parameters.is_empty())
+            .filter(|(_id, md)| {
+                config()
+                    .top_module
+                    .as_ref()
+                    .map_or(true, |top| &md.link_info.name == top)
+            })
+            .map(|(id, _md)| id)
+            .collect();
+
+        if config().jobs <= 1 || to_instantiate.len() <= 1 {
+            for md_id in to_instantiate {
+                if cancel.load(Ordering::Relaxed) {
+                    return false;
+                }
+                self.instantiate_top_level_module(md_id, cancel);
             }
-            span_debugger.defuse();
+            return !cancel.load(Ordering::Relaxed);
         }
-        if config().early_exit == EarlyExitUpTo::Instantiate {}
+
+        let to_instantiate = &to_instantiate;
+        let next_module = &AtomicUsize::new(0);
+        let num_threads = usize::min(config().jobs, to_instantiate.len());
+        std::thread::scope(|scope| {
+            for _ in 0..num_threads {
+                scope.spawn(move || loop {
+                    if cancel.load(Ordering::Relaxed) {
+                        break;
+                    }
+                    let idx = next_module.fetch_add(1, Ordering::Relaxed);
+                    let Some(md_id) = to_instantiate.get(idx) else {
+                        break;
+                    };
+                    self.instantiate_top_level_module(*md_id, cancel);
+                });
+            }
+        });
+        // Modules that were running when cancel was set are cut short, see [crate::instantiation::InstantiationCache::instantiate]
+        !cancel.load(Ordering::Relaxed)
+    }
+
+    fn instantiate_top_level_module(&self, md_id: ModuleUUID, cancel: &AtomicBool) {
+        let md = &self.modules[md_id];
+        let span_debug_message = format!("instantiating {}", &md.link_info.name);
+        let mut span_debugger =
+            SpanDebugger::new(&span_debug_message, &self.files[md.link_info.file]);
+        let _inst = md
+            .instantiations
+            .instantiate(md, self, FlatAlloc::new(), cancel);
+        span_debugger.defuse();
     }
 }
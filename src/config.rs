@@ -38,11 +38,33 @@ pub struct ConfigStruct {
     pub debug_print_latency_graph: bool,
     pub debug_whitelist: Option<HashSet<String>>,
     pub codegen_module_and_dependencies_one_file: Option<String>,
+    /// Only this module (and whatever it instantiates) is instantiated. If `None`, all modules without template parameters are
+    pub top_module: Option<String>,
     pub early_exit: EarlyExitUpTo,
     pub use_color: bool,
     pub ci: bool,
     pub target_language: TargetLanguage,
+    /// Number of worker threads the compiler may use. Always at least 1
+    pub jobs: usize,
+    /// Directory in which [crate::instantiation::InstantiationCache] persists instances between runs
+    pub cache_dir: Option<PathBuf>,
+    /// Print a table of the time spent per compilation phase, module and instance. See [crate::stats]
+    pub time_passes: bool,
+    /// File to which the statistics of [crate::stats] are written as JSON
+    pub stats_json: Option<PathBuf>,
+    /// See [crate::instantiation::InstantiatedModule::compact]
+    pub compact_instances: bool,
+    /// Keep running and recompile when files change, see [crate::dev_aid::watch]. Also set by `--server`
+    pub watch: bool,
+    /// Local TCP port on which [crate::dev_aid::watch] accepts compile requests
+    pub server_port: Option<u16>,
+    /// Generate the latency registers of a wire as one shift register, rather than one register per cycle
+    pub shift_registers: bool,
+    /// See [crate::tree_sitter_alloc]
+    pub pool_parse_trees: bool,
     pub files: Vec<PathBuf>,
+    /// No files were given, so [ConfigStruct::files] are the .sus files of the working directory. `--watch` then also picks up new ones
+    pub files_from_working_dir: bool,
 }
 
 fn command_builder() -> Command {
@@ -93,6 +115,9 @@ fn command_builder() -> Command {
         .arg(Arg::new("standalone")
             .long("standalone")
             .help("Generate standalone code with all dependencies in one file of the module specified."))
+        .arg(Arg::new("top")
+            .long("top")
+            .help("Only instantiate the module specified, and the modules it depends on. It must not have template parameters. By default, all modules without template parameters are instantiated"))
         .arg(Arg::new("upto")
             .long("upto")
             .help("Describes at what point in the compilation process we should exit early. This is mainly to aid in debugging, where incorrect results from flattening/typechecking may lead to errors, which we still wish to see in say the LSP")
@@ -111,6 +136,46 @@ fn command_builder() -> Command {
             .help("Sets the target HDL")
             .value_parser(clap::builder::EnumValueParser::<TargetLanguage>::new())
             .default_value("system-verilog"))
+        .arg(Arg::new("jobs")
+            .long("jobs")
+            .short('j')
+            .help("Number of threads the compiler may use, for instance to typecheck modules in parallel. 0 uses all available cores")
+            .value_parser(clap::value_parser!(usize))
+            .default_value("1"))
+        .arg(Arg::new("cache-dir")
+            .long("cache-dir")
+            .help("Directory in which instantiated modules are stored between runs. Modules whose source, dependencies and template arguments didn't change are loaded from here instead of being instantiated again")
+            .value_parser(clap::value_parser!(PathBuf)))
+        .arg(Arg::new("time-passes")
+            .long("time-passes")
+            .help("Print how long each compilation phase took, which modules and instances took the longest, and counters such as the number of wires and latency graph edges")
+            .action(clap::ArgAction::SetTrue))
+        .arg(Arg::new("stats-json")
+            .long("stats-json")
+            .help("Write the timings and counters of --time-passes to this file as JSON, for tracking compile times in CI")
+            .value_parser(clap::value_parser!(PathBuf)))
+        .arg(Arg::new("compact-instances")
+            .long("compact-instances")
+            .help("Reduce memory use by dropping the state only needed during instantiation, and sharing wire names between instances. Hover info in the LSP no longer shows generative values")
+            .action(clap::ArgAction::SetTrue))
+        .arg(Arg::new("shift-registers")
+            .long("shift-registers")
+            .help("Generate the latency registers of each wire as a single array shifted in one always_ff block, instead of one register per cycle. This keeps the output of deep pipelines small, and lets synthesis tools infer shift register primitives. Only supported for SystemVerilog")
+            .action(clap::ArgAction::SetTrue))
+        .arg(Arg::new("pool-parse-trees")
+            .long("pool-parse-trees")
+            .help("Allocate the nodes of parse trees from pools that are reused between parses, instead of from the system allocator. Speeds up parsing large files")
+            .action(clap::ArgAction::SetTrue))
+        .arg(Arg::new("watch")
+            .long("watch")
+            .help("Keep running after compiling. When one of the files changes, only the affected modules are recompiled, and only their output files rewritten. The output files of removed modules are deleted. Without file arguments, new .sus files in the working directory are compiled too")
+            .conflicts_with("lsp")
+            .action(clap::ArgAction::SetTrue))
+        .arg(Arg::new("server")
+            .long("server")
+            .help("Like --watch, and also accept compile requests from build scripts on this local TCP port. Each line received is answered with a line 'errors=<N> warnings=<M>' once the outputs are up to date")
+            .conflicts_with("lsp")
+            .value_parser(clap::value_parser!(u16)))
         .arg(Arg::new("files")
             .action(clap::ArgAction::Append)
             .help(".sus Files")
@@ -128,6 +193,15 @@ fn command_builder() -> Command {
             }))
 }
 
+/// The files that are compiled when none are given
+pub fn sus_files_in_working_dir() -> Vec<PathBuf> {
+    std::fs::read_dir(".")
+        .unwrap()
+        .map(|file| file.unwrap().path())
+        .filter(|file_path| file_path.is_file() && file_path.extension() == Some("sus".as_ref()))
+        .collect()
+}
+
 fn parse_args<I, T>(itr: I) -> Result<ConfigStruct, clap::Error>
 where
     I: IntoIterator<Item = T>,
@@ -147,17 +221,31 @@ where
     let use_color = !matches.get_flag("nocolor") && !use_lsp;
     let early_exit = *matches.get_one("upto").unwrap();
     let codegen_module_and_dependencies_one_file = matches.get_one("standalone").cloned();
+    let top_module = matches.get_one("top").cloned();
     let ci = matches.get_flag("ci");
     let target_language = *matches.get_one("target").unwrap();
+    let jobs = match *matches.get_one::<usize>("jobs").unwrap() {
+        0 => std::thread::available_parallelism().map_or(1, |n| n.get()),
+        jobs => jobs,
+    };
+    let cache_dir = matches.get_one::<PathBuf>("cache-dir").cloned();
+    let time_passes = matches.get_flag("time-passes");
+    let stats_json = matches.get_one::<PathBuf>("stats-json").cloned();
+    let compact_instances = matches.get_flag("compact-instances");
+    let shift_registers = matches.get_flag("shift-registers");
+    if shift_registers && target_language == TargetLanguage::Vhdl {
+        return Err(command_builder().error(
+            clap::error::ErrorKind::ArgumentConflict,
+            "--shift-registers is only supported with --target system-verilog",
+        ));
+    }
+    let pool_parse_trees = matches.get_flag("pool-parse-trees");
+    let server_port = matches.get_one::<u16>("server").copied();
+    let watch = matches.get_flag("watch") || server_port.is_some();
+    let files_from_working_dir = matches.get_many::<PathBuf>("files").is_none();
     let file_paths: Vec<PathBuf> = match matches.get_many("files") {
         Some(files) => files.cloned().collect(),
-        None => std::fs::read_dir(".")
-            .unwrap()
-            .map(|file| file.unwrap().path())
-            .filter(|file_path| {
-                file_path.is_file() && file_path.extension() == Some("sus".as_ref())
-            })
-            .collect(),
+        None => sus_files_in_working_dir(),
     };
     Ok(ConfigStruct {
         use_lsp,
@@ -168,11 +256,22 @@ where
         debug_print_latency_graph,
         debug_whitelist,
         codegen_module_and_dependencies_one_file,
+        top_module,
         early_exit,
         use_color,
         ci,
         target_language,
+        jobs,
+        cache_dir,
+        time_passes,
+        stats_json,
+        compact_instances,
+        watch,
+        server_port,
+        shift_registers,
+        pool_parse_trees,
         files: file_paths,
+        files_from_working_dir,
     })
 }
 
@@ -220,6 +319,81 @@ mod tests {
         assert!(!config.use_color)
     }
 
+    #[test]
+    fn test_jobs() {
+        let config = parse_args([""]).unwrap();
+        assert_eq!(config.jobs, 1);
+        let config = parse_args(["", "--jobs", "0"]).unwrap();
+        assert!(config.jobs >= 1);
+        let config = parse_args(["", "-j", "4"]).unwrap();
+        assert_eq!(config.jobs, 4);
+    }
+
+    #[test]
+    fn test_cache_dir() {
+        let config = parse_args([""]).unwrap();
+        assert_eq!(config.cache_dir, None);
+        let config = parse_args(["", "--cache-dir", "sus_cache"]).unwrap();
+        assert_eq!(config.cache_dir, Some("sus_cache".into()));
+    }
+
+    #[test]
+    fn test_stats() {
+        let config = parse_args([""]).unwrap();
+        assert!(!config.time_passes);
+        assert_eq!(config.stats_json, None);
+        let config = parse_args(["", "--time-passes", "--stats-json", "stats.json"]).unwrap();
+        assert!(config.time_passes);
+        assert_eq!(config.stats_json, Some("stats.json".into()));
+    }
+
+    #[test]
+    fn test_compact_instances() {
+        let config = parse_args([""]).unwrap();
+        assert!(!config.compact_instances);
+        let config = parse_args(["", "--compact-instances"]).unwrap();
+        assert!(config.compact_instances);
+    }
+
+    #[test]
+    fn test_shift_registers() {
+        let config = parse_args([""]).unwrap();
+        assert!(!config.shift_registers);
+        let config = parse_args(["", "--shift-registers"]).unwrap();
+        assert!(config.shift_registers);
+        assert!(parse_args(["", "--shift-registers", "--target", "vhdl"]).is_err());
+    }
+
+    #[test]
+    fn test_pool_parse_trees() {
+        let config = parse_args([""]).unwrap();
+        assert!(!config.pool_parse_trees);
+        let config = parse_args(["", "--pool-parse-trees"]).unwrap();
+        assert!(config.pool_parse_trees);
+    }
+
+    #[test]
+    fn test_watch() {
+        let config = parse_args([""]).unwrap();
+        assert!(!config.watch);
+        assert_eq!(config.server_port, None);
+        let config = parse_args(["", "--watch"]).unwrap();
+        assert!(config.watch);
+        assert!(config.files_from_working_dir);
+        let config = parse_args(["", "--server", "25001"]).unwrap();
+        assert!(config.watch);
+        assert_eq!(config.server_port, Some(25001));
+        assert!(parse_args(["", "--lsp", "--watch"]).is_err());
+    }
+
+    #[test]
+    fn test_top_module() {
+        let config = parse_args([""]).unwrap();
+        assert_eq!(config.top_module, None);
+        let config = parse_args(["", "--top", "Top"]).unwrap();
+        assert_eq!(config.top_module.as_deref(), Some("Top"));
+    }
+
     #[test]
     fn test_automatic_codegen() {
         let config = parse_args([""]).unwrap();
@@ -10,12 +10,21 @@ const SPAN_TOUCH_HISTORY_SIZE: usize = 256;
 const NUM_SPANS_TO_PRINT: usize = 10;
 const DEFAULT_RANGE: Range<usize> = usize::MAX..usize::MAX;
 
+/// Recording spans is on in debug builds, and can be turned on for release builds with the `debug_spans` feature.
+///
+/// When off, [add_debug_span] and [SpanDebugger] compile down to nothing, as [crate::file_position::Span::debug] is on many hot paths.
+const RECORD_SPANS: bool = cfg!(any(debug_assertions, feature = "debug_spans"));
+
 /// Register a [crate::file_position::Span] for potential printing by [PanicGuardSpanPrinter] on panic.
 ///
 /// Would like to use [crate::file_position::Span], but cannot copy the span because that would create infinite loop.
 ///
 /// So use [Range] instead.
+#[inline]
 pub fn add_debug_span(span_rng: Range<usize>) {
+    if !RECORD_SPANS {
+        return;
+    }
     // Convert to range so we don't invoke any of Span's triggers
     SPANS_HISTORY.with_borrow_mut(|history| {
         let cur_idx = history.num_spans;
@@ -88,11 +97,13 @@ pub struct SpanDebugger<'text> {
 
 impl<'text> SpanDebugger<'text> {
     pub fn new(context: &'text str, file_text: &'text FileData) -> Self {
-        SPANS_HISTORY.with_borrow_mut(|history| {
-            assert!(!history.in_use);
-            history.in_use = true;
-            history.num_spans = 0;
-        });
+        if RECORD_SPANS {
+            SPANS_HISTORY.with_borrow_mut(|history| {
+                assert!(!history.in_use);
+                history.in_use = true;
+                history.num_spans = 0;
+            });
+        }
 
         Self {
             context,
@@ -102,10 +113,12 @@ impl<'text> SpanDebugger<'text> {
     }
 
     pub fn defuse(&mut self) {
-        SPANS_HISTORY.with_borrow_mut(|history| {
-            assert!(history.in_use);
-            history.in_use = false;
-        });
+        if RECORD_SPANS {
+            SPANS_HISTORY.with_borrow_mut(|history| {
+                assert!(history.in_use);
+                history.in_use = false;
+            });
+        }
 
         self.defused = true;
     }
@@ -115,7 +128,11 @@ impl Drop for SpanDebugger<'_> {
     fn drop(&mut self) {
         if !self.defused {
             println!("Panic happened in Span-guarded context: {}", self.context);
-            print_most_recent_spans(self.file_data)
+            if RECORD_SPANS {
+                print_most_recent_spans(self.file_data)
+            } else {
+                println!("Span history is not recorded in release builds. Build with the 'debug_spans' feature to print it.");
+            }
         }
     }
 }
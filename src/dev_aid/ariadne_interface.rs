@@ -75,32 +75,20 @@ impl LinkerExtraFileInfoManager for FileSourcesManager {
     }
 }
 
-pub fn compile_all(file_paths: Vec<PathBuf>) -> (Linker, FileSourcesManager) {
+/// Fails before compiling anything if `--top` doesn't name a valid top module, see [Linker::check_top_module]
+pub fn compile_all(file_paths: Vec<PathBuf>) -> Result<(Linker, FileSourcesManager), String> {
     let mut linker = Linker::new();
     let mut file_source_manager = FileSourcesManager {
         file_sources: ArenaVector::new(),
     };
     linker.add_standard_library(&mut file_source_manager);
 
-    for file_path in file_paths {
-        let file_text = match std::fs::read_to_string(&file_path) {
-            Ok(file_text) => file_text,
-            Err(reason) => {
-                let file_path_disp = file_path.display();
-                panic!("Could not open file '{file_path_disp}' for syntax highlighting because {reason}")
-            }
-        };
-
-        linker.add_file(
-            file_path.to_string_lossy().into_owned(),
-            file_text,
-            &mut file_source_manager,
-        );
-    }
+    linker.add_files(&file_paths, &mut file_source_manager);
+    linker.check_top_module()?;
 
     linker.recompile_all();
 
-    (linker, file_source_manager)
+    Ok((linker, file_source_manager))
 }
 
 fn ariadne_config() -> Config {
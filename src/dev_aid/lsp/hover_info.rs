@@ -53,10 +53,14 @@ impl HoverCollector<'_> {
 
             md.instantiations.for_each_instance(|_template_args, inst| {
                 if is_generative {
-                    let value_str = match &inst.generation_state[id] {
-                        SubModuleOrWire::SubModule(_) | SubModuleOrWire::Wire(_) => unreachable!(),
-                        SubModuleOrWire::CompileTimeValue(v) => format!(" = {}", v),
-                        SubModuleOrWire::Unnasigned => "never assigned to".to_string(),
+                    // The generation state is gone from instances compacted with --compact-instances
+                    let value_str = match inst.generation_state.get(id) {
+                        Some(SubModuleOrWire::SubModule(_) | SubModuleOrWire::Wire(_)) => {
+                            unreachable!()
+                        }
+                        Some(SubModuleOrWire::CompileTimeValue(v)) => format!(" = {}", v),
+                        Some(SubModuleOrWire::Unnasigned) => "never assigned to".to_string(),
+                        None => "compacted away".to_string(),
                     };
                     self.monospace(value_str);
                 } else {
@@ -1,4 +1,5 @@
 mod hover_info;
+mod reference_index;
 mod semantic_tokens;
 mod tree_walk;
 
@@ -6,15 +7,25 @@ use crate::{compiler_top::LinkerExtraFileInfoManager, linker::GlobalUUID, prelud
 
 use hover_info::hover;
 use lsp_types::{notification::*, request::Request, *};
-use semantic_tokens::{make_semantic_tokens, semantic_token_capabilities};
-use std::{collections::HashMap, error::Error, net::SocketAddr, path::Path};
+use reference_index::ReferenceIndex;
+use semantic_tokens::{
+    make_semantic_tokens, make_semantic_tokens_delta, make_semantic_tokens_in_range,
+    semantic_token_capabilities, SemanticTokensCache,
+};
+use std::{
+    collections::{HashMap, VecDeque},
+    error::Error,
+    net::SocketAddr,
+    path::Path,
+    sync::atomic::{AtomicBool, Ordering},
+    time::Duration,
+};
 
 use crate::{
     config::config,
     errors::{CompileError, ErrorLevel},
     file_position::{FileText, LineCol},
     flattening::Instruction,
-    linker::FileData,
 };
 
 use tree_walk::{get_selected_object, InGlobal, LocationInfo};
@@ -78,28 +89,31 @@ impl Linker {
     fn find_uri(&self, uri: &Url) -> Option<FileUUID> {
         self.find_file(uri.as_str())
     }
-    fn update_text(&mut self, uri: &Url, new_file_text: String, manager: &mut LSPFileManager) {
-        self.add_or_update_file(uri.as_str(), new_file_text, manager);
-
-        self.recompile_all();
+    /// Instantiation is left to [instantiate_in_background]
+    fn recompile_incremental_for_lsp(&mut self, manager: &mut LSPFileManager) {
+        for file_id in self.recompile_incremental_before_instantiation() {
+            manager.reference_index.invalidate_file(file_id);
+        }
+        manager.needs_instantiation = true;
     }
-    fn ensure_contains_file(&mut self, uri: &Url, manager: &mut LSPFileManager) -> FileUUID {
-        if let Some(found) = self.find_uri(uri) {
-            found
-        } else {
+    fn ensure_contains_file(&mut self, uri: &Url, manager: &mut LSPFileManager) {
+        if self.find_uri(uri).is_none() {
             let file_text = std::fs::read_to_string(uri.to_file_path().unwrap()).unwrap();
 
-            let file_uuid = self.add_file(uri.to_string(), file_text, manager);
-            self.recompile_all();
-            file_uuid
+            self.add_file(uri.to_string(), file_text, manager);
+            self.recompile_incremental_for_lsp(manager);
         }
     }
+    /// The main loop has already added the file of the request, see [requested_file]
+    fn expect_file(&self, uri: &Url) -> FileUUID {
+        self.find_uri(uri)
+            .expect("The main loop ensures the file of a request was added")
+    }
     fn location_in_file(
-        &mut self,
+        &self,
         text_pos: &lsp_types::TextDocumentPositionParams,
-        manager: &mut LSPFileManager,
     ) -> (FileUUID, usize) {
-        let file_id = self.ensure_contains_file(&text_pos.text_document.uri, manager);
+        let file_id = self.expect_file(&text_pos.text_document.uri);
         let file_data = &self.files[file_id];
 
         let position = file_data
@@ -160,10 +174,35 @@ fn convert_diagnostic(
     )
 }
 
-fn push_all_errors(
+fn publish_diagnostics(
+    connection: &lsp_server::Connection,
+    uri: Url,
+    diagnostics: Vec<Diagnostic>,
+) -> Result<(), Box<dyn Error + Sync + Send>> {
+    let params = &PublishDiagnosticsParams {
+        uri,
+        diagnostics,
+        version: None,
+    };
+    let params_json = serde_json::to_value(params)?;
+
+    connection.sender.send(lsp_server::Message::Notification(
+        lsp_server::Notification {
+            method: PublishDiagnostics::METHOD.to_owned(),
+            params: params_json,
+        },
+    ))?;
+    Ok(())
+}
+
+/// Only sends the diagnostics of files for which they differ from what the client already has.
+/// Files that were removed from the [Linker] get their diagnostics cleared
+fn push_changed_errors(
     connection: &lsp_server::Connection,
     linker: &Linker,
+    manager: &mut LSPFileManager,
 ) -> Result<(), Box<dyn Error + Sync + Send>> {
+    let mut current_diagnostics: HashMap<Url, Vec<Diagnostic>> = HashMap::new();
     for (file_id, file_data) in &linker.files {
         let mut diag_vec: Vec<Diagnostic> = Vec::new();
 
@@ -171,34 +210,59 @@ fn push_all_errors(
             diag_vec.push(convert_diagnostic(err, &file_data.file_text, linker));
         });
 
-        let params = &PublishDiagnosticsParams {
-            uri: Url::parse(&file_data.file_identifier).unwrap(),
-            diagnostics: diag_vec,
-            version: None,
-        };
-        let params_json = serde_json::to_value(params)?;
+        current_diagnostics.insert(Url::parse(&file_data.file_identifier).unwrap(), diag_vec);
+    }
 
-        connection.sender.send(lsp_server::Message::Notification(
-            lsp_server::Notification {
-                method: PublishDiagnostics::METHOD.to_owned(),
-                params: params_json,
-            },
-        ))?;
+    let published = &manager.published_diagnostics;
+    for (uri, diagnostics) in &current_diagnostics {
+        // Files the client never got diagnostics for have none
+        let unchanged = match published.get(uri) {
+            Some(published_diagnostics) => published_diagnostics == diagnostics,
+            None => diagnostics.is_empty(),
+        };
+        if !unchanged {
+            publish_diagnostics(connection, uri.clone(), diagnostics.clone())?;
+        }
+    }
+    for uri in published.keys() {
+        if !current_diagnostics.contains_key(uri) {
+            publish_diagnostics(connection, uri.clone(), Vec::new())?;
+        }
     }
+
+    manager.published_diagnostics = current_diagnostics;
     Ok(())
 }
 
-struct LSPFileManager {}
+#[derive(Default)]
+struct LSPFileManager {
+    reference_index: ReferenceIndex,
+    semantic_tokens_cache: SemanticTokensCache,
+    /// Globals were recompiled, but their instantiation hasn't finished yet
+    needs_instantiation: bool,
+    /// What was last sent for each file, see [push_changed_errors]
+    published_diagnostics: HashMap<Url, Vec<Diagnostic>>,
+}
 
 impl LinkerExtraFileInfoManager for LSPFileManager {
     fn convert_filename(&self, path: &Path) -> String {
         Url::from_file_path(path).unwrap().into()
     }
+    fn on_file_added(&mut self, file_id: FileUUID, _linker: &Linker) {
+        self.reference_index.invalidate_file(file_id);
+    }
+    fn on_file_updated(&mut self, file_id: FileUUID, _linker: &Linker) {
+        self.reference_index.invalidate_file(file_id);
+    }
+    fn before_file_remove(&mut self, file_id: FileUUID, _linker: &Linker) {
+        self.reference_index.invalidate_file(file_id);
+        self.semantic_tokens_cache.forget_file(file_id);
+    }
 }
 
 fn initialize_all_files(init_params: &InitializeParams) -> (Linker, LSPFileManager) {
     let mut linker = Linker::new();
-    let mut manager = LSPFileManager {};
+    let mut manager = LSPFileManager::default();
 
     linker.add_standard_library(&mut manager);
 
@@ -255,43 +319,18 @@ fn gather_completions(linker: &Linker, file_id: FileUUID, position: usize) -> Ve
     result
 }
 
-fn gather_references_in_file(
+fn gather_all_references_in_one_file(
     linker: &Linker,
-    file_data: &FileData,
-    refers_to: RefersTo,
-) -> Vec<Span> {
-    let mut ref_locations = Vec::new();
-    tree_walk::visit_all(linker, file_data, |span, info| {
-        if refers_to.refers_to_same_as(info) {
-            ref_locations.push(span);
-        }
-    });
-    ref_locations
-}
-
-fn for_each_local_reference_in_global(
-    linker: &Linker,
-    obj_id: GlobalUUID,
-    local: FlatID,
+    reference_index: &mut ReferenceIndex,
+    file_id: FileUUID,
+    pos: usize,
 ) -> Vec<Span> {
-    let mut ref_locations = Vec::new();
-    tree_walk::visit_all_in_module(linker, obj_id, |span, info| {
-        if let LocationInfo::InGlobal(_, _, f_id, _) = info {
-            if local == f_id {
-                ref_locations.push(span);
-            }
-        }
-    });
-    ref_locations
-}
-
-fn gather_all_references_in_one_file(linker: &Linker, file_id: FileUUID, pos: usize) -> Vec<Span> {
     if let Some((_location, hover_info)) = get_selected_object(linker, file_id, pos) {
         let refers_to = RefersTo::from(hover_info);
         if refers_to.is_global() {
-            gather_references_in_file(linker, &linker.files[file_id], refers_to)
+            reference_index.references_in_file(linker, file_id, refers_to)
         } else if let Some(local) = refers_to.local {
-            for_each_local_reference_in_global(linker, local.0, local.1)
+            reference_index.references_to_local(linker, local.0, local.1)
         } else {
             Vec::new()
         }
@@ -302,6 +341,7 @@ fn gather_all_references_in_one_file(linker: &Linker, file_id: FileUUID, pos: us
 
 fn gather_all_references_across_all_files(
     linker: &Linker,
+    reference_index: &mut ReferenceIndex,
     file_id: FileUUID,
     pos: usize,
 ) -> Vec<(FileUUID, Vec<Span>)> {
@@ -310,8 +350,9 @@ fn gather_all_references_across_all_files(
     if let Some((location, hover_info)) = get_selected_object(linker, file_id, pos) {
         let refers_to = RefersTo::from(hover_info);
         if refers_to.is_global() {
-            for (other_file_id, other_file) in &linker.files {
-                let found_refs = gather_references_in_file(linker, other_file, refers_to);
+            for (other_file_id, _other_file) in &linker.files {
+                let found_refs =
+                    reference_index.references_in_file(linker, other_file_id, refers_to);
                 for r in &found_refs {
                     assert!(location.size() == r.size())
                 }
@@ -320,7 +361,7 @@ fn gather_all_references_across_all_files(
                 }
             }
         } else if let Some(local) = refers_to.local {
-            let found_refs = for_each_local_reference_in_global(linker, local.0, local.1);
+            let found_refs = reference_index.references_to_local(linker, local.0, local.1);
             for r in &found_refs {
                 assert!(location.size() == r.size())
             }
@@ -335,7 +376,7 @@ fn gather_all_references_across_all_files(
 fn handle_request(
     method: &str,
     params: serde_json::Value,
-    linker: &mut Linker,
+    linker: &Linker,
     manager: &mut LSPFileManager,
 ) -> Result<serde_json::Value, serde_json::Error> {
     match method {
@@ -344,8 +385,7 @@ fn handle_request(
                 serde_json::from_value(params).expect("JSON Encoding Error while parsing params");
             println!("HoverRequest");
 
-            let (file_uuid, pos) =
-                linker.location_in_file(&params.text_document_position_params, manager);
+            let (file_uuid, pos) = linker.location_in_file(&params.text_document_position_params);
             let file_data = &linker.files[file_uuid];
             let mut hover_list: Vec<MarkedString> = Vec::new();
 
@@ -370,8 +410,7 @@ fn handle_request(
                 serde_json::from_value(params).expect("JSON Encoding Error while parsing params");
             println!("GotoDefinition");
 
-            let (file_uuid, pos) =
-                linker.location_in_file(&params.text_document_position_params, manager);
+            let (file_uuid, pos) = linker.location_in_file(&params.text_document_position_params);
 
             let mut goto_definition_list: Vec<SpanFile> = Vec::new();
 
@@ -420,22 +459,58 @@ fn handle_request(
             let params: SemanticTokensParams =
                 serde_json::from_value(params).expect("JSON Encoding Error while parsing params");
 
-            let uuid = linker.ensure_contains_file(&params.text_document.uri, manager);
+            let uuid = linker.expect_file(&params.text_document.uri);
 
             serde_json::to_value(SemanticTokensResult::Tokens(make_semantic_tokens(
-                uuid, linker,
+                uuid,
+                linker,
+                &mut manager.semantic_tokens_cache,
             )))
         }
+        request::SemanticTokensFullDeltaRequest::METHOD => {
+            println!("SemanticTokensFullDeltaRequest: {params}");
+            let params: SemanticTokensDeltaParams =
+                serde_json::from_value(params).expect("JSON Encoding Error while parsing params");
+
+            let uuid = linker.expect_file(&params.text_document.uri);
+
+            serde_json::to_value(make_semantic_tokens_delta(
+                uuid,
+                linker,
+                &mut manager.semantic_tokens_cache,
+                &params.previous_result_id,
+            ))
+        }
+        request::SemanticTokensRangeRequest::METHOD => {
+            println!("SemanticTokensRangeRequest: {params}");
+            let params: SemanticTokensRangeParams =
+                serde_json::from_value(params).expect("JSON Encoding Error while parsing params");
+
+            let uuid = linker.expect_file(&params.text_document.uri);
+            let file_text = &linker.files[uuid].file_text;
+            let span = Span::from(
+                file_text.linecol_to_byte_clamp(from_position(params.range.start))
+                    ..file_text.linecol_to_byte_clamp(from_position(params.range.end)),
+            );
+
+            serde_json::to_value(SemanticTokensRangeResult::Tokens(
+                make_semantic_tokens_in_range(uuid, linker, span),
+            ))
+        }
         request::DocumentHighlightRequest::METHOD => {
             let params: DocumentHighlightParams =
                 serde_json::from_value(params).expect("JSON Encoding Error while parsing params");
             println!("DocumentHighlight");
 
-            let (file_id, pos) =
-                linker.location_in_file(&params.text_document_position_params, manager);
+            let (file_id, pos) = linker.location_in_file(&params.text_document_position_params);
             let file_data = &linker.files[file_id];
 
-            let ref_locations = gather_all_references_in_one_file(linker, file_id, pos);
+            let ref_locations = gather_all_references_in_one_file(
+                linker,
+                &mut manager.reference_index,
+                file_id,
+                pos,
+            );
 
             let result: Vec<DocumentHighlight> = ref_locations
                 .into_iter()
@@ -451,9 +526,14 @@ fn handle_request(
                 serde_json::from_value(params).expect("JSON Encoding Error while parsing params");
             println!("FindAllReferences");
 
-            let (file_id, pos) = linker.location_in_file(&params.text_document_position, manager);
+            let (file_id, pos) = linker.location_in_file(&params.text_document_position);
 
-            let ref_locations = gather_all_references_across_all_files(linker, file_id, pos);
+            let ref_locations = gather_all_references_across_all_files(
+                linker,
+                &mut manager.reference_index,
+                file_id,
+                pos,
+            );
 
             serde_json::to_value(cvt_location_list_of_lists(ref_locations, linker))
         }
@@ -462,9 +542,14 @@ fn handle_request(
                 serde_json::from_value(params).expect("JSON Encoding Error while parsing params");
             println!("Rename");
 
-            let (file_id, pos) = linker.location_in_file(&params.text_document_position, manager);
+            let (file_id, pos) = linker.location_in_file(&params.text_document_position);
 
-            let ref_locations_lists = gather_all_references_across_all_files(linker, file_id, pos);
+            let ref_locations_lists = gather_all_references_across_all_files(
+                linker,
+                &mut manager.reference_index,
+                file_id,
+                pos,
+            );
 
             let changes: HashMap<_, _> = ref_locations_lists
                 .into_iter()
@@ -496,8 +581,7 @@ fn handle_request(
                 serde_json::from_value(params).expect("JSON Encoding Error while parsing params");
             println!("Completion");
 
-            let (file_uuid, position) =
-                linker.location_in_file(&params.text_document_position, manager);
+            let (file_uuid, position) = linker.location_in_file(&params.text_document_position);
 
             serde_json::to_value(CompletionResponse::Array(gather_completions(
                 linker, file_uuid, position,
@@ -510,40 +594,226 @@ fn handle_request(
     }
 }
 
+/// Edits are compiled once no new edit arrived for this long, such that a burst of keystrokes is compiled once
+const COMPILE_DEBOUNCE: Duration = Duration::from_millis(200);
+/// While instantiating in the background, how often the main thread checks whether the worker finished
+const INSTANTIATION_POLL_INTERVAL: Duration = Duration::from_millis(10);
+
+/// File changes that the [Linker] hasn't seen yet. Until they are compiled, requests are answered from the previous compilation.
+#[derive(Default)]
+struct PendingChanges {
+    /// The newest text of each changed file, or [None] if it was deleted
+    files: HashMap<Url, Option<String>>,
+}
+
+impl PendingChanges {
+    /// Applies the (possibly ranged) changes of a [DidChangeTextDocumentParams] in order, to the last known text of the file
+    fn apply_content_changes(
+        &mut self,
+        linker: &Linker,
+        uri: &Url,
+        content_changes: Vec<TextDocumentContentChangeEvent>,
+    ) {
+        let old_text = match self.files.get_mut(uri).and_then(Option::take) {
+            Some(pending_text) => pending_text,
+            None => match linker.find_uri(uri) {
+                Some(file_id) => linker.files[file_id].file_text.file_text.clone(),
+                None => String::new(),
+            },
+        };
+        let mut file_text = FileText::new(old_text);
+        for change in content_changes {
+            if let Some(range) = change.range {
+                let start = file_text.linecol_to_byte_clamp(from_position(range.start));
+                let end = file_text.linecol_to_byte_clamp(from_position(range.end));
+                file_text.apply_edit(start..end, &change.text);
+            } else {
+                file_text = FileText::new(change.text);
+            }
+        }
+        self.files.insert(uri.clone(), Some(file_text.file_text));
+    }
+
+    /// Unlike the open files, which the client sends the text of, files changed on disk are read here
+    fn add_watched_file_changes(&mut self, changes: Vec<FileEvent>) -> bool {
+        let mut any_added = false;
+        for change in changes {
+            if !change.uri.path().ends_with(".sus") {
+                continue;
+            }
+            if change.typ == FileChangeType::DELETED {
+                self.files.insert(change.uri, None);
+                any_added = true;
+                continue;
+            }
+            let Ok(path) = change.uri.to_file_path() else {
+                continue;
+            };
+            match std::fs::read_to_string(&path) {
+                Ok(text) => {
+                    self.files.insert(change.uri, Some(text));
+                    any_added = true;
+                }
+                Err(err) => println!("Could not read changed file {}: {err}", path.display()),
+            }
+        }
+        any_added
+    }
+
+    /// Gives all pending changes to the [Linker], and compiles them up to instantiation
+    fn compile(&mut self, linker: &mut Linker, manager: &mut LSPFileManager) {
+        for (uri, text) in self.files.drain() {
+            match text {
+                Some(text) => linker.add_or_update_file(uri.as_str(), text, manager),
+                None => {
+                    if let Some(file_id) = linker.find_uri(&uri) {
+                        manager.before_file_remove(file_id, linker);
+                        linker.remove_file(file_id);
+                    }
+                }
+            }
+        }
+        linker.recompile_incremental_for_lsp(manager);
+    }
+}
+
+/// Returns whether the notification added [PendingChanges]. Others, like `$/cancelRequest` or `didSave`, change nothing
 fn handle_notification(
-    connection: &lsp_server::Connection,
     notification: lsp_server::Notification,
-    linker: &mut Linker,
-    manager: &mut LSPFileManager,
-    initialize_params: &InitializeParams,
-) -> Result<(), Box<dyn Error + Sync + Send>> {
+    linker: &Linker,
+    pending: &mut PendingChanges,
+) -> bool {
     match notification.method.as_str() {
         notification::DidChangeTextDocument::METHOD => {
             println!("DidChangeTextDocument");
             let params: DidChangeTextDocumentParams = serde_json::from_value(notification.params)
                 .expect("JSON Encoding Error while parsing params");
 
-            let mut content_change_iter = params.content_changes.into_iter();
-            let only_change = content_change_iter.next().unwrap();
-            assert!(content_change_iter.next().is_none());
-            assert!(only_change.range.is_none());
-            linker.update_text(&params.text_document.uri, only_change.text, manager);
-
-            push_all_errors(connection, linker)?;
+            pending.apply_content_changes(
+                linker,
+                &params.text_document.uri,
+                params.content_changes,
+            );
+            true
         }
         notification::DidChangeWatchedFiles::METHOD => {
             println!("Workspace Files modified");
-            (*linker, *manager) = initialize_all_files(initialize_params);
+            let params: DidChangeWatchedFilesParams = serde_json::from_value(notification.params)
+                .expect("JSON Encoding Error while parsing params");
 
-            push_all_errors(connection, linker)?;
+            pending.add_watched_file_changes(params.changes)
         }
         other => {
             println!("got other notification: {other:?}");
+            false
         }
     }
+}
+
+/// The file a request is about. All requests we handle have a `textDocument`
+fn requested_file(params: &serde_json::Value) -> Option<Url> {
+    let uri = params.get("textDocument")?.get("uri")?.as_str()?;
+    Url::parse(uri).ok()
+}
+
+fn respond(
+    connection: &lsp_server::Connection,
+    req: lsp_server::Request,
+    linker: &Linker,
+    manager: &mut LSPFileManager,
+) -> Result<(), Box<dyn Error + Sync + Send>> {
+    let response_value = handle_request(&req.method, req.params, linker, manager);
+
+    let result = response_value.unwrap();
+    let response = lsp_server::Response {
+        id: req.id,
+        result: Some(result),
+        error: None,
+    };
+    connection
+        .sender
+        .send(lsp_server::Message::Response(response))?;
     Ok(())
 }
 
+enum BackgroundInstantiation {
+    Finished,
+    /// Instantiation was cancelled for messages that must change the [Linker] first.
+    /// Changed file contents were already added to the [PendingChanges], these are the other messages, in the order they arrived
+    Interrupted(VecDeque<lsp_server::Message>),
+    Disconnected,
+}
+
+/// Instantiates all modules on a worker thread. Meanwhile, requests about files that are already known
+/// are answered on this thread, as they only need the flattened and typechecked globals.
+///
+/// Notifications are handled right away, and only cancel the instantiation if they changed a file.
+/// Any other message cancels it as well, and is handled once the worker has stopped. Instances that finished are kept,
+/// see [Linker::instantiate_all_top_level_modules]. The worker checks for cancellation in the middle of instantiating a module as well,
+/// and requests keep being answered until it has exited, such that this thread never blocks on it.
+fn instantiate_in_background(
+    connection: &lsp_server::Connection,
+    linker: &Linker,
+    manager: &mut LSPFileManager,
+    pending: &mut PendingChanges,
+) -> Result<BackgroundInstantiation, Box<dyn Error + Sync + Send>> {
+    let cancel = AtomicBool::new(false);
+    std::thread::scope(|scope| {
+        let worker = scope.spawn(|| linker.instantiate_all_top_level_modules(&cancel));
+
+        let mut deferred = VecDeque::new();
+        let outcome = loop {
+            if worker.is_finished() {
+                break if cancel.load(Ordering::Relaxed) {
+                    BackgroundInstantiation::Interrupted(deferred)
+                } else {
+                    BackgroundInstantiation::Finished
+                };
+            }
+            let msg = match connection
+                .receiver
+                .recv_timeout(INSTANTIATION_POLL_INTERVAL)
+            {
+                Ok(msg) => msg,
+                Err(err) if err.is_timeout() => continue,
+                Err(_) => break BackgroundInstantiation::Disconnected,
+            };
+            match msg {
+                // Requests about files with pending changes must wait until those are compiled
+                lsp_server::Message::Request(req)
+                    if req.method != request::Shutdown::METHOD
+                        && requested_file(&req.params).map_or(true, |uri| {
+                            linker.find_uri(&uri).is_some() && !pending.files.contains_key(&uri)
+                        }) =>
+                {
+                    if let Err(err) = respond(connection, req, linker, manager) {
+                        cancel.store(true, Ordering::Relaxed);
+                        return Err(err);
+                    }
+                }
+                lsp_server::Message::Response(resp) => {
+                    println!("got response: {resp:?}");
+                }
+                lsp_server::Message::Notification(notification) => {
+                    if handle_notification(notification, linker, pending) {
+                        cancel.store(true, Ordering::Relaxed);
+                    }
+                }
+                other => {
+                    deferred.push_back(other);
+                    cancel.store(true, Ordering::Relaxed);
+                }
+            }
+        };
+        cancel.store(true, Ordering::Relaxed);
+
+        // Only blocks when the client disconnected
+        let finished = worker.join().unwrap();
+        manager.needs_instantiation = !finished;
+        Ok(outcome)
+    })
+}
+
 fn main_loop(
     connection: lsp_server::Connection,
     initialize_params: serde_json::Value,
@@ -554,11 +824,45 @@ fn main_loop(
     let initialize_params: InitializeParams = serde_json::from_value(initialize_params).unwrap();
 
     let (mut linker, mut manager) = initialize_all_files(&initialize_params);
+    let mut pending = PendingChanges::default();
+    // Messages that arrived during a background instantiation, and couldn't be handled at that point
+    let mut deferred = VecDeque::new();
 
-    push_all_errors(&connection, &linker)?;
+    push_changed_errors(&connection, &linker, &mut manager)?;
 
     println!("starting LSP main loop");
-    for msg in &connection.receiver {
+    loop {
+        let msg = if let Some(msg) = deferred.pop_front() {
+            msg
+        } else if !pending.files.is_empty() {
+            match connection.receiver.recv_timeout(COMPILE_DEBOUNCE) {
+                Ok(msg) => msg,
+                Err(err) if err.is_timeout() => {
+                    pending.compile(&mut linker, &mut manager);
+                    push_changed_errors(&connection, &linker, &mut manager)?;
+                    continue;
+                }
+                Err(_) => return Ok(()),
+            }
+        } else if manager.needs_instantiation {
+            match instantiate_in_background(&connection, &linker, &mut manager, &mut pending)? {
+                BackgroundInstantiation::Finished => {
+                    push_changed_errors(&connection, &linker, &mut manager)?;
+                    continue;
+                }
+                BackgroundInstantiation::Interrupted(msgs) => {
+                    deferred = msgs;
+                    continue;
+                }
+                BackgroundInstantiation::Disconnected => return Ok(()),
+            }
+        } else {
+            match connection.receiver.recv() {
+                Ok(msg) => msg,
+                Err(_) => return Ok(()),
+            }
+        };
+
         match msg {
             lsp_server::Message::Request(req) => {
                 if connection.handle_shutdown(&req)? {
@@ -566,30 +870,21 @@ fn main_loop(
                     return Ok(());
                 }
 
-                let response_value =
-                    handle_request(&req.method, req.params, &mut linker, &mut manager);
-
-                let result = response_value.unwrap();
-                let response = lsp_server::Response {
-                    id: req.id,
-                    result: Some(result),
-                    error: None,
-                };
-                connection
-                    .sender
-                    .send(lsp_server::Message::Response(response))?;
+                if let Some(uri) = requested_file(&req.params) {
+                    // The client's positions refer to the new text, so don't wait for the debounce
+                    if pending.files.contains_key(&uri) {
+                        pending.compile(&mut linker, &mut manager);
+                        push_changed_errors(&connection, &linker, &mut manager)?;
+                    }
+                    linker.ensure_contains_file(&uri, &mut manager);
+                }
+                respond(&connection, req, &linker, &mut manager)?;
             }
             lsp_server::Message::Response(resp) => {
                 println!("got response: {resp:?}");
             }
             lsp_server::Message::Notification(notification) => {
-                handle_notification(
-                    &connection,
-                    notification,
-                    &mut linker,
-                    &mut manager,
-                    &initialize_params,
-                )?;
+                handle_notification(notification, &linker, &mut pending);
             }
         }
 
@@ -598,7 +893,6 @@ fn main_loop(
             println!("File: {}", &file.file_identifier);
         }
     }
-    Ok(())
 }
 
 pub fn lsp_main() -> Result<(), Box<dyn Error + Sync + Send>> {
@@ -625,7 +919,9 @@ pub fn lsp_main() -> Result<(), Box<dyn Error + Sync + Send>> {
             resolve_provider: Some(true),
             ..Default::default()
         }),
-        text_document_sync: Some(TextDocumentSyncCapability::Kind(TextDocumentSyncKind::FULL)),
+        text_document_sync: Some(TextDocumentSyncCapability::Kind(
+            TextDocumentSyncKind::INCREMENTAL,
+        )),
         ..Default::default()
     })
     .unwrap();
@@ -0,0 +1,120 @@
+//! Reverse index from everything that can be referred to, to the spans referring to it.
+//!
+//! Find-references, rename and document highlights used to walk every file per request.
+//! Instead, each file is walked once with [tree_walk::visit_all], and its references are kept until that file changes.
+//! A file's references change when it is edited, but also when the globals in it are recompiled because something they reference changed.
+//! [Linker::recompile_incremental] reports these files, and [ReferenceIndex::invalidate_file] drops their entries.
+//! Files are indexed lazily, on the first request after they changed.
+
+use std::collections::HashMap;
+
+use crate::linker::GlobalUUID;
+use crate::prelude::*;
+
+use super::tree_walk::{self, LocationInfo, RefersTo};
+
+/// The thing a [LocationInfo] refers to. A location refers to exactly one of these, or isn't a reference at all (types).
+///
+/// [RefersTo] is the same, except that something may be referenced through several of these, such as a port being both a local and a [RefTarget::Port]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+enum RefTarget {
+    Local(GlobalUUID, FlatID),
+    Global(GlobalUUID),
+    Port(ModuleUUID, PortID),
+    Interface(ModuleUUID, InterfaceID),
+    Parameter(GlobalUUID, TemplateID),
+}
+
+impl RefTarget {
+    /// A [RefersTo] refers to the same thing as a location, if one of its [RefTarget::all_of] is the location's target
+    fn of_location(info: LocationInfo) -> Option<Self> {
+        match info {
+            LocationInfo::InGlobal(global_id, _, obj, _) => Some(RefTarget::Local(global_id, obj)),
+            LocationInfo::Parameter(parent, _, template_id, _) => {
+                Some(RefTarget::Parameter(parent, template_id))
+            }
+            LocationInfo::Type(_, _) => None,
+            LocationInfo::Global(global_id) => Some(RefTarget::Global(global_id)),
+            LocationInfo::Port(sm, _, port_id) => Some(RefTarget::Port(sm.module_ref.id, port_id)),
+            LocationInfo::Interface(md_id, _, interface_id, _) => {
+                Some(RefTarget::Interface(md_id, interface_id))
+            }
+        }
+    }
+
+    fn all_of(refers_to: RefersTo) -> impl Iterator<Item = RefTarget> {
+        [
+            refers_to
+                .local
+                .map(|(global, id)| RefTarget::Local(global, id)),
+            refers_to.global.map(RefTarget::Global),
+            refers_to.port.map(|(md, id)| RefTarget::Port(md, id)),
+            refers_to
+                .interface
+                .map(|(md, id)| RefTarget::Interface(md, id)),
+            refers_to
+                .parameter
+                .map(|(global, id)| RefTarget::Parameter(global, id)),
+        ]
+        .into_iter()
+        .flatten()
+    }
+}
+
+/// All references in a single file, in the order [tree_walk::visit_all] found them
+type FileReferences = HashMap<RefTarget, Vec<Span>>;
+
+#[derive(Debug, Default)]
+pub struct ReferenceIndex {
+    /// Files without an entry have not been indexed yet, or changed since
+    files: HashMap<FileUUID, FileReferences>,
+}
+
+impl ReferenceIndex {
+    pub fn invalidate_file(&mut self, file_id: FileUUID) {
+        self.files.remove(&file_id);
+    }
+
+    fn file_references(&mut self, linker: &Linker, file_id: FileUUID) -> &FileReferences {
+        self.files.entry(file_id).or_insert_with(|| {
+            let mut references = FileReferences::new();
+            tree_walk::visit_all(linker, &linker.files[file_id], |span, info| {
+                if let Some(target) = RefTarget::of_location(info) {
+                    references.entry(target).or_default().push(span);
+                }
+            });
+            references
+        })
+    }
+
+    /// All references in this file to the same thing as `refers_to`, sorted
+    pub fn references_in_file(
+        &mut self,
+        linker: &Linker,
+        file_id: FileUUID,
+        refers_to: RefersTo,
+    ) -> Vec<Span> {
+        let file_references = self.file_references(linker, file_id);
+        let mut result: Vec<Span> = RefTarget::all_of(refers_to)
+            .filter_map(|target| file_references.get(&target))
+            .flatten()
+            .copied()
+            .collect();
+        result.sort();
+        result
+    }
+
+    /// All references to the local declaration `local` in `obj_id`. These can only appear in the global itself
+    pub fn references_to_local(
+        &mut self,
+        linker: &Linker,
+        obj_id: GlobalUUID,
+        local: FlatID,
+    ) -> Vec<Span> {
+        let file_id = linker.get_link_info(obj_id).file;
+        self.file_references(linker, file_id)
+            .get(&RefTarget::Local(obj_id, local))
+            .cloned()
+            .unwrap_or_default()
+    }
+}
@@ -1,9 +1,12 @@
+use std::collections::HashMap;
+
 use crate::prelude::*;
 
 use lsp_types::{
-    Position, SemanticToken, SemanticTokenModifier, SemanticTokenType, SemanticTokensFullOptions,
-    SemanticTokensLegend, SemanticTokensOptions, SemanticTokensServerCapabilities,
-    WorkDoneProgressOptions,
+    Position, SemanticToken, SemanticTokenModifier, SemanticTokenType, SemanticTokens,
+    SemanticTokensDelta, SemanticTokensEdit, SemanticTokensFullDeltaResult,
+    SemanticTokensFullOptions, SemanticTokensLegend, SemanticTokensOptions,
+    SemanticTokensServerCapabilities, WorkDoneProgressOptions,
 };
 
 use crate::{
@@ -66,8 +69,8 @@ pub fn semantic_token_capabilities() -> SemanticTokensServerCapabilities {
             token_types: Vec::from(TOKEN_TYPES),
             token_modifiers: Vec::from(TOKEN_MODIFIERS),
         },
-        range: Some(false), // Don't support ranges yet
-        full: Some(SemanticTokensFullOptions::Bool(true)), // TODO: Support delta updating for faster syntax highlighting, just do whole file for now
+        range: Some(true),
+        full: Some(SemanticTokensFullOptions::Delta { delta: Some(true) }),
     })
 }
 
@@ -139,10 +142,15 @@ impl IDEIdentifierType {
     }
 }
 
-fn walk_name_color(file: &FileData, linker: &Linker) -> Vec<(Span, IDEIdentifierType)> {
+/// Colours the whole file, or only the part within `in_span`
+fn walk_name_color(
+    file: &FileData,
+    linker: &Linker,
+    in_span: Option<Span>,
+) -> Vec<(Span, IDEIdentifierType)> {
     let mut result: Vec<(Span, IDEIdentifierType)> = Vec::new();
 
-    tree_walk::visit_all(linker, file, |span, item| {
+    let visitor = |span, item| {
         result.push((
             span,
             match item {
@@ -172,20 +180,155 @@ fn walk_name_color(file: &FileData, linker: &Linker) -> Vec<(Span, IDEIdentifier
                 LocationInfo::Interface(_, _, _, _) => IDEIdentifierType::Interface,
             },
         ));
-    });
+    };
+    match in_span {
+        Some(in_span) => tree_walk::visit_all_in_span(linker, file, in_span, visitor),
+        None => tree_walk::visit_all(linker, file, visitor),
+    }
 
     result
 }
 
-pub fn make_semantic_tokens(uuid: FileUUID, linker: &Linker) -> lsp_types::SemanticTokens {
+/// The tokens last sent for each file, such that `semanticTokens/full/delta` only has to send what changed
+#[derive(Debug, Default)]
+pub struct SemanticTokensCache {
+    last_result_id: u64,
+    files: HashMap<FileUUID, (String, Vec<SemanticToken>)>,
+}
+
+impl SemanticTokensCache {
+    pub fn forget_file(&mut self, file_id: FileUUID) {
+        self.files.remove(&file_id);
+    }
+
+    /// Returns the new result id for the file
+    fn store(&mut self, file_id: FileUUID, data: Vec<SemanticToken>) -> String {
+        self.last_result_id += 1;
+        let result_id = self.last_result_id.to_string();
+        self.files.insert(file_id, (result_id.clone(), data));
+        result_id
+    }
+}
+
+fn make_file_tokens(uuid: FileUUID, linker: &Linker, in_span: Option<Span>) -> Vec<SemanticToken> {
     let file_data = &linker.files[uuid];
 
-    let mut ide_tokens = walk_name_color(file_data, linker);
+    let mut ide_tokens = walk_name_color(file_data, linker, in_span);
 
-    let data = convert_to_semantic_tokens(file_data, &mut ide_tokens);
+    convert_to_semantic_tokens(file_data, &mut ide_tokens)
+}
 
-    lsp_types::SemanticTokens {
-        result_id: None,
+pub fn make_semantic_tokens(
+    uuid: FileUUID,
+    linker: &Linker,
+    cache: &mut SemanticTokensCache,
+) -> SemanticTokens {
+    let data = make_file_tokens(uuid, linker, None);
+
+    SemanticTokens {
+        result_id: Some(cache.store(uuid, data.clone())),
         data,
     }
 }
+
+/// Only walks the globals overlapping `span`. Not cached, as the client still requests the full tokens afterwards
+pub fn make_semantic_tokens_in_range(
+    uuid: FileUUID,
+    linker: &Linker,
+    span: Span,
+) -> SemanticTokens {
+    SemanticTokens {
+        result_id: None,
+        data: make_file_tokens(uuid, linker, Some(span)),
+    }
+}
+
+/// Sends the edit from the tokens the client already has, if we still know which those are
+pub fn make_semantic_tokens_delta(
+    uuid: FileUUID,
+    linker: &Linker,
+    cache: &mut SemanticTokensCache,
+    previous_result_id: &str,
+) -> SemanticTokensFullDeltaResult {
+    let data = make_file_tokens(uuid, linker, None);
+
+    let edits = match cache.files.get(&uuid) {
+        Some((result_id, old_data)) if result_id == previous_result_id => {
+            diff_tokens(old_data, &data)
+        }
+        _ => {
+            return SemanticTokensFullDeltaResult::Tokens(SemanticTokens {
+                result_id: Some(cache.store(uuid, data.clone())),
+                data,
+            })
+        }
+    };
+
+    SemanticTokensFullDeltaResult::TokensDelta(SemanticTokensDelta {
+        result_id: Some(cache.store(uuid, data)),
+        edits,
+    })
+}
+
+/// The tokens are encoded relative to the previous one, so an edit leaves the tokens before and after it unchanged.
+/// Therefore we strip the common prefix and suffix, and replace what's in between in a single edit.
+///
+/// [SemanticTokensEdit::start] and [SemanticTokensEdit::delete_count] index into the flattened array of integers, 5 per token
+fn diff_tokens(old: &[SemanticToken], new: &[SemanticToken]) -> Vec<SemanticTokensEdit> {
+    const INTEGERS_PER_TOKEN: u32 = 5;
+
+    let prefix_len = old.iter().zip(new).take_while(|(a, b)| a == b).count();
+    let max_suffix_len = usize::min(old.len(), new.len()) - prefix_len;
+    let suffix_len = old
+        .iter()
+        .rev()
+        .zip(new.iter().rev())
+        .take(max_suffix_len)
+        .take_while(|(a, b)| a == b)
+        .count();
+
+    let num_deleted = old.len() - prefix_len - suffix_len;
+    let inserted = &new[prefix_len..new.len() - suffix_len];
+    if num_deleted == 0 && inserted.is_empty() {
+        return Vec::new();
+    }
+    vec![SemanticTokensEdit {
+        start: prefix_len as u32 * INTEGERS_PER_TOKEN,
+        delete_count: num_deleted as u32 * INTEGERS_PER_TOKEN,
+        data: Some(inserted.to_vec()),
+    }]
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn mk_token(delta_line: u32, length: u32) -> SemanticToken {
+        SemanticToken {
+            delta_line,
+            delta_start: 0,
+            length,
+            token_type: 0,
+            token_modifiers_bitset: 0,
+        }
+    }
+
+    #[test]
+    fn diff_replaces_only_changed_tokens() {
+        let old = [mk_token(0, 1), mk_token(1, 2), mk_token(1, 3)];
+        let new = [
+            mk_token(0, 1),
+            mk_token(2, 5),
+            mk_token(1, 4),
+            mk_token(1, 3),
+        ];
+
+        let edits = diff_tokens(&old, &new);
+        assert_eq!(edits.len(), 1);
+        assert_eq!(edits[0].start, 5);
+        assert_eq!(edits[0].delete_count, 5);
+        assert_eq!(edits[0].data.as_deref(), Some(&new[1..3]));
+
+        assert!(diff_tokens(&new, &new).is_empty());
+    }
+}
@@ -36,7 +36,7 @@ pub enum LocationInfo<'linker> {
     Interface(ModuleUUID, &'linker Module, InterfaceID, &'linker Interface),
 }
 
-/// Permits really efficient [RefersTo::refers_to_same_as] [LocationInfo] checking
+/// Everything a [LocationInfo] may be referring to. Looked up in the [super::reference_index::ReferenceIndex]
 #[derive(Clone, Copy, Debug)]
 pub struct RefersTo {
     pub local: Option<(GlobalUUID, FlatID)>,
@@ -111,18 +111,6 @@ impl From<LocationInfo<'_>> for RefersTo {
 }
 
 impl RefersTo {
-    pub fn refers_to_same_as(&self, info: LocationInfo) -> bool {
-        match info {
-            LocationInfo::InGlobal(global_id, _, obj, _) => self.local == Some((global_id, obj)),
-            LocationInfo::Parameter(parent, _, template_id, _) => {
-                self.parameter == Some((parent, template_id))
-            }
-            LocationInfo::Type(_, _) => false,
-            LocationInfo::Global(ne) => self.global == Some(ne),
-            LocationInfo::Port(sm, _, p_id) => self.port == Some((sm.module_ref.id, p_id)),
-            LocationInfo::Interface(md_id, _, i_id, _) => self.interface == Some((md_id, i_id)),
-        }
-    }
     pub fn is_global(&self) -> bool {
         self.global.is_some()
             | self.port.is_some()
@@ -146,19 +134,20 @@ pub fn visit_all<'linker, Visitor: FnMut(Span, LocationInfo<'linker>)>(
     walker.walk_file(file);
 }
 
-/// Walks the file, and provides all [LocationInfo]s.
-pub fn visit_all_in_module<'linker, Visitor: FnMut(Span, LocationInfo<'linker>)>(
+/// Walks only the part of the file that overlaps `span`, and provides the [LocationInfo]s in it.
+pub fn visit_all_in_span<'linker, Visitor: FnMut(Span, LocationInfo<'linker>)>(
     linker: &'linker Linker,
-    obj_id: GlobalUUID,
+    file: &'linker FileData,
+    span: Span,
     visitor: Visitor,
 ) {
     let mut walker = TreeWalker {
         linker,
         visitor,
-        should_prune: |_| false,
+        should_prune: |s: Span| !s.overlaps(span),
     };
 
-    walker.walk_global(obj_id);
+    walker.walk_file(file);
 }
 
 /// Walks the file, and finds the [LocationInfo] that is the most relevant
@@ -1,4 +1,5 @@
 pub mod ariadne_interface;
+pub mod watch;
 
 #[cfg(feature = "lsp")]
 pub mod lsp;
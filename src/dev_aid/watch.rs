@@ -0,0 +1,268 @@
+//! `--watch` and `--server` mode: keep the [Linker] around after the first compile, and recompile when input files change.
+//!
+//! Files are polled by modification time, such that no file system notification library is needed.
+//! Changed files go through [Linker::add_or_update_file] and [Linker::recompile_incremental], like edits in the LSP,
+//! and only the modules in recompiled files have their `--codegen` output rewritten.
+//! The output files of modules that no longer exist are deleted.
+//! When no files were given on the command line, new .sus files in the working directory are added as well.
+//!
+//! With `--server <port>`, build scripts can connect to `127.0.0.1:<port>` and send lines.
+//! All files are then checked by content rather than modification time, and each line is answered with
+//! `errors=<N> warnings=<M>` once the outputs are up to date. Clients are read without blocking,
+//! so a client that doesn't finish its line never holds up the others.
+
+use std::collections::HashSet;
+use std::error::Error;
+use std::io::{ErrorKind, Read, Write};
+use std::net::{TcpListener, TcpStream};
+use std::path::{Path, PathBuf};
+use std::time::{Duration, SystemTime};
+
+use crate::codegen::CodeGenBackend;
+use crate::compiler_top::LinkerExtraFileInfoManager;
+use crate::config::{config, sus_files_in_working_dir, EarlyExitUpTo};
+use crate::errors::ErrorLevel;
+use crate::prelude::*;
+
+use super::ariadne_interface::{print_all_errors, FileSourcesManager};
+
+const POLL_INTERVAL: Duration = Duration::from_millis(100);
+
+struct WatchedFile {
+    path: PathBuf,
+    /// [None] if the file could not be read the last time
+    modified: Option<SystemTime>,
+}
+
+fn modified_time(path: &Path) -> Option<SystemTime> {
+    std::fs::metadata(path).and_then(|m| m.modified()).ok()
+}
+
+/// Rereads the files whose modification time changed, or all files if `compare_contents` is set.
+/// Files whose text is unchanged are skipped, such that touching a file doesn't rewrite any outputs
+///
+/// Returns whether anything was updated
+fn update_changed_files(
+    watched: &mut [WatchedFile],
+    linker: &mut Linker,
+    file_sources: &mut FileSourcesManager,
+    compare_contents: bool,
+) -> bool {
+    let mut any_updated = false;
+    for file in watched {
+        let modified = modified_time(&file.path);
+        if !compare_contents && modified == file.modified {
+            continue;
+        }
+        file.modified = modified;
+
+        let file_identifier = file_sources.convert_filename(&file.path);
+        let existing_file = linker.find_file(&file_identifier);
+        match std::fs::read_to_string(&file.path) {
+            Ok(text) => {
+                if existing_file
+                    .is_some_and(|file_id| linker.files[file_id].file_text.file_text == text)
+                {
+                    continue;
+                }
+                linker.add_or_update_file(&file_identifier, text, file_sources);
+                any_updated = true;
+            }
+            Err(err) => {
+                // Removed files come back through add_or_update_file once they reappear
+                if let Some(file_id) = existing_file {
+                    eprintln!("Could not read '{file_identifier}' because {err}, removing it");
+                    file_sources.before_file_remove(file_id, linker);
+                    linker.remove_file(file_id);
+                    any_updated = true;
+                }
+            }
+        }
+    }
+    any_updated
+}
+
+fn count_errors(linker: &Linker) -> (usize, usize) {
+    let mut num_errors = 0;
+    let mut num_warnings = 0;
+    for (file_id, _) in &linker.files {
+        linker.for_all_errors_in_file(file_id, |err| match err.level {
+            ErrorLevel::Error => num_errors += 1,
+            ErrorLevel::Warning => num_warnings += 1,
+        });
+    }
+    (num_errors, num_warnings)
+}
+
+/// A build script connected to `--server`
+struct Client {
+    stream: TcpStream,
+    /// The start of a line that hasn't been completed yet
+    partial_line: Vec<u8>,
+    /// Lines received since the last answer
+    num_requests: usize,
+}
+
+impl Client {
+    /// Reads whatever the client sent since the last poll, without blocking.
+    /// Returns [false] once the client went away and there is nothing left to answer
+    fn read_requests(&mut self) -> bool {
+        let mut buf = [0; 1024];
+        let mut is_closed = false;
+        loop {
+            match self.stream.read(&mut buf) {
+                Ok(0) => {
+                    is_closed = true;
+                    break;
+                }
+                Ok(num_read) => {
+                    for byte in &buf[..num_read] {
+                        if *byte == b'\n' {
+                            self.num_requests += 1;
+                            self.partial_line.clear();
+                        } else {
+                            self.partial_line.push(*byte);
+                        }
+                    }
+                }
+                Err(err) if err.kind() == ErrorKind::WouldBlock => break,
+                Err(err) if err.kind() == ErrorKind::Interrupted => {}
+                Err(_) => return false,
+            }
+        }
+        !is_closed || self.num_requests > 0
+    }
+}
+
+/// The files of the working directory that aren't watched yet, see [crate::config::ConfigStruct::files_from_working_dir]
+fn add_new_files(watched: &mut Vec<WatchedFile>) {
+    for path in sus_files_in_working_dir() {
+        if !watched.iter().any(|file| file.path == path) {
+            println!("Found new file {}", path.display());
+            // Not yet read, so update_changed_files adds it
+            watched.push(WatchedFile {
+                path,
+                modified: None,
+            });
+        }
+    }
+}
+
+/// Deletes the `--codegen` outputs of modules that were generated before, but no longer exist
+fn remove_stale_outputs(
+    output_names: &mut HashSet<String>,
+    linker: &Linker,
+    codegen_backend: &dyn CodeGenBackend,
+) {
+    let current_names: HashSet<String> = crate::modules_with_output_files(linker)
+        .map(|md| md.link_info.name.clone())
+        .collect();
+    for stale_name in output_names.difference(&current_names) {
+        let path = codegen_backend.output_file_path(stale_name);
+        match std::fs::remove_file(&path) {
+            Ok(()) => println!("Removed {}", path.display()),
+            Err(err) if err.kind() == ErrorKind::NotFound => {}
+            Err(err) => eprintln!("Could not remove {}: {err}", path.display()),
+        }
+    }
+    *output_names = current_names;
+}
+
+pub fn watch_main(
+    mut linker: Linker,
+    mut file_sources: FileSourcesManager,
+    codegen_backend: &dyn CodeGenBackend,
+) -> Result<(), Box<dyn Error + Sync + Send>> {
+    let config = config();
+
+    let listener = match config.server_port {
+        Some(port) => {
+            let listener = TcpListener::bind(("127.0.0.1", port))?;
+            listener.set_nonblocking(true)?;
+            Some(listener)
+        }
+        None => None,
+    };
+
+    let mut watched: Vec<WatchedFile> = config
+        .files
+        .iter()
+        .map(|path| WatchedFile {
+            path: path.clone(),
+            modified: modified_time(path),
+        })
+        .collect();
+
+    println!("Watching {} files for changes", watched.len());
+
+    let generates_module_outputs = config.codegen && config.early_exit == EarlyExitUpTo::CodeGen;
+    // main already wrote these
+    let mut output_names: HashSet<String> = if generates_module_outputs {
+        crate::modules_with_output_files(&linker)
+            .map(|md| md.link_info.name.clone())
+            .collect()
+    } else {
+        HashSet::new()
+    };
+
+    let mut clients: Vec<Client> = Vec::new();
+    loop {
+        if let Some(listener) = &listener {
+            loop {
+                match listener.accept() {
+                    Ok((stream, _addr)) => {
+                        if stream.set_nonblocking(true).is_ok() {
+                            clients.push(Client {
+                                stream,
+                                partial_line: Vec::new(),
+                                num_requests: 0,
+                            });
+                        }
+                    }
+                    Err(err) if err.kind() == ErrorKind::WouldBlock => break,
+                    Err(err) => return Err(err.into()),
+                }
+            }
+        }
+        clients.retain_mut(Client::read_requests);
+
+        if config.files_from_working_dir {
+            add_new_files(&mut watched);
+        }
+
+        let compare_contents = clients.iter().any(|client| client.num_requests > 0);
+        if update_changed_files(
+            &mut watched,
+            &mut linker,
+            &mut file_sources,
+            compare_contents,
+        ) {
+            let recompiled_files: HashSet<FileUUID> = linker.recompile_incremental();
+            print_all_errors(&linker, &mut file_sources.file_sources);
+            if config.early_exit == EarlyExitUpTo::CodeGen {
+                let generated = crate::generate_outputs(&linker, codegen_backend, |md| {
+                    recompiled_files.contains(&md.link_info.file)
+                });
+                if let Err(err) = generated {
+                    eprintln!("{err}");
+                }
+                if generates_module_outputs {
+                    remove_stale_outputs(&mut output_names, &linker, codegen_backend);
+                }
+            }
+        }
+
+        if compare_contents {
+            let (num_errors, num_warnings) = count_errors(&linker);
+            for client in &mut clients {
+                for _ in 0..client.num_requests {
+                    // The client may have gone away already, which is its own business
+                    let _ = writeln!(client.stream, "errors={num_errors} warnings={num_warnings}");
+                }
+                client.num_requests = 0;
+            }
+        }
+
+        std::thread::sleep(POLL_INTERVAL);
+    }
+}
@@ -60,6 +60,11 @@ impl ErrorStore {
         }
     }
 
+    /// Rebuild an [ErrorStore] that was stored elsewhere, for instance in the instantiation cache
+    pub fn from_parts(errors: Vec<CompileError>, did_error: bool) -> ErrorStore {
+        ErrorStore { errors, did_error }
+    }
+
     pub fn take(&mut self) -> Self {
         std::mem::replace(self, ErrorStore::new())
     }
@@ -77,6 +82,28 @@ impl ErrorStore {
     pub fn is_untouched(&self) -> bool {
         self.errors.is_empty()
     }
+
+    /// Estimated number of bytes these errors own on the heap
+    pub fn heap_size(&self) -> usize {
+        self.errors.capacity() * std::mem::size_of::<CompileError>()
+            + self
+                .errors
+                .iter()
+                .map(|err| {
+                    err.reason.capacity()
+                        + err.infos.capacity() * std::mem::size_of::<ErrorInfo>()
+                        + err
+                            .infos
+                            .iter()
+                            .map(|info| info.info.capacity())
+                            .sum::<usize>()
+                })
+                .sum::<usize>()
+    }
+
+    pub fn shrink_to_fit(&mut self) {
+        self.errors.shrink_to_fit();
+    }
 }
 
 impl<'e> IntoIterator for &'e ErrorStore {
@@ -19,6 +19,9 @@ impl From<Range<usize>> for Span {
 
 impl Span {
     /// Register that we have visited this span. Eases debugging when errors occur
+    ///
+    /// No-op in release builds, unless the `debug_spans` feature is enabled
+    #[inline]
     pub fn debug(&self) -> Span {
         crate::debug::add_debug_span(self.0..self.1);
         *self
@@ -43,6 +46,12 @@ impl Span {
         self.debug();
         pos >= self.0 && pos <= self.1
     }
+    /// Like [Span::contains_pos], spans that only touch also overlap
+    pub fn overlaps(&self, other: Span) -> bool {
+        self.debug();
+        other.debug();
+        self.0 <= other.1 && other.0 <= self.1
+    }
     // Not really a useful quantity. Should only be used comparatively, find which is the nested-most span
     pub fn size(&self) -> usize {
         self.debug();
@@ -129,18 +138,45 @@ pub struct FileText {
 
 impl FileText {
     pub fn new(file_text: String) -> Self {
-        let mut lines_start_at = Vec::new();
-
-        lines_start_at.push(0);
-        for (idx, c) in file_text.char_indices() {
+        let mut result = FileText {
+            file_text,
+            lines_start_at: Vec::new(),
+        };
+        result.recompute_lines_from(0);
+        result
+    }
+    /// Recomputes [Self::lines_start_at] for all lines starting at or after the line containing `byte_pos`
+    fn recompute_lines_from(&mut self, byte_pos: usize) {
+        let first_line = self
+            .lines_start_at
+            .partition_point(|start| *start <= byte_pos);
+        self.lines_start_at.truncate(first_line.max(1));
+        if self.lines_start_at.is_empty() {
+            self.lines_start_at.push(0);
+        }
+        let rescan_from = *self.lines_start_at.last().unwrap();
+        for (idx, c) in self.file_text[rescan_from..].char_indices() {
             if c == '\n' {
-                lines_start_at.push(idx + 1);
+                self.lines_start_at.push(rescan_from + idx + 1);
             }
         }
-
-        FileText {
-            file_text,
-            lines_start_at,
+    }
+    /// Replaces the text in `byte_range` with `new_text`. Used for incremental updates from the LSP
+    pub fn apply_edit(&mut self, byte_range: Range<usize>, new_text: &str) {
+        let edit_start = byte_range.start;
+        self.file_text.replace_range(byte_range, new_text);
+        self.recompute_lines_from(edit_start);
+    }
+    /// Like [Self::byte_to_linecol], but the column is counted in bytes, the way tree-sitter expects it
+    pub fn byte_to_line_byte_col(&self, byte_pos: usize) -> LineCol {
+        assert!(byte_pos <= self.file_text.len());
+        let line = self
+            .lines_start_at
+            .partition_point(|start| *start <= byte_pos)
+            - 1;
+        LineCol {
+            line,
+            col: byte_pos - self.lines_start_at[line],
         }
     }
     /// Errors when byte is outside of file
@@ -2,11 +2,14 @@ use crate::alloc::{ArenaAllocator, UUIDAllocator, UUIDRange, UUID};
 use crate::typing::abstract_type::{AbstractType, DomainType};
 use crate::{alloc::UUIDRangeIter, prelude::*};
 
-use num::BigInt;
 use sus_proc_macro::{field, kind, kw};
 
 use crate::linker::{FileData, GlobalResolver, GlobalUUID, AFTER_FLATTEN_CP};
-use crate::{debug::SpanDebugger, value::Value};
+use crate::{
+    debug::SpanDebugger,
+    stats,
+    value::{IntValue, Value},
+};
 
 use super::name_context::LocalVariableContext;
 use super::parser::Cursor;
@@ -767,7 +770,7 @@ impl FlatteningContext<'_, '_> {
                 name : name.to_owned(),
                 name_span,
                 decl_span,
-                declaration_runtime_depth : OnceCell::new(),
+                declaration_runtime_depth : OnceLock::new(),
                 latency_specifier : span_latency_specifier.map(|(ls, _)| ls),
                 documentation
             }));
@@ -943,7 +946,7 @@ impl FlatteningContext<'_, '_> {
             let text = &self.globals.file_data.file_text[expr_span];
             use std::str::FromStr;
             (
-                ExpressionSource::Constant(Value::Integer(BigInt::from_str(text).unwrap())),
+                ExpressionSource::Constant(Value::Integer(IntValue::from_str(text).unwrap())),
                 true,
             )
         } else if kind == kind!("unary_op") {
@@ -1634,7 +1637,7 @@ impl FlatteningContext<'_, '_> {
                             decl_span,
                             name_span,
                             name: module_name.to_string(),
-                            declaration_runtime_depth: OnceCell::new(),
+                            declaration_runtime_depth: OnceLock::new(),
                             read_only: false,
                             declaration_itself_is_not_written_to: true,
                             decl_kind: DeclarationKind::NotPort,
@@ -1670,7 +1673,16 @@ pub fn flatten_all_globals(linker: &mut Linker) {
                     .next()
                     .expect("Iterator cannot be exhausted");
 
-                flatten_global(linker, global_obj, cursor);
+                // Skip globals that were not invalidated since the last compilation (#49)
+                if linker.get_link_info(global_obj).checkpoints.len() == AFTER_FLATTEN_CP {
+                    let timer = stats::ItemTimer::start("flatten");
+                    flatten_global(linker, global_obj, cursor);
+                    let link_info = linker.get_link_info(global_obj);
+                    stats::count(|c| c.instructions += link_info.instructions.len());
+                    timer.finish(|| link_info.name.clone());
+                } else {
+                    cursor.clear_gathered_comments();
+                }
             });
         });
         span_debugger.defuse();
@@ -1679,6 +1691,17 @@ pub fn flatten_all_globals(linker: &mut Linker) {
 
 fn flatten_global(linker: &mut Linker, global_obj: GlobalUUID, cursor: &mut Cursor<'_>) {
     let errors_globals = GlobalResolver::take_errors_globals(linker, global_obj);
+    // Recompiled globals keep the instruction buffer of their previous compilation, so it needn't grow from nothing again
+    let mut reused_instructions = std::mem::take(
+        &mut Linker::get_link_info_mut(
+            &mut linker.modules,
+            &mut linker.types,
+            &mut linker.constants,
+            global_obj,
+        )
+        .instructions,
+    );
+    reused_instructions.clear();
     let obj_link_info = linker.get_link_info(global_obj);
     let globals = GlobalResolver::new(linker, obj_link_info, errors_globals);
 
@@ -1733,7 +1756,7 @@ fn flatten_global(linker: &mut Linker, global_obj: GlobalUUID, cursor: &mut Curs
         default_declaration_context,
         errors: &globals.errors,
         working_on_link_info: linker.get_link_info(global_obj),
-        instructions: FlatAlloc::new(),
+        instructions: reused_instructions,
         type_alloc: TypingAllocator {
             type_variable_alloc: UUIDAllocator::new(),
             domain_variable_alloc: UUIDAllocator::new(),
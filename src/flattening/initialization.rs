@@ -275,14 +275,25 @@ impl InitializationContext<'_> {
 
 pub fn gather_initial_file_data(mut builder: FileBuilder) {
     let mut cursor = Cursor::new_at_root(builder.tree, &builder.file_data.file_text);
+    let mut global_idx = 0;
     cursor.list_and_report_errors(
         kind!("source_file"),
         builder.other_parsing_errors,
         |cursor| {
+            let span = cursor.span();
+
+            // Globals that were unaffected by an edit keep their old objects
+            if global_idx < builder.num_kept_globals() {
+                assert_eq!(builder.kept_global_span(global_idx), span);
+                global_idx += 1;
+                cursor.clear_gathered_comments();
+                return;
+            }
+            global_idx += 1;
+
             let parsing_errors = ErrorCollector::new_empty(builder.file_id, builder.files);
             cursor.report_all_decendant_errors(&parsing_errors);
 
-            let span = cursor.span();
             cursor.go_down(kind!("global_object"), |cursor| {
                 initialize_global_object(&mut builder, parsing_errors, span, cursor);
             });
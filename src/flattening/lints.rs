@@ -1,5 +1,6 @@
 use sus_proc_macro::get_builtin_const;
 
+use crate::instantiation::list_of_lists::{CsrAdjacency, FanInOut};
 use crate::linker::{IsExtern, LinkInfo, AFTER_LINTS_CP};
 use crate::prelude::*;
 use crate::typing::template::ParameterKind;
@@ -10,6 +11,10 @@ use super::{ExpressionSource, Instruction, Module, WireReferencePathElement, Wir
 
 pub fn perform_lints(linker: &mut Linker) {
     for (_, md) in &mut linker.modules {
+        // Already linted in a previous compilation (#49)
+        if md.link_info.checkpoints.len() != AFTER_LINTS_CP {
+            continue;
+        }
         let errors = ErrorCollector::from_storage(
             md.link_info.errors.take(),
             md.link_info.file,
@@ -78,10 +83,11 @@ fn find_unused_variables(md: &Module, errors: &ErrorCollector) {
     }
 
     while let Some(item) = wire_to_explore_queue.pop() {
-        for from in &instruction_fanins[item] {
-            if !is_instance_used_map[*from] {
-                is_instance_used_map[*from] = true;
-                wire_to_explore_queue.push(*from);
+        for FanInOut { other, .. } in instruction_fanins.edges(item.get_hidden_value()) {
+            let from = FlatID::from_hidden_value(other);
+            if !is_instance_used_map[from] {
+                is_instance_used_map[from] = true;
+                wire_to_explore_queue.push(from);
             }
         }
     }
@@ -96,23 +102,20 @@ fn find_unused_variables(md: &Module, errors: &ErrorCollector) {
     }
 }
 
-fn make_fanins(
-    instructions: &FlatAlloc<Instruction, FlatIDMarker>,
-) -> FlatAlloc<Vec<FlatID>, FlatIDMarker> {
-    // Setup Wire Fanouts List for faster processing
-    let mut instruction_fanins: FlatAlloc<Vec<FlatID>, FlatIDMarker> =
-        instructions.map(|_| Vec::new());
+fn make_fanins(instructions: &FlatAlloc<Instruction, FlatIDMarker>) -> CsrAdjacency {
+    // Collect (to, from) pairs, and pack them into a CSR list for faster processing
+    let mut fanin_edges: Vec<(FlatID, FlatID)> = Vec::new();
 
     for (inst_id, inst) in instructions.iter() {
         let mut collector_func = |id| {
-            instruction_fanins[inst_id].push(id);
+            fanin_edges.push((inst_id, id));
         };
         match inst {
             Instruction::Write(conn) => {
                 if let Some(flat_root) = conn.to.root.get_root_flat() {
-                    instruction_fanins[flat_root].push(conn.from);
+                    fanin_edges.push((flat_root, conn.from));
                     WireReferencePathElement::for_each_dependency(&conn.to.path, |idx_wire| {
-                        instruction_fanins[flat_root].push(idx_wire)
+                        fanin_edges.push((flat_root, idx_wire))
                     });
                 }
             }
@@ -124,7 +127,7 @@ fn make_fanins(
             }
             Instruction::FuncCall(fc) => {
                 for a in &fc.arguments {
-                    instruction_fanins[fc.interface_reference.submodule_decl].push(*a);
+                    fanin_edges.push((fc.interface_reference.submodule_decl, *a));
                 }
             }
             Instruction::Declaration(decl) => {
@@ -140,16 +143,27 @@ fn make_fanins(
                 for id in FlatIDRange::new(stm.then_start, stm.else_end) {
                     if let Instruction::Write(conn) = &instructions[id] {
                         if let Some(flat_root) = conn.to.root.get_root_flat() {
-                            instruction_fanins[flat_root].push(stm.condition);
+                            fanin_edges.push((flat_root, stm.condition));
                         }
                     }
                 }
             }
             Instruction::ForStatement(stm) => {
-                instruction_fanins[stm.loop_var_decl].push(stm.start);
-                instruction_fanins[stm.loop_var_decl].push(stm.end);
+                fanin_edges.push((stm.loop_var_decl, stm.start));
+                fanin_edges.push((stm.loop_var_decl, stm.end));
             }
         }
     }
-    instruction_fanins
+    CsrAdjacency::from_random_access_iterator(
+        instructions.len(),
+        fanin_edges.iter().map(|(to, from)| {
+            (
+                to.get_hidden_value(),
+                FanInOut {
+                    other: from.get_hidden_value(),
+                    delta_latency: 0,
+                },
+            )
+        }),
+    )
 }
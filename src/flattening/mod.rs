@@ -11,8 +11,8 @@ use crate::prelude::*;
 use crate::typing::abstract_type::DomainType;
 use crate::typing::type_inference::{DomainVariableIDMarker, TypeVariableIDMarker};
 
-use std::cell::OnceCell;
 use std::ops::Deref;
+use std::sync::OnceLock;
 
 pub use flatten::flatten_all_globals;
 pub use initialization::gather_initial_file_data;
@@ -596,7 +596,7 @@ pub struct Declaration {
     pub decl_span: Span,
     pub name_span: Span,
     pub name: String,
-    pub declaration_runtime_depth: OnceCell<usize>,
+    pub declaration_runtime_depth: OnceLock<usize>,
     /// Variables are read_only when they may not be controlled by the current block of code.
     /// This is for example, the inputs of the current module, or the outputs of nested modules.
     /// But could also be the iterator of a for loop.
@@ -1,12 +1,17 @@
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+
 use crate::alloc::ArenaAllocator;
-use crate::errors::{ErrorInfo, ErrorInfoObject, FileKnowingErrorInfoObject};
+use crate::config::config;
+use crate::errors::{ErrorInfo, ErrorInfoObject, ErrorStore, FileKnowingErrorInfoObject};
 use crate::prelude::*;
 use crate::typing::abstract_type::AbstractType;
 use crate::typing::template::ParameterKind;
 use crate::typing::type_inference::{FailedUnification, HindleyMilner};
 
 use crate::debug::SpanDebugger;
-use crate::linker::{GlobalResolver, GlobalUUID, AFTER_TYPECHECK_CP};
+use crate::linker::{GlobalResolver, GlobalUUID, ResolvedGlobals, AFTER_TYPECHECK_CP};
+use crate::stats;
 
 use crate::typing::{
     abstract_type::{DomainType, TypeUnifier, BOOL_TYPE, INT_TYPE},
@@ -16,49 +21,146 @@ use crate::typing::{
 use super::*;
 
 pub fn typecheck_all_modules(linker: &mut Linker) {
-    let module_uuids: Vec<ModuleUUID> = linker.modules.iter().map(|(id, _md)| id).collect();
-    for module_uuid in module_uuids {
-        let global_id = GlobalUUID::Module(module_uuid);
-        let errs_globals = GlobalResolver::take_errors_globals(linker, global_id);
-
-        let working_on: &Module = &linker.modules[module_uuid];
-        let globals = GlobalResolver::new(linker, &working_on.link_info, errs_globals);
-
-        let ctx_info_string = format!("Typechecking {}", &working_on.link_info.name);
-        println!("{ctx_info_string}");
-        let mut span_debugger =
-            SpanDebugger::new(&ctx_info_string, &linker.files[working_on.link_info.file]);
-
-        let mut context = TypeCheckingContext {
-            globals: &globals,
-            errors: &globals.errors,
-            type_checker: TypeUnifier::new(
-                &working_on.link_info.template_parameters,
-                working_on.link_info.type_variable_alloc.clone(),
-            ),
-            runtime_condition_stack: Vec::new(),
-            working_on: &working_on.link_info,
-        };
+    // Only typecheck modules that were not typechecked yet (#49)
+    let module_uuids: Vec<ModuleUUID> = linker
+        .modules
+        .iter()
+        .filter(|(_id, md)| md.link_info.checkpoints.len() == AFTER_TYPECHECK_CP)
+        .map(|(id, _md)| id)
+        .collect();
+
+    if config().jobs > 1 && module_uuids.len() > 1 {
+        typecheck_modules_in_parallel(linker, &module_uuids);
+    } else {
+        for module_uuid in module_uuids {
+            let errs_globals =
+                GlobalResolver::take_errors_globals(linker, GlobalUUID::Module(module_uuid));
+            println!(
+                "Typechecking {}",
+                &linker.modules[module_uuid].link_info.name
+            );
+            let result = typecheck_module(linker, module_uuid, errs_globals);
+            commit_typecheck_result(linker, module_uuid, result);
+        }
+    }
+}
 
-        context.typecheck();
+/// Everything [typecheck_module] produces, to be applied to the module by [commit_typecheck_result]
+struct TypecheckResult {
+    type_checker: TypeUnifier,
+    errors: ErrorStore,
+    resolved_globals: ResolvedGlobals,
+}
 
-        let type_checker = context.type_checker;
-        let errs_and_globals = globals.decommission(&linker.files);
+/// Typechecking a module only reads other modules through the [GlobalResolver].
+/// The result is only written back into the module by [commit_typecheck_result]
+fn typecheck_module(
+    linker: &Linker,
+    module_uuid: ModuleUUID,
+    errs_globals: (ErrorStore, ResolvedGlobals),
+) -> TypecheckResult {
+    let timer = stats::ItemTimer::start("typecheck");
+    let working_on: &Module = &linker.modules[module_uuid];
+    let globals = GlobalResolver::new(linker, &working_on.link_info, errs_globals);
+
+    let ctx_info_string = format!("Typechecking {}", &working_on.link_info.name);
+    let mut span_debugger =
+        SpanDebugger::new(&ctx_info_string, &linker.files[working_on.link_info.file]);
+
+    let mut context = TypeCheckingContext {
+        globals: &globals,
+        errors: &globals.errors,
+        type_checker: TypeUnifier::new(
+            &working_on.link_info.template_parameters,
+            working_on.link_info.type_variable_alloc.clone(),
+        ),
+        runtime_condition_stack: Vec::new(),
+        working_on: &working_on.link_info,
+    };
+
+    context.typecheck();
+
+    let type_checker = context.type_checker;
+    stats::count(|c| {
+        c.type_variables += type_checker.type_substitutor.id_range().len()
+            + type_checker.domain_substitutor.id_range().len()
+    });
+    let (errors, resolved_globals) = globals.decommission(&linker.files);
 
-        // Grab another mutable copy of md so it doesn't force a borrow conflict
-        let working_on_mut = &mut linker.modules[module_uuid];
-        apply_types(
-            type_checker,
-            working_on_mut,
-            &errs_and_globals.0,
-            &linker.types,
-        );
+    span_debugger.defuse();
+    timer.finish(|| working_on.link_info.name.clone());
 
-        working_on_mut
-            .link_info
-            .reabsorb_errors_globals(errs_and_globals, AFTER_TYPECHECK_CP);
+    TypecheckResult {
+        type_checker,
+        errors: errors.into_storage(),
+        resolved_globals,
+    }
+}
+
+fn commit_typecheck_result(linker: &mut Linker, module_uuid: ModuleUUID, result: TypecheckResult) {
+    let working_on = &mut linker.modules[module_uuid];
+    let errors =
+        ErrorCollector::from_storage(result.errors, working_on.link_info.file, &linker.files);
+
+    apply_types(result.type_checker, working_on, &errors, &linker.types);
+
+    working_on
+        .link_info
+        .reabsorb_errors_globals((errors, result.resolved_globals), AFTER_TYPECHECK_CP);
+}
 
-        span_debugger.defuse();
+/// Typechecks the modules on [crate::config::ConfigStruct::jobs] threads. Threads grab the next module to check from a shared counter.
+///
+/// The results are committed in the order of `module_uuids`, such that the output doesn't depend on the number of threads.
+fn typecheck_modules_in_parallel(linker: &mut Linker, module_uuids: &[ModuleUUID]) {
+    let work_items: Vec<Mutex<Option<(ErrorStore, ResolvedGlobals)>>> = module_uuids
+        .iter()
+        .map(|module_uuid| {
+            let errs_globals =
+                GlobalResolver::take_errors_globals(linker, GlobalUUID::Module(*module_uuid));
+            Mutex::new(Some(errs_globals))
+        })
+        .collect();
+
+    let work_items = &work_items;
+    let shared_linker: &Linker = linker;
+    let next_work_item = &AtomicUsize::new(0);
+    let num_threads = usize::min(config().jobs, module_uuids.len());
+
+    let mut results: Vec<(usize, TypecheckResult)> = std::thread::scope(|scope| {
+        let workers: Vec<_> = (0..num_threads)
+            .map(|_| {
+                scope.spawn(move || {
+                    let mut finished = Vec::new();
+                    loop {
+                        let idx = next_work_item.fetch_add(1, Ordering::Relaxed);
+                        let Some(module_uuid) = module_uuids.get(idx) else {
+                            break;
+                        };
+                        let errs_globals = work_items[idx].lock().unwrap().take().unwrap();
+                        finished.push((
+                            idx,
+                            typecheck_module(shared_linker, *module_uuid, errs_globals),
+                        ));
+                    }
+                    finished
+                })
+            })
+            .collect();
+        workers
+            .into_iter()
+            .flat_map(|worker| worker.join().unwrap())
+            .collect()
+    });
+
+    results.sort_by_key(|(idx, _)| *idx);
+    for (idx, result) in results {
+        let module_uuid = module_uuids[idx];
+        println!(
+            "Typechecking {}",
+            &linker.modules[module_uuid].link_info.name
+        );
+        commit_typecheck_result(linker, module_uuid, result);
     }
 }
 
@@ -65,8 +65,10 @@ impl InstantiationContext<'_, '_> {
                     }
                     for s in sources {
                         let source_typ = &self.wires[s.from].typ;
-                        let destination_typ = self
-                            .walk_type_along_path(self.wires[this_wire_id].typ.clone(), &s.to_path);
+                        let destination_typ = self.walk_type_along_path(
+                            ConcreteType::clone(&self.wires[this_wire_id].typ),
+                            &s.to_path,
+                        );
                         self.type_substitutor.unify_report_error(
                             &destination_typ,
                             source_typ,
@@ -167,7 +169,8 @@ impl InstantiationContext<'_, '_> {
                     );
                 }
                 RealWireDataSource::Select { root, path } => {
-                    let found_typ = self.walk_type_along_path(self.wires[*root].typ.clone(), path);
+                    let found_typ = self
+                        .walk_type_along_path(ConcreteType::clone(&self.wires[*root].typ), path);
                     self.type_substitutor.unify_report_error(
                         &found_typ,
                         &self.wires[this_wire_id].typ,
@@ -187,7 +190,10 @@ impl InstantiationContext<'_, '_> {
 
     fn finalize(&mut self) {
         for (_id, w) in &mut self.wires {
-            if !w.typ.fully_substitute(&self.type_substitutor) {
+            if !w
+                .typ
+                .finalize(&self.type_substitutor, &self.linker.interned_types)
+            {
                 let typ_as_str = w.typ.display(&self.linker.types);
 
                 let span = self.md.get_instruction_span(w.original_instruction);
@@ -290,13 +296,13 @@ fn can_expression_be_value_inferred(link_info: &LinkInfo, expr_id: FlatID) -> Op
 
 fn concretize_written_type_with_possible_template_args(
     written_typ: &WrittenType,
-    template_args: &TVec<ConcreteType>,
+    template_args: &TVec<InstanceType>,
     link_info: &LinkInfo,
     type_substitutor: &TypeSubstitutor<ConcreteType, ConcreteTypeVariableIDMarker>,
 ) -> ConcreteType {
     match written_typ {
         WrittenType::Error(_span) => ConcreteType::Unknown(type_substitutor.alloc()),
-        WrittenType::TemplateVariable(_span, uuid) => template_args[*uuid].clone(),
+        WrittenType::TemplateVariable(_span, uuid) => ConcreteType::clone(&template_args[*uuid]),
         WrittenType::Named(global_reference) => {
             let object_template_args: TVec<ConcreteType> =
                 global_reference
@@ -316,7 +322,7 @@ fn concretize_written_type_with_possible_template_args(
                                     if let Some(found_template_arg) =
                                         can_expression_be_value_inferred(link_info, *uuid)
                                     {
-                                        template_args[found_template_arg].clone()
+                                        ConcreteType::clone(&template_args[found_template_arg])
                                     } else {
                                         ConcreteType::Unknown(type_substitutor.alloc())
                                     }
@@ -344,7 +350,7 @@ fn concretize_written_type_with_possible_template_args(
             let arr_idx_concrete = if let Some(found_template_arg) =
                 can_expression_be_value_inferred(link_info, *arr_idx_id)
             {
-                template_args[found_template_arg].clone()
+                ConcreteType::clone(&template_args[found_template_arg])
             } else {
                 ConcreteType::Unknown(type_substitutor.alloc())
             };
@@ -374,7 +380,7 @@ impl DelayedConstraint<InstantiationContext<'_, '_>> for SubmoduleTypecheckConst
 
         // Check if there's any argument that isn't known
         for (_id, arg) in &mut sm.template_args {
-            if !arg.fully_substitute(&context.type_substitutor) {
+            if !arg.finalize(&context.type_substitutor, &context.linker.interned_types) {
                 // We don't actually *need* to already fully_substitute here, but it's convenient and saves some work
                 return DelayedConstraintStatus::NoProgress;
             }
@@ -383,7 +389,8 @@ impl DelayedConstraint<InstantiationContext<'_, '_>> for SubmoduleTypecheckConst
         if let Some(instance) = sub_module.instantiations.instantiate(
             sub_module,
             context.linker,
-            sm.template_args.clone(),
+            sm.template_args.map(|(_, arg)| arg.unwrap_final().clone()),
+            context.cancel,
         ) {
             for (port_id, concrete_port) in &instance.interface_ports {
                 let connecting_wire = &sm.port_map[port_id];
@@ -0,0 +1,837 @@
+//! Persistent on-disk cache of [InstantiatedModule]s, enabled with `--cache-dir`
+//!
+//! An entry is keyed by a hash of everything the instantiation could depend on:
+//! the flattened module, all globals it (transitively) references, and the template arguments.
+//! The UUIDs of globals and files are part of these, so entries are only reused when they are assigned identically.
+//! This is the case as long as the same set of files is compiled in the same order.
+//! The key also includes a hash of the sources the compiler itself was built from (see build.rs),
+//! such that a rebuilt compiler never reads entries that an older build wrote.
+//!
+//! Entries are stored in a compact binary format. An entry that can't be read is treated as a miss.
+
+use std::borrow::Cow;
+use std::collections::hash_map::DefaultHasher;
+use std::collections::HashSet;
+use std::hash::{Hash, Hasher};
+use std::path::Path;
+use std::sync::atomic::{AtomicBool, Ordering};
+
+use num::BigInt;
+
+use crate::errors::{ErrorInfo, ErrorLevel};
+use crate::file_position::BracketSpan;
+use crate::linker::{GlobalUUID, LinkInfo};
+use crate::prelude::*;
+use crate::typing::concrete_type::ConcreteGlobalReference;
+use crate::value::IntValue;
+
+use super::*;
+
+/// Identifies cache entries
+const MAGIC: &[u8; 4] = b"SUSI";
+/// Bump whenever the layout of [InstantiatedModule] or the encoding below changes
+const FORMAT_VERSION: u32 = 2;
+
+/// Used by [InstantiationCache::instantiate] in place of [perform_instantiation] when a cache directory is given
+pub fn load_or_instantiate(
+    cache_dir: &Path,
+    md: &Module,
+    linker: &Linker,
+    template_args: &TVec<ConcreteType>,
+    cancel: &AtomicBool,
+) -> InstantiatedModule {
+    let key = cache_key(md, linker, template_args);
+    let entry_path = cache_dir.join(format!("{}-{key:016x}.inst", md.link_info.name));
+
+    if let Some(mut cached) = load_entry(&entry_path, linker, cancel) {
+        if !config().ci {
+            println!("Loaded {} from the instantiation cache", cached.name);
+        }
+        cached.cache_key = Some(key);
+        return cached;
+    }
+
+    let mut result = perform_instantiation(md, linker, template_args, cancel);
+    result.cache_key = Some(key);
+    // The instance may be incomplete
+    if cancel.load(Ordering::Relaxed) {
+        return result;
+    }
+    if let Err(err) = store_entry(cache_dir, &entry_path, &result) {
+        println!(
+            "Could not write instantiation cache entry {}: {err}",
+            entry_path.display()
+        );
+    }
+    result
+}
+
+fn hash_link_info(link_info: &LinkInfo, linker: &Linker, hasher: &mut DefaultHasher) {
+    link_info.name.hash(hasher);
+    format!("{:?}", link_info.file).hash(hasher);
+    linker.files[link_info.file].file_identifier.hash(hasher);
+    link_info.errors.did_error.hash(hasher);
+    format!("{:?}", link_info.template_parameters).hash(hasher);
+    format!("{:?}", link_info.instructions).hash(hasher);
+}
+
+fn hash_module(md: &Module, linker: &Linker, hasher: &mut DefaultHasher) {
+    hash_link_info(&md.link_info, linker, hasher);
+    format!("{:?}", md.ports).hash(hasher);
+    format!("{:?}", md.domains).hash(hasher);
+    format!("{:?}", md.interfaces).hash(hasher);
+    md.implicit_clk_domain.hash(hasher);
+}
+
+/// Only depends on the template arguments and the module's design hash, which is computed once per compilation
+fn cache_key(md: &Module, linker: &Linker, template_args: &TVec<ConcreteType>) -> u64 {
+    let design_hash = md
+        .instantiations
+        .design_hash
+        .get_or_init(|| hash_design(md, linker));
+
+    let mut hasher = DefaultHasher::new();
+    FORMAT_VERSION.hash(&mut hasher);
+    env!("SUS_COMPILER_BUILD_ID").hash(&mut hasher);
+    design_hash.hash(&mut hasher);
+    template_args.hash(&mut hasher);
+    hasher.finish()
+}
+
+/// Hashes the module and all globals it (transitively) references
+fn hash_design(md: &Module, linker: &Linker) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    hash_module(md, linker, &mut hasher);
+
+    let mut visited: HashSet<GlobalUUID> = HashSet::new();
+    let mut to_visit: Vec<GlobalUUID> = md.link_info.resolved_globals.referenced_globals().to_vec();
+    while let Some(global) = to_visit.pop() {
+        if !visited.insert(global) {
+            continue;
+        }
+        format!("{global:?}").hash(&mut hasher);
+        let link_info = match global {
+            GlobalUUID::Module(md_id) => {
+                let dependency = &linker.modules[md_id];
+                hash_module(dependency, linker, &mut hasher);
+                &dependency.link_info
+            }
+            GlobalUUID::Type(_) | GlobalUUID::Constant(_) => {
+                let link_info = linker.get_link_info(global);
+                hash_link_info(link_info, linker, &mut hasher);
+                link_info
+            }
+        };
+        to_visit.extend_from_slice(link_info.resolved_globals.referenced_globals());
+    }
+
+    hasher.finish()
+}
+
+fn load_entry(
+    entry_path: &Path,
+    linker: &Linker,
+    cancel: &AtomicBool,
+) -> Option<InstantiatedModule> {
+    let bytes = std::fs::read(entry_path).ok()?;
+    let mut reader = CacheReader {
+        bytes: &bytes,
+        linker,
+        cancel,
+    };
+    if reader.take(MAGIC.len())? != MAGIC || u32::read(&mut reader)? != FORMAT_VERSION {
+        return None;
+    }
+    let result = InstantiatedModule::read(&mut reader)?;
+    reader.bytes.is_empty().then_some(result)
+}
+
+fn store_entry(
+    cache_dir: &Path,
+    entry_path: &Path,
+    instance: &InstantiatedModule,
+) -> std::io::Result<()> {
+    let mut bytes = Vec::new();
+    bytes.extend_from_slice(MAGIC);
+    FORMAT_VERSION.write(&mut bytes);
+    instance.write(&mut bytes);
+
+    // Write to a temporary file first, such that concurrent compiler runs never read half-written entries
+    std::fs::create_dir_all(cache_dir)?;
+    let tmp_path = entry_path.with_extension(format!("tmp{}", std::process::id()));
+    std::fs::write(&tmp_path, bytes)?;
+    std::fs::rename(&tmp_path, entry_path)
+}
+
+struct CacheReader<'b, 'l> {
+    bytes: &'b [u8],
+    /// Submodule instances are not stored in their parent, they're fetched from their own [InstantiationCache] instead
+    linker: &'l Linker,
+    cancel: &'l AtomicBool,
+}
+
+impl<'b> CacheReader<'b, '_> {
+    fn take(&mut self, num_bytes: usize) -> Option<&'b [u8]> {
+        if num_bytes > self.bytes.len() {
+            return None;
+        }
+        let (taken, rest) = self.bytes.split_at(num_bytes);
+        self.bytes = rest;
+        Some(taken)
+    }
+}
+
+/// Binary encoding of the parts of an [InstantiatedModule]
+trait CacheData: Sized {
+    fn write(&self, out: &mut Vec<u8>);
+    fn read(input: &mut CacheReader) -> Option<Self>;
+}
+
+impl CacheData for u8 {
+    fn write(&self, out: &mut Vec<u8>) {
+        out.push(*self);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(input.take(1)?[0])
+    }
+}
+
+impl CacheData for u32 {
+    fn write(&self, out: &mut Vec<u8>) {
+        out.extend_from_slice(&self.to_le_bytes());
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(u32::from_le_bytes(input.take(4)?.try_into().ok()?))
+    }
+}
+
+impl CacheData for i64 {
+    fn write(&self, out: &mut Vec<u8>) {
+        out.extend_from_slice(&self.to_le_bytes());
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(i64::from_le_bytes(input.take(8)?.try_into().ok()?))
+    }
+}
+
+impl CacheData for usize {
+    fn write(&self, out: &mut Vec<u8>) {
+        out.extend_from_slice(&(*self as u64).to_le_bytes());
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        usize::try_from(u64::from_le_bytes(input.take(8)?.try_into().ok()?)).ok()
+    }
+}
+
+impl CacheData for bool {
+    fn write(&self, out: &mut Vec<u8>) {
+        (*self as u8).write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        match u8::read(input)? {
+            0 => Some(false),
+            1 => Some(true),
+            _ => None,
+        }
+    }
+}
+
+impl CacheData for String {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.len().write(out);
+        out.extend_from_slice(self.as_bytes());
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        let len = usize::read(input)?;
+        String::from_utf8(input.take(len)?.to_vec()).ok()
+    }
+}
+
+/// Encoded like [String]
+impl CacheData for Symbol {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.len().write(out);
+        out.extend_from_slice(self.as_bytes());
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        let len = usize::read(input)?;
+        let name = std::str::from_utf8(input.take(len)?).ok()?;
+        Some(Symbol::intern(&input.linker.names, name))
+    }
+}
+
+impl<T: CacheData> CacheData for Option<T> {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.is_some().write(out);
+        if let Some(v) = self {
+            v.write(out);
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        if bool::read(input)? {
+            Some(Some(T::read(input)?))
+        } else {
+            Some(None)
+        }
+    }
+}
+
+impl<T: CacheData> CacheData for Vec<T> {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.len().write(out);
+        for v in self {
+            v.write(out);
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        let len = usize::read(input)?;
+        // Don't trust the length for preallocation, a corrupted entry could make us allocate a lot
+        let mut result = Vec::with_capacity(len.min(input.bytes.len()));
+        for _ in 0..len {
+            result.push(T::read(input)?);
+        }
+        Some(result)
+    }
+}
+
+impl<T: CacheData> CacheData for Box<[T]> {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.len().write(out);
+        for v in self.iter() {
+            v.write(out);
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(Vec::read(input)?.into_boxed_slice())
+    }
+}
+
+impl<IndexMarker> CacheData for UUID<IndexMarker> {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.get_hidden_value().write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(UUID::from_hidden_value(usize::read(input)?))
+    }
+}
+
+impl<T: CacheData, IndexMarker> CacheData for FlatAlloc<T, IndexMarker> {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.len().write(out);
+        for (_id, v) in self {
+            v.write(out);
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        let len = usize::read(input)?;
+        let mut result = FlatAlloc::with_capacity(len.min(input.bytes.len()));
+        for _ in 0..len {
+            result.alloc(T::read(input)?);
+        }
+        Some(result)
+    }
+}
+
+impl CacheData for Span {
+    fn write(&self, out: &mut Vec<u8>) {
+        let range = self.as_range();
+        range.start.write(out);
+        range.end.write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        let start = usize::read(input)?;
+        let end = usize::read(input)?;
+        (end >= start).then(|| Span::from(start..end))
+    }
+}
+
+impl CacheData for BracketSpan {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.outer_span().write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(BracketSpan::from_outer(Span::read(input)?))
+    }
+}
+
+impl CacheData for BigInt {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.to_signed_bytes_le().write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(BigInt::from_signed_bytes_le(&Vec::<u8>::read(input)?))
+    }
+}
+
+impl CacheData for IntValue {
+    fn write(&self, out: &mut Vec<u8>) {
+        match self {
+            IntValue::Small(v) => {
+                0u8.write(out);
+                v.write(out);
+            }
+            IntValue::Big(v) => {
+                1u8.write(out);
+                v.write(out);
+            }
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(match u8::read(input)? {
+            0 => IntValue::Small(i64::read(input)?),
+            1 => IntValue::from(BigInt::read(input)?),
+            _ => return None,
+        })
+    }
+}
+
+impl CacheData for Value {
+    fn write(&self, out: &mut Vec<u8>) {
+        match self {
+            Value::Bool(b) => {
+                0u8.write(out);
+                b.write(out);
+            }
+            Value::Integer(v) => {
+                1u8.write(out);
+                v.write(out);
+            }
+            Value::Array(values) => {
+                2u8.write(out);
+                values.write(out);
+            }
+            // Packed arrays are rare enough in instances that they're stored unpacked
+            Value::BoolArray(_) | Value::IntArray(_) => {
+                2u8.write(out);
+                let values: Box<[Value]> = self.array_iter().map(Cow::into_owned).collect();
+                values.write(out);
+            }
+            Value::Unset => 3u8.write(out),
+            Value::Error => 4u8.write(out),
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(match u8::read(input)? {
+            0 => Value::Bool(bool::read(input)?),
+            1 => Value::Integer(IntValue::read(input)?),
+            2 => Value::Array(Box::read(input)?),
+            3 => Value::Unset,
+            4 => Value::Error,
+            _ => return None,
+        })
+    }
+}
+
+impl CacheData for ConcreteType {
+    fn write(&self, out: &mut Vec<u8>) {
+        match self {
+            ConcreteType::Named(global_ref) => {
+                0u8.write(out);
+                global_ref.id.write(out);
+                global_ref.template_args.write(out);
+            }
+            ConcreteType::Value(v) => {
+                1u8.write(out);
+                v.write(out);
+            }
+            ConcreteType::Array(arr) => {
+                2u8.write(out);
+                arr.0.write(out);
+                arr.1.write(out);
+            }
+            ConcreteType::Unknown(var) => {
+                3u8.write(out);
+                var.write(out);
+            }
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(match u8::read(input)? {
+            0 => ConcreteType::Named(ConcreteGlobalReference {
+                id: UUID::read(input)?,
+                template_args: FlatAlloc::read(input)?,
+            }),
+            1 => ConcreteType::Value(Value::read(input)?),
+            2 => {
+                let content = ConcreteType::read(input)?;
+                let size = ConcreteType::read(input)?;
+                ConcreteType::Array(Box::new((content, size)))
+            }
+            3 => ConcreteType::Unknown(UUID::read(input)?),
+            _ => return None,
+        })
+    }
+}
+
+/// Only the type itself is stored. Errored instances may still contain unknowns, those stay [InstanceType::Inferring]
+impl CacheData for InstanceType {
+    fn write(&self, out: &mut Vec<u8>) {
+        ConcreteType::write(self, out)
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        let typ = ConcreteType::read(input)?;
+        Some(if typ.contains_unknown() {
+            InstanceType::Inferring(typ)
+        } else {
+            InstanceType::Final(typ.intern(&input.linker.interned_types))
+        })
+    }
+}
+
+/// Operators are stored as their index in these lists
+const UNARY_OPERATORS: [UnaryOperator; 7] = [
+    UnaryOperator::And,
+    UnaryOperator::Or,
+    UnaryOperator::Xor,
+    UnaryOperator::Not,
+    UnaryOperator::Sum,
+    UnaryOperator::Product,
+    UnaryOperator::Negate,
+];
+const BINARY_OPERATORS: [BinaryOperator; 14] = [
+    BinaryOperator::And,
+    BinaryOperator::Or,
+    BinaryOperator::Xor,
+    BinaryOperator::Add,
+    BinaryOperator::Subtract,
+    BinaryOperator::Multiply,
+    BinaryOperator::Divide,
+    BinaryOperator::Modulo,
+    BinaryOperator::Equals,
+    BinaryOperator::NotEquals,
+    BinaryOperator::Greater,
+    BinaryOperator::GreaterEq,
+    BinaryOperator::Lesser,
+    BinaryOperator::LesserEq,
+];
+
+impl CacheData for UnaryOperator {
+    fn write(&self, out: &mut Vec<u8>) {
+        let idx = UNARY_OPERATORS.iter().position(|op| op == self).unwrap();
+        (idx as u8).write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        UNARY_OPERATORS.get(u8::read(input)? as usize).copied()
+    }
+}
+
+impl CacheData for BinaryOperator {
+    fn write(&self, out: &mut Vec<u8>) {
+        let idx = BINARY_OPERATORS.iter().position(|op| op == self).unwrap();
+        (idx as u8).write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        BINARY_OPERATORS.get(u8::read(input)? as usize).copied()
+    }
+}
+
+impl CacheData for ErrorInfo {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.position.write(out);
+        self.file.write(out);
+        self.info.write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(ErrorInfo {
+            position: Span::read(input)?,
+            file: UUID::read(input)?,
+            info: String::read(input)?,
+        })
+    }
+}
+
+impl CacheData for CompileError {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.position.write(out);
+        self.reason.write(out);
+        self.infos.write(out);
+        (self.level == ErrorLevel::Error).write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(CompileError {
+            position: Span::read(input)?,
+            reason: String::read(input)?,
+            infos: Vec::read(input)?,
+            level: if bool::read(input)? {
+                ErrorLevel::Error
+            } else {
+                ErrorLevel::Warning
+            },
+        })
+    }
+}
+
+impl CacheData for ErrorStore {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.did_error.write(out);
+        self.into_iter().len().write(out);
+        for err in self {
+            err.write(out);
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        let did_error = bool::read(input)?;
+        let errors = Vec::read(input)?;
+        Some(ErrorStore::from_parts(errors, did_error))
+    }
+}
+
+impl CacheData for RealWirePathElem {
+    fn write(&self, out: &mut Vec<u8>) {
+        match self {
+            RealWirePathElem::ArrayAccess { span, idx_wire } => {
+                span.write(out);
+                idx_wire.write(out);
+            }
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(RealWirePathElem::ArrayAccess {
+            span: BracketSpan::read(input)?,
+            idx_wire: UUID::read(input)?,
+        })
+    }
+}
+
+impl CacheData for ConditionStackElem {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.condition_wire.write(out);
+        self.inverse.write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(ConditionStackElem {
+            condition_wire: UUID::read(input)?,
+            inverse: bool::read(input)?,
+        })
+    }
+}
+
+impl CacheData for MultiplexerSource {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.to_path.write(out);
+        self.num_regs.write(out);
+        self.from.write(out);
+        self.condition.write(out);
+        self.original_connection.write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(MultiplexerSource {
+            to_path: Vec::read(input)?,
+            num_regs: i64::read(input)?,
+            from: UUID::read(input)?,
+            condition: Box::read(input)?,
+            original_connection: UUID::read(input)?,
+        })
+    }
+}
+
+impl CacheData for RealWireDataSource {
+    fn write(&self, out: &mut Vec<u8>) {
+        match self {
+            RealWireDataSource::ReadOnly => 0u8.write(out),
+            RealWireDataSource::Multiplexer { is_state, sources } => {
+                1u8.write(out);
+                is_state.write(out);
+                sources.write(out);
+            }
+            RealWireDataSource::UnaryOp { op, right } => {
+                2u8.write(out);
+                op.write(out);
+                right.write(out);
+            }
+            RealWireDataSource::BinaryOp { op, left, right } => {
+                3u8.write(out);
+                op.write(out);
+                left.write(out);
+                right.write(out);
+            }
+            RealWireDataSource::Select { root, path } => {
+                4u8.write(out);
+                root.write(out);
+                path.write(out);
+            }
+            RealWireDataSource::Constant { value } => {
+                5u8.write(out);
+                value.write(out);
+            }
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(match u8::read(input)? {
+            0 => RealWireDataSource::ReadOnly,
+            1 => RealWireDataSource::Multiplexer {
+                is_state: Option::read(input)?,
+                sources: Vec::read(input)?,
+            },
+            2 => RealWireDataSource::UnaryOp {
+                op: UnaryOperator::read(input)?,
+                right: UUID::read(input)?,
+            },
+            3 => RealWireDataSource::BinaryOp {
+                op: BinaryOperator::read(input)?,
+                left: UUID::read(input)?,
+                right: UUID::read(input)?,
+            },
+            4 => RealWireDataSource::Select {
+                root: UUID::read(input)?,
+                path: Vec::read(input)?,
+            },
+            5 => RealWireDataSource::Constant {
+                value: Value::read(input)?,
+            },
+            _ => return None,
+        })
+    }
+}
+
+impl CacheData for RealWire {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.source.write(out);
+        self.original_instruction.write(out);
+        self.typ.write(out);
+        self.name.write(out);
+        self.domain.write(out);
+        self.specified_latency.write(out);
+        self.absolute_latency.write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(RealWire {
+            source: RealWireDataSource::read(input)?,
+            original_instruction: UUID::read(input)?,
+            typ: InstanceType::read(input)?,
+            name: Symbol::read(input)?,
+            domain: UUID::read(input)?,
+            specified_latency: i64::read(input)?,
+            absolute_latency: i64::read(input)?,
+        })
+    }
+}
+
+impl CacheData for SubModulePort {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.maps_to_wire.write(out);
+        self.name_refs.write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(SubModulePort {
+            maps_to_wire: UUID::read(input)?,
+            name_refs: Vec::read(input)?,
+        })
+    }
+}
+
+impl CacheData for SubModule {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.original_instruction.write(out);
+        self.instance.get().is_some().write(out);
+        self.port_map.write(out);
+        self.interface_call_sites.write(out);
+        self.name.write(out);
+        self.module_uuid.write(out);
+        self.template_args.write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        let original_instruction = UUID::read(input)?;
+        let has_instance = bool::read(input)?;
+        let port_map = FlatAlloc::read(input)?;
+        let interface_call_sites = FlatAlloc::read(input)?;
+        let name = Symbol::read(input)?;
+        let module_uuid: ModuleUUID = UUID::read(input)?;
+        let template_args: TVec<InstanceType> = FlatAlloc::read(input)?;
+
+        let instance = if has_instance {
+            let sub_module = &input.linker.modules[module_uuid];
+            let sub_instance = sub_module.instantiations.instantiate(
+                sub_module,
+                input.linker,
+                template_args.map(|(_, arg)| arg.unwrap_final().clone()),
+                input.cancel,
+            )?;
+            OnceLock::from(sub_instance)
+        } else {
+            OnceLock::new()
+        };
+
+        Some(SubModule {
+            original_instruction,
+            instance,
+            port_map,
+            interface_call_sites,
+            name,
+            module_uuid,
+            template_args,
+        })
+    }
+}
+
+impl CacheData for InstantiatedPort {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.wire.write(out);
+        self.is_input.write(out);
+        self.absolute_latency.write(out);
+        self.typ.write(out);
+        self.domain.write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(InstantiatedPort {
+            wire: UUID::read(input)?,
+            is_input: bool::read(input)?,
+            absolute_latency: i64::read(input)?,
+            typ: ConcreteType::read(input)?.intern(&input.linker.interned_types),
+            domain: UUID::read(input)?,
+        })
+    }
+}
+
+impl CacheData for SubModuleOrWire {
+    fn write(&self, out: &mut Vec<u8>) {
+        match self {
+            SubModuleOrWire::SubModule(sm_id) => {
+                0u8.write(out);
+                sm_id.write(out);
+            }
+            SubModuleOrWire::Wire(wire_id) => {
+                1u8.write(out);
+                wire_id.write(out);
+            }
+            SubModuleOrWire::CompileTimeValue(v) => {
+                2u8.write(out);
+                v.write(out);
+            }
+            SubModuleOrWire::Unnasigned => 3u8.write(out),
+        }
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(match u8::read(input)? {
+            0 => SubModuleOrWire::SubModule(UUID::read(input)?),
+            1 => SubModuleOrWire::Wire(UUID::read(input)?),
+            2 => SubModuleOrWire::CompileTimeValue(Value::read(input)?),
+            3 => SubModuleOrWire::Unnasigned,
+            _ => return None,
+        })
+    }
+}
+
+impl CacheData for InstantiatedModule {
+    fn write(&self, out: &mut Vec<u8>) {
+        self.name.write(out);
+        self.mangled_name.write(out);
+        self.errors.write(out);
+        self.interface_ports.write(out);
+        self.wires.write(out);
+        self.submodules.write(out);
+        self.generation_state.write(out);
+    }
+    fn read(input: &mut CacheReader) -> Option<Self> {
+        Some(InstantiatedModule {
+            name: String::read(input)?,
+            mangled_name: String::read(input)?,
+            errors: ErrorStore::read(input)?,
+            interface_ports: FlatAlloc::read(input)?,
+            wires: FlatAlloc::read(input)?,
+            submodules: FlatAlloc::read(input)?,
+            generation_state: FlatAlloc::read(input)?,
+            cache_key: None,
+        })
+    }
+}
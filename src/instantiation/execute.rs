@@ -4,16 +4,15 @@
 //!
 //! As for typing, it only instantiates written types and leaves the rest for further typechecking.
 
+use std::borrow::Cow;
 use std::ops::{Deref, Index, IndexMut};
 
 use crate::linker::IsExtern;
 use crate::prelude::*;
 use crate::typing::template::GlobalReference;
 
-use num::BigInt;
-
 use crate::flattening::*;
-use crate::value::{compute_binary_op, compute_unary_op, Value};
+use crate::value::{compute_binary_op, compute_unary_op, IntValue, Value};
 
 use crate::typing::{
     abstract_type::DomainType,
@@ -44,37 +43,52 @@ impl GenerationState<'_> {
         }
     }
 
+    /// The last array access of the path uses [Value::array_set], such that packed arrays stay packed
     fn write_gen_variable(
         &self,
         mut target: &mut Value,
         conn_path: &[WireReferencePathElement],
         to_write: Value,
     ) -> ExecutionResult<()> {
-        for elem in conn_path {
+        let Some((last_elem, path_to_last)) = conn_path.split_last() else {
+            *target = to_write;
+            return Ok(());
+        };
+        for elem in path_to_last {
             match elem {
                 &WireReferencePathElement::ArrayAccess { idx, bracket_span } => {
-                    let idx = self.get_generation_integer(idx)?; // Caught by typecheck
-                    let Value::Array(a_box) = target else {
-                        caught_by_typecheck!("Non-array")
-                    };
-                    let array_len = a_box.len();
-                    let Some(tt) = usize::try_from(idx).ok().and_then(|pos| a_box.get_mut(pos))
-                    else {
-                        return Err((
-                            bracket_span.inner_span(),
-                            format!(
-                                "Index {idx} is out of bounds for this array of size {}",
-                                array_len
-                            ),
-                        ));
-                    };
-                    target = tt
+                    let pos = self.get_array_index(target, idx, bracket_span)?;
+                    target = target.array_get_mut(pos).unwrap();
                 }
             }
         }
-        *target = to_write;
+        match last_elem {
+            &WireReferencePathElement::ArrayAccess { idx, bracket_span } => {
+                let pos = self.get_array_index(target, idx, bracket_span)?;
+                target.array_set(pos, to_write);
+            }
+        }
         Ok(())
     }
+    /// Checks that `idx` is in bounds for writing to `target`
+    fn get_array_index(
+        &self,
+        target: &Value,
+        idx: FlatID,
+        bracket_span: BracketSpan,
+    ) -> ExecutionResult<usize> {
+        let idx = self.get_generation_integer(idx)?; // Caught by typecheck
+        let Some(array_len) = target.array_len() else {
+            caught_by_typecheck!("Non-array")
+        };
+        match idx.to_usize() {
+            Some(pos) if pos < array_len => Ok(pos),
+            _ => Err((
+                bracket_span.inner_span(),
+                format!("Index {idx} is out of bounds for this array of size {array_len}"),
+            )),
+        }
+    }
     fn get_generation_value(&self, v: FlatID) -> ExecutionResult<&Value> {
         if let SubModuleOrWire::CompileTimeValue(vv) = &self.generation_state[v] {
             if let Value::Unset | Value::Error = vv {
@@ -92,17 +106,15 @@ impl GenerationState<'_> {
             ))
         }
     }
-    fn get_generation_integer(&self, idx: FlatID) -> ExecutionResult<&BigInt> {
+    fn get_generation_integer(&self, idx: FlatID) -> ExecutionResult<&IntValue> {
         let val = self.get_generation_value(idx)?;
         Ok(val.unwrap_integer())
     }
-    fn get_generation_small_int<INT: for<'v> TryFrom<&'v BigInt>>(
-        &self,
-        idx: FlatID,
-    ) -> ExecutionResult<INT> {
+    fn get_generation_small_int<INT: TryFrom<i64>>(&self, idx: FlatID) -> ExecutionResult<INT> {
         let val = self.get_generation_value(idx)?;
         let val_as_int = val.unwrap_integer();
-        INT::try_from(val_as_int).map_err(|_| {
+        let small_int = val_as_int.to_i64().and_then(|v| INT::try_from(v).ok());
+        small_int.ok_or_else(|| {
             (
                 self.span_of(idx),
                 format!(
@@ -130,21 +142,20 @@ impl IndexMut<FlatID> for GenerationState<'_> {
 
 fn array_access<'v>(
     arr_val: &'v Value,
-    idx: &BigInt,
+    idx: &IntValue,
     span: BracketSpan,
-) -> ExecutionResult<&'v Value> {
-    let Value::Array(arr) = arr_val else {
+) -> ExecutionResult<Cow<'v, Value>> {
+    let Some(array_len) = arr_val.array_len() else {
         caught_by_typecheck!("Value must be an array")
     };
 
-    if let Some(elem) = usize::try_from(idx).ok().and_then(|idx| arr.get(idx)) {
+    if let Some(elem) = idx.to_usize().and_then(|idx| arr_val.array_get(idx)) {
         Ok(elem)
     } else {
         Err((
             span.outer_span(),
             format!(
-                "Compile-Time Array index is out of range: idx: {idx}, array size: {}",
-                arr.len()
+                "Compile-Time Array index is out of range: idx: {idx}, array size: {array_len}"
             ),
         ))
     }
@@ -240,10 +251,10 @@ impl InstantiationContext<'_, '_> {
                 "clog2" => {
                     let (val, span) = self.get_first_template_argument_value(cst_ref);
                     let int_val = val.unwrap_integer();
-                    if *int_val > BigInt::ZERO {
-                        let int_val_minus_one: BigInt = int_val - 1;
+                    if *int_val > IntValue::ZERO {
+                        let int_val_minus_one = int_val - 1;
 
-                        Value::Integer(BigInt::from(int_val_minus_one.bits()))
+                        Value::Integer(IntValue::from(int_val_minus_one.bits()))
                     } else {
                         return Err((span, format!("clog2 argument must be > 0, found {int_val}")));
                     }
@@ -320,7 +331,7 @@ impl InstantiationContext<'_, '_> {
                 &WireReferencePathElement::ArrayAccess { idx, bracket_span } => {
                     let idx_wire = self.get_wire_or_constant_as_wire(idx, domain);
                     assert_eq!(
-                        self.wires[idx_wire].typ, INT_CONCRETE_TYPE,
+                        *self.wires[idx_wire].typ, INT_CONCRETE_TYPE,
                         "Caught by typecheck"
                     );
                     preamble.push(RealWirePathElem::ArrayAccess {
@@ -439,12 +450,19 @@ impl InstantiationContext<'_, '_> {
         }
         Ok(())
     }
-    fn compute_compile_time_wireref(&self, wire_ref: &WireReference) -> ExecutionResult<Value> {
-        let mut work_on_value: Value = match &wire_ref.root {
+    /// Local values are borrowed until the end of the path, such that indexing into a large generative array,
+    /// like a lookup table, only copies the element that is read
+    fn compute_compile_time_wireref(
+        &self,
+        wire_ref: &WireReference,
+    ) -> ExecutionResult<Cow<'_, Value>> {
+        let mut work_on_value: Cow<Value> = match &wire_ref.root {
             &WireReferenceRoot::LocalDecl(decl_id, _span) => {
-                self.generation_state.get_generation_value(decl_id)?.clone()
+                Cow::Borrowed(self.generation_state.get_generation_value(decl_id)?)
+            }
+            WireReferenceRoot::NamedConstant(cst) => {
+                Cow::Owned(self.get_named_constant_value(cst)?)
             }
-            WireReferenceRoot::NamedConstant(cst) => self.get_named_constant_value(cst)?,
             &WireReferenceRoot::SubModulePort(_) => {
                 todo!("Don't yet support compile time functions")
             }
@@ -455,7 +473,12 @@ impl InstantiationContext<'_, '_> {
                 &WireReferencePathElement::ArrayAccess { idx, bracket_span } => {
                     let idx = self.generation_state.get_generation_integer(idx)?;
 
-                    array_access(&work_on_value, idx, bracket_span)?.clone()
+                    match work_on_value {
+                        Cow::Borrowed(arr) => array_access(arr, idx, bracket_span)?,
+                        Cow::Owned(arr) => {
+                            Cow::Owned(array_access(&arr, idx, bracket_span)?.into_owned())
+                        }
+                    }
                 }
             }
         }
@@ -465,7 +488,7 @@ impl InstantiationContext<'_, '_> {
     fn compute_compile_time(&mut self, expression: &Expression) -> ExecutionResult<Value> {
         Ok(match &expression.source {
             ExpressionSource::WireRef(wire_ref) => {
-                self.compute_compile_time_wireref(wire_ref)?.clone()
+                self.compute_compile_time_wireref(wire_ref)?.into_owned()
             }
             &ExpressionSource::UnaryOp { op, right } => {
                 let right_val = self.generation_state.get_generation_value(right)?;
@@ -477,7 +500,6 @@ impl InstantiationContext<'_, '_> {
 
                 match op {
                     BinaryOperator::Divide | BinaryOperator::Modulo => {
-                        use num::Zero;
                         if right_val.unwrap_integer().is_zero() {
                             return Err((
                                 expression.span,
@@ -504,7 +526,9 @@ impl InstantiationContext<'_, '_> {
         domain: DomainID,
     ) -> WireID {
         self.wires.alloc(RealWire {
-            typ: value.get_type_best_effort(&mut self.type_substitutor),
+            typ: value
+                .get_type_best_effort(&mut self.type_substitutor)
+                .into(),
             source: RealWireDataSource::Constant { value },
             original_instruction,
             domain,
@@ -564,10 +588,10 @@ impl InstantiationContext<'_, '_> {
                 source,
                 original_instruction: submod_instance.original_instruction,
                 domain: domain.unwrap_physical(),
-                typ: ConcreteType::Unknown(self.type_substitutor.alloc()),
+                typ: ConcreteType::Unknown(self.type_substitutor.alloc()).into(),
                 name: self
                     .unique_name_producer
-                    .get_unique_name(format!("{}_{}", submod_instance.name, port_data.name)),
+                    .get_unique_name(&format!("{}_{}", submod_instance.name, port_data.name)),
                 specified_latency: CALCULATE_LATENCY_LATER,
                 absolute_latency: CALCULATE_LATENCY_LATER,
             });
@@ -647,7 +671,7 @@ impl InstantiationContext<'_, '_> {
         };
         Ok(self.wires.alloc(RealWire {
             name: self.unique_name_producer.get_unique_name(""),
-            typ: ConcreteType::Unknown(self.type_substitutor.alloc()),
+            typ: ConcreteType::Unknown(self.type_substitutor.alloc()).into(),
             original_instruction,
             domain,
             source,
@@ -694,7 +718,7 @@ impl InstantiationContext<'_, '_> {
             };
             let wire_id = self.wires.alloc(RealWire {
                 name: self.unique_name_producer.get_unique_name(&wire_decl.name),
-                typ,
+                typ: typ.into(),
                 original_instruction,
                 domain: wire_decl.typ.domain.unwrap_physical(),
                 source,
@@ -708,6 +732,12 @@ impl InstantiationContext<'_, '_> {
     fn instantiate_code_block(&mut self, block_range: FlatIDRange) -> ExecutionResult<()> {
         let mut instruction_range = block_range.into_iter();
         while let Some(original_instruction) = instruction_range.next() {
+            if self.cancel.load(Ordering::Relaxed) {
+                return Err((
+                    self.md.get_instruction_span(original_instruction),
+                    "Instantiation was cancelled".to_owned(),
+                ));
+            }
             let instr = &self.md.link_info.instructions[original_instruction];
             self.md.get_instruction_span(original_instruction).debug();
             let instance_to_add: SubModuleOrWire = match instr {
@@ -721,11 +751,11 @@ impl InstantiationContext<'_, '_> {
                     };
                     let port_map = sub_module.ports.map(|_| None);
                     let interface_call_sites = sub_module.interfaces.map(|_| Vec::new());
-                    let mut template_args =
+                    let mut template_args: TVec<InstanceType> =
                         FlatAlloc::with_capacity(submodule.module_ref.template_args.len());
 
                     for (_id, v) in &submodule.module_ref.template_args {
-                        template_args.alloc(match v {
+                        let arg = match v {
                             Some(arg) => match &arg.kind {
                                 TemplateArgKind::Type(typ) => self.concretize_type(typ)?,
                                 TemplateArgKind::Value(v) => ConcreteType::Value(
@@ -733,11 +763,12 @@ impl InstantiationContext<'_, '_> {
                                 ),
                             },
                             None => ConcreteType::Unknown(self.type_substitutor.alloc()),
-                        });
+                        };
+                        template_args.alloc(arg.into());
                     }
                     SubModuleOrWire::SubModule(self.submodules.alloc(SubModule {
                         original_instruction,
-                        instance: OnceCell::new(),
+                        instance: OnceLock::new(),
                         port_map,
                         interface_call_sites,
                         name: self.unique_name_producer.get_unique_name(name_origin),
@@ -875,7 +906,7 @@ impl InstantiationContext<'_, '_> {
                             unreachable!()
                         };
                         *v = Value::Integer(current_val.clone());
-                        current_val += 1;
+                        current_val = &current_val + 1;
                         self.instantiate_code_block(stm.loop_body)?;
                     }
 
@@ -897,7 +928,7 @@ impl InstantiationContext<'_, '_> {
                     wire: *wire_id,
                     is_input: port.is_input,
                     absolute_latency: CALCULATE_LATENCY_LATER,
-                    typ: wire.typ.clone(),
+                    typ: wire.typ.intern(&self.linker.interned_types),
                     domain: wire.domain,
                 })
             }
@@ -1,6 +1,9 @@
+use std::sync::atomic::{AtomicUsize, Ordering};
+
 use crate::config::config;
 
-use super::list_of_lists::ListOfLists;
+pub use super::list_of_lists::FanInOut;
+use super::list_of_lists::{CsrAdjacency, CsrEdges, CsrGraph};
 
 /// A wire for which a latency has been specified.
 ///
@@ -26,39 +29,9 @@ pub enum LatencyCountingError {
     },
 }
 
-/// A graph connection from (resp to) another wire, which specifies the minimal (resp maximal) difference in latency between them.
-#[derive(Debug, Clone, Copy)]
-pub struct FanInOut {
-    pub other: usize,
-    pub delta_latency: i64,
-}
-
-pub fn convert_fanin_to_fanout(fanins: &ListOfLists<FanInOut>) -> ListOfLists<FanInOut> {
-    ListOfLists::from_random_access_iterator(
-        fanins.len(),
-        fanins.iter_flattened_by_bucket().map(
-            |(
-                bucket,
-                &FanInOut {
-                    other,
-                    delta_latency,
-                },
-            )| {
-                (
-                    other,
-                    FanInOut {
-                        other: bucket,
-                        delta_latency: -delta_latency,
-                    },
-                )
-            },
-        ),
-    )
-}
-
 struct LatencyStackElem<'d> {
     node_idx: usize,
-    remaining_fanout: std::slice::Iter<'d, FanInOut>,
+    remaining_fanout: CsrEdges<'d>,
 }
 
 /// The node for the latency-counting graph. See [solve_latencies]
@@ -166,7 +139,7 @@ fn clear_unpinned_latencies(working_latencies: &mut [LatencyNode]) {
 /// Leaves working_latencies[start_node].is_pinned() == true
 fn count_latency<'d, const BACKWARDS: bool>(
     working_latencies: &mut [LatencyNode],
-    fanouts: &'d ListOfLists<FanInOut>,
+    fanouts: &'d CsrAdjacency,
     start_node: usize,
     stack: &mut Vec<LatencyStackElem<'d>>,
 ) -> Result<(), LatencyCountingError> {
@@ -176,11 +149,11 @@ fn count_latency<'d, const BACKWARDS: bool>(
 
     stack.push(LatencyStackElem {
         node_idx: start_node,
-        remaining_fanout: fanouts[start_node].iter(),
+        remaining_fanout: fanouts.edges(start_node),
     });
 
     while let Some(top) = stack.last_mut() {
-        if let Some(&FanInOut {
+        if let Some(FanInOut {
             other: to_node,
             delta_latency,
         }) = top.remaining_fanout.next()
@@ -194,7 +167,7 @@ fn count_latency<'d, const BACKWARDS: bool>(
                 LatencyNodeUpdate::Updated => {
                     stack.push(LatencyStackElem {
                         node_idx: to_node,
-                        remaining_fanout: fanouts[to_node].iter(),
+                        remaining_fanout: fanouts.edges(to_node),
                     });
                 }
                 LatencyNodeUpdate::ErrorPinnedConflict { new_latency } => {
@@ -251,7 +224,7 @@ fn count_latency<'d, const BACKWARDS: bool>(
 
 fn count_latency_all_in_list<'d, const BACKWARDS: bool>(
     working_latencies: &mut [LatencyNode],
-    fanouts: &'d ListOfLists<FanInOut>,
+    fanouts: &'d CsrAdjacency,
     nodes: &[SpecifiedLatency],
     stack: &mut Vec<LatencyStackElem<'d>>,
 ) -> Result<(), LatencyCountingError> {
@@ -315,37 +288,298 @@ fn pop_a_port(ports: &mut Vec<PortLatencyCandidate>) -> Option<PortLatencyCandid
 }
 
 /// All elements in latencies must initially be [LatencyNode::UNSET] or pinned known values
+///
+/// The graph is first split into its connected components (see [find_connected_components]), which are solved independently.
+/// Components that don't contain any specified latency can't be solved, and are left at [i64::MIN]
 pub fn solve_latencies(
-    fanins: &ListOfLists<FanInOut>,
-    fanouts: &ListOfLists<FanInOut>,
+    graph: &CsrGraph,
     inputs: &[usize],
     outputs: &[usize],
     mut specified_latencies: Vec<SpecifiedLatency>,
 ) -> Result<Vec<i64>, LatencyCountingError> {
     if config().debug_print_latency_graph {
-        print_latency_test_case(fanins, inputs, outputs, &specified_latencies);
+        print_latency_test_case(&graph.fanins, inputs, outputs, &specified_latencies);
     }
 
-    if fanins.len() == 0 {
+    if graph.len() == 0 {
         return Ok(Vec::new());
     }
 
+    // If no latencies are given, we have to initialize an arbitrary one ourselves. Prefer input ports over output ports over regular wires
+    if specified_latencies.is_empty() {
+        let wire = *inputs.first().unwrap_or(outputs.first().unwrap_or(&0));
+        specified_latencies.push(SpecifiedLatency { wire, latency: 0 });
+    }
+
+    let components = find_connected_components(graph);
+
+    // Common case, no need to split up the graph
+    if components.num_components == 1 {
+        return solve_connected_latencies(graph, inputs, outputs, &specified_latencies);
+    }
+
+    let sub_problems = components.split_problem(graph, inputs, outputs, &specified_latencies);
+
+    let total_nodes: usize = sub_problems.iter().map(|p| p.nodes.len()).sum();
+    let solutions =
+        if config().jobs > 1 && sub_problems.len() > 1 && total_nodes >= PARALLEL_LATENCY_MIN_NODES
+        {
+            solve_sub_problems_in_parallel(&sub_problems)
+        } else {
+            sub_problems.iter().map(LatencySubProblem::solve).collect()
+        };
+
+    let mut result = vec![i64::MIN; graph.len()];
+    for (sub_problem, solution) in std::iter::zip(&sub_problems, solutions) {
+        for (local_idx, latency) in solution?.into_iter().enumerate() {
+            result[sub_problem.nodes[local_idx]] = latency;
+        }
+    }
+    Ok(result)
+}
+
+/// Below this number of wires, solving components on multiple threads isn't worth it
+const PARALLEL_LATENCY_MIN_NODES: usize = 4096;
+
+/// The (weakly) connected components of the latency graph. Latencies in one component don't constrain those in another
+struct ConnectedComponents {
+    num_components: usize,
+    /// Components are numbered in order of their lowest node
+    component_of: Vec<usize>,
+}
+
+fn find_connected_components(graph: &CsrGraph) -> ConnectedComponents {
+    let mut component_of = vec![usize::MAX; graph.len()];
+    let mut num_components = 0;
+    let mut stack = Vec::new();
+
+    for start_node in 0..graph.len() {
+        if component_of[start_node] != usize::MAX {
+            continue;
+        }
+        component_of[start_node] = num_components;
+        stack.push(start_node);
+        while let Some(node) = stack.pop() {
+            for fan in graph.fanins.edges(node).chain(graph.fanouts.edges(node)) {
+                if component_of[fan.other] == usize::MAX {
+                    component_of[fan.other] = num_components;
+                    stack.push(fan.other);
+                }
+            }
+        }
+        num_components += 1;
+    }
+
+    ConnectedComponents {
+        num_components,
+        component_of,
+    }
+}
+
+/// One connected component of the latency graph, with all wire indices local to it
+struct LatencySubProblem {
+    /// Maps the local indices back to wires of the whole graph
+    nodes: Vec<usize>,
+    graph: CsrGraph,
+    inputs: Vec<usize>,
+    outputs: Vec<usize>,
+    specified_latencies: Vec<SpecifiedLatency>,
+}
+
+impl LatencySubProblem {
+    fn solve(&self) -> Result<Vec<i64>, LatencyCountingError> {
+        solve_connected_latencies(
+            &self.graph,
+            &self.inputs,
+            &self.outputs,
+            &self.specified_latencies,
+        )
+        .map_err(|err| err.map_wires(|local_idx| self.nodes[local_idx]))
+    }
+}
+
+impl ConnectedComponents {
+    /// Only produces the components that contain a specified latency, the others can't be solved
+    fn split_problem(
+        &self,
+        graph: &CsrGraph,
+        inputs: &[usize],
+        outputs: &[usize],
+        specified_latencies: &[SpecifiedLatency],
+    ) -> Vec<LatencySubProblem> {
+        let mut has_specified_latency = vec![false; self.num_components];
+        for spec in specified_latencies {
+            has_specified_latency[self.component_of[spec.wire]] = true;
+        }
+        // Keep the sub problems in the same order as the components, such that errors are reported consistently
+        let mut sub_problem_of_component = vec![usize::MAX; self.num_components];
+        let mut num_sub_problems = 0;
+        for (component, has_spec) in has_specified_latency.into_iter().enumerate() {
+            if has_spec {
+                sub_problem_of_component[component] = num_sub_problems;
+                num_sub_problems += 1;
+            }
+        }
+
+        // Nodes keep their relative order within their sub problem
+        let mut local_idx = vec![usize::MAX; self.component_of.len()];
+        let mut nodes_per_sub_problem: Vec<Vec<usize>> = vec![Vec::new(); num_sub_problems];
+        for (node, component) in self.component_of.iter().enumerate() {
+            let sub_problem = sub_problem_of_component[*component];
+            if sub_problem != usize::MAX {
+                local_idx[node] = nodes_per_sub_problem[sub_problem].len();
+                nodes_per_sub_problem[sub_problem].push(node);
+            }
+        }
+
+        // Edges never leave their component, so all of them can be mapped to local indices
+        let to_local = |adjacency: &CsrAdjacency, nodes: &[usize]| -> CsrAdjacency {
+            nodes
+                .iter()
+                .map(|n| {
+                    adjacency.edges(*n).map(|fan| FanInOut {
+                        other: local_idx[fan.other],
+                        delta_latency: fan.delta_latency,
+                    })
+                })
+                .collect()
+        };
+        let mut sub_problems: Vec<LatencySubProblem> = nodes_per_sub_problem
+            .into_iter()
+            .map(|nodes| LatencySubProblem {
+                graph: CsrGraph {
+                    fanins: to_local(&graph.fanins, &nodes),
+                    fanouts: to_local(&graph.fanouts, &nodes),
+                },
+                nodes,
+                inputs: Vec::new(),
+                outputs: Vec::new(),
+                specified_latencies: Vec::new(),
+            })
+            .collect();
+
+        let sub_problem_of_wire = |wire: usize| {
+            let sub_problem = sub_problem_of_component[self.component_of[wire]];
+            (sub_problem != usize::MAX).then_some(sub_problem)
+        };
+        for i in inputs {
+            if let Some(sp) = sub_problem_of_wire(*i) {
+                sub_problems[sp].inputs.push(local_idx[*i]);
+            }
+        }
+        for o in outputs {
+            if let Some(sp) = sub_problem_of_wire(*o) {
+                sub_problems[sp].outputs.push(local_idx[*o]);
+            }
+        }
+        for spec in specified_latencies {
+            let sp = sub_problem_of_wire(spec.wire).unwrap();
+            sub_problems[sp].specified_latencies.push(SpecifiedLatency {
+                wire: local_idx[spec.wire],
+                latency: spec.latency,
+            });
+        }
+
+        sub_problems
+    }
+}
+
+/// Threads grab the next component to solve from a shared counter. Solutions are returned in the order of `sub_problems`
+fn solve_sub_problems_in_parallel(
+    sub_problems: &[LatencySubProblem],
+) -> Vec<Result<Vec<i64>, LatencyCountingError>> {
+    let next_sub_problem = &AtomicUsize::new(0);
+    let num_threads = usize::min(config().jobs, sub_problems.len());
+
+    let mut solutions: Vec<(usize, Result<Vec<i64>, LatencyCountingError>)> =
+        std::thread::scope(|scope| {
+            let workers: Vec<_> = (0..num_threads)
+                .map(|_| {
+                    scope.spawn(move || {
+                        let mut finished = Vec::new();
+                        loop {
+                            let idx = next_sub_problem.fetch_add(1, Ordering::Relaxed);
+                            let Some(sub_problem) = sub_problems.get(idx) else {
+                                break;
+                            };
+                            finished.push((idx, sub_problem.solve()));
+                        }
+                        finished
+                    })
+                })
+                .collect();
+            workers
+                .into_iter()
+                .flat_map(|worker| worker.join().unwrap())
+                .collect()
+        });
+
+    solutions.sort_by_key(|(idx, _)| *idx);
+    solutions
+        .into_iter()
+        .map(|(_, solution)| solution)
+        .collect()
+}
+
+impl LatencyCountingError {
+    /// Translates the wires mentioned in this error, for instance from a [LatencySubProblem] back to the whole graph
+    fn map_wires(self, f: impl Fn(usize) -> usize) -> Self {
+        let map_path = |path: Vec<SpecifiedLatency>| {
+            path.into_iter()
+                .map(|spec| SpecifiedLatency {
+                    wire: f(spec.wire),
+                    latency: spec.latency,
+                })
+                .collect()
+        };
+        match self {
+            LatencyCountingError::ConflictingSpecifiedLatencies { conflict_path } => {
+                LatencyCountingError::ConflictingSpecifiedLatencies {
+                    conflict_path: map_path(conflict_path),
+                }
+            }
+            LatencyCountingError::NetPositiveLatencyCycle {
+                conflict_path,
+                net_roundtrip_latency,
+            } => LatencyCountingError::NetPositiveLatencyCycle {
+                conflict_path: map_path(conflict_path),
+                net_roundtrip_latency,
+            },
+            LatencyCountingError::IndeterminablePortLatency { bad_ports } => {
+                LatencyCountingError::IndeterminablePortLatency {
+                    bad_ports: bad_ports
+                        .into_iter()
+                        .map(|(wire, a, b)| (f(wire), a, b))
+                        .collect(),
+                }
+            }
+        }
+    }
+}
+
+/// Solves a connected latency graph, see [solve_latencies]
+///
+/// Requires at least one specified latency
+fn solve_connected_latencies(
+    graph: &CsrGraph,
+    inputs: &[usize],
+    outputs: &[usize],
+    specified_latencies: &[SpecifiedLatency],
+) -> Result<Vec<i64>, LatencyCountingError> {
+    assert!(!specified_latencies.is_empty());
+    let fanins = &graph.fanins;
+    let fanouts = &graph.fanouts;
+
     // The current set of latencies
-    let mut working_latencies = vec![LatencyNode::UNSET; fanins.len()];
+    let mut working_latencies = vec![LatencyNode::UNSET; graph.len()];
     // This stack is reused by [count_latency] calls
     let mut stack = Vec::new();
     // This list contains all ports that still need to be placed. This list gathers port assignments as they happen,
     // and reports errors if port conflicts arise
     let mut ports_to_place = Vec::with_capacity(inputs.len() + outputs.len());
 
-    // If no latencies are given, we have to initialize an arbitrary one ourselves. Prefer input ports over output ports over regular wires
-    if specified_latencies.is_empty() {
-        let wire = *inputs.first().unwrap_or(outputs.first().unwrap_or(&0));
-        specified_latencies.push(SpecifiedLatency { wire, latency: 0 });
-    }
-
     // Set up the specified latencies
-    for spec_lat in &specified_latencies {
+    for spec_lat in specified_latencies {
         working_latencies[spec_lat.wire] = LatencyNode::new_pinned(spec_lat.latency);
     }
 
@@ -372,7 +606,7 @@ pub fn solve_latencies(
     count_latency_all_in_list::<false>(
         &mut working_latencies,
         fanouts,
-        &specified_latencies,
+        specified_latencies,
         &mut stack,
     )?;
     inform_all_ports(&mut ports_to_place, &working_latencies)?;
@@ -382,7 +616,7 @@ pub fn solve_latencies(
     count_latency_all_in_list::<true>(
         &mut working_latencies,
         fanins,
-        &specified_latencies,
+        specified_latencies,
         &mut stack,
     )?;
     inform_all_ports(&mut ports_to_place, &working_latencies)?;
@@ -406,7 +640,7 @@ pub fn solve_latencies(
         clear_unpinned_latencies(&mut working_latencies);
     }
     // It may be that some ports are leftover after this while loop. That just means they weren't connected to a port we have seen.
-    // TODO multi-cluster ports
+    // Ports in other connected components are solved separately, see [solve_latencies]
 
     // Now that we have all the ports, we can fill in the internal latencies
     for idx in 0..working_latencies.len() {
@@ -441,7 +675,7 @@ pub fn solve_latencies(
 }
 
 fn print_latency_test_case(
-    fanins: &ListOfLists<FanInOut>,
+    fanins: &CsrAdjacency,
     inputs: &[usize],
     outputs: &[usize],
     specified_latencies: &[SpecifiedLatency],
@@ -450,24 +684,23 @@ fn print_latency_test_case(
     println!("#[test]");
     println!("fn new_test_case() {{");
     println!("    let fanins : [&[FanInOut]; {}] = [", fanins.len());
-    for (idx, fin) in fanins.iter().enumerate() {
+    for idx in 0..fanins.len() {
         print!("        /*{idx}*/&[");
         for FanInOut {
             other,
             delta_latency,
-        } in fin
+        } in fanins.edges(idx)
         {
             print!("mk_fan({other}, {delta_latency}),")
         }
         println!("],");
     }
     println!("    ];");
-    println!("    let fanins = ListOfLists::from_slice_slice(&fanins);");
-    println!("    let fanouts = convert_fanin_to_fanout(&fanins);");
+    println!("    let graph = graph_from_slice_slice(&fanins);");
     println!("    let inputs = vec!{inputs:?};");
     println!("    let outputs = vec!{outputs:?};");
     println!("    let specified_latencies = vec!{specified_latencies:?};");
-    println!("    let found_latencies = solve_latencies(&fanins, &fanouts, &inputs, &outputs, specified_latencies).unwrap();");
+    println!("    let found_latencies = solve_latencies(&graph, &inputs, &outputs, specified_latencies).unwrap();");
     println!("}}");
     println!("==== END LATENCY TEST CASE ====");
 }
@@ -483,25 +716,27 @@ mod tests {
         }
     }
 
+    fn graph_from_slice_slice(fanins: &[&[FanInOut]]) -> CsrGraph {
+        CsrGraph::from_fanins(fanins.iter().map(|fin| fin.iter().copied()).collect())
+    }
+
     // makes inputs for fanins, outputs for fanouts
-    fn infer_ports(fanins: &ListOfLists<FanInOut>) -> Vec<usize> {
-        fanins
-            .iter()
-            .enumerate()
-            .filter_map(|(idx, v)| v.is_empty().then_some(idx))
+    fn infer_ports(fanins: &CsrAdjacency) -> Vec<usize> {
+        (0..fanins.len())
+            .filter(|idx| fanins.edges(*idx).len() == 0)
             .collect()
     }
 
     fn solve_latencies_infer_ports(
-        fanins: &ListOfLists<FanInOut>,
+        fanins: &[&[FanInOut]],
         specified_latencies: Vec<SpecifiedLatency>,
     ) -> Result<Vec<i64>, LatencyCountingError> {
-        let fanouts = convert_fanin_to_fanout(fanins);
+        let graph = graph_from_slice_slice(fanins);
 
-        let inputs = infer_ports(fanins);
-        let outputs = infer_ports(&fanouts);
+        let inputs = infer_ports(&graph.fanins);
+        let outputs = infer_ports(&graph.fanouts);
 
-        solve_latencies(fanins, &fanouts, &inputs, &outputs, specified_latencies)
+        solve_latencies(&graph, &inputs, &outputs, specified_latencies)
     }
 
     fn latencies_equal(a: &[i64], b: &[i64]) -> bool {
@@ -528,17 +763,33 @@ mod tests {
             /*5*/ &[mk_fan(4, 0), mk_fan(1, 1)],
             /*6*/ &[mk_fan(5, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
 
         let correct_latencies = [0, 0, 2, 2, 1, 1, 1];
 
-        let fanouts = convert_fanin_to_fanout(&fanins);
-
         let inputs = vec![0, 4];
         let outputs = vec![3, 6];
 
-        let found_latencies =
-            solve_latencies(&fanins, &fanouts, &inputs, &outputs, Vec::new()).unwrap();
+        let found_latencies = solve_latencies(&graph, &inputs, &outputs, Vec::new()).unwrap();
+
+        assert!(
+            latencies_equal(&found_latencies, &correct_latencies),
+            "{found_latencies:?} =lat= {correct_latencies:?}"
+        );
+    }
+
+    #[test]
+    fn check_correct_latency_beyond_i32() {
+        let fanins: [&[FanInOut]; 3] = [
+            /*0*/ &[],
+            /*1*/ &[mk_fan(0, 3_000_000_000)],
+            /*2*/ &[mk_fan(1, 1)],
+        ];
+        let graph = graph_from_slice_slice(&fanins);
+
+        let correct_latencies = [0, 3_000_000_000, 3_000_000_001];
+
+        let found_latencies = solve_latencies(&graph, &[0], &[2], Vec::new()).unwrap();
 
         assert!(
             latencies_equal(&found_latencies, &correct_latencies),
@@ -557,18 +808,15 @@ mod tests {
             /*5*/ &[mk_fan(4, 0), mk_fan(1, 1)],
             /*6*/ &[mk_fan(5, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
 
         let correct_latencies = [-1, -1, 1, 1, 0, 0, 0];
 
-        let fanouts = convert_fanin_to_fanout(&fanins);
-
         let inputs = vec![0, 4];
         let outputs = vec![3, 6];
 
         let found_latencies = solve_latencies(
-            &fanins,
-            &fanouts,
+            &graph,
             &inputs,
             &outputs,
             vec![SpecifiedLatency {
@@ -592,12 +840,10 @@ mod tests {
             /*5*/ &[mk_fan(4, 0), mk_fan(1, 1)],
             /*6*/ &[mk_fan(5, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
 
         let correct_latencies = [0, 0, 2, 2, 1, 1, 1];
 
-        let fanouts = convert_fanin_to_fanout(&fanins);
-
         let inputs = vec![0, 4];
         let outputs = vec![3, 6];
 
@@ -605,8 +851,7 @@ mod tests {
             println!("starting_node: {starting_node}");
             if starting_node == 5 {
                 let err = solve_latencies(
-                    &fanins,
-                    &fanouts,
+                    &graph,
                     &inputs,
                     &outputs,
                     vec![SpecifiedLatency {
@@ -621,8 +866,7 @@ mod tests {
                 continue;
             }
             let found_latencies = solve_latencies(
-                &fanins,
-                &fanouts,
+                &graph,
                 &inputs,
                 &outputs,
                 vec![SpecifiedLatency {
@@ -651,17 +895,14 @@ mod tests {
             /*6*/ &[mk_fan(5, 0)],
             /*7*/ &[], // superfluous input
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
 
         let correct_latencies = [0, 0, 2, 2, 1, 1, 1, -1];
 
-        let fanouts = convert_fanin_to_fanout(&fanins);
-
         let inputs = vec![0, 4];
         let outputs = vec![3, 6];
 
-        let found_latencies =
-            solve_latencies(&fanins, &fanouts, &inputs, &outputs, Vec::new()).unwrap();
+        let found_latencies = solve_latencies(&graph, &inputs, &outputs, Vec::new()).unwrap();
 
         assert!(
             latencies_equal(&found_latencies, &correct_latencies),
@@ -681,17 +922,14 @@ mod tests {
             /*6*/ &[mk_fan(5, 0)],
             /*7*/ &[mk_fan(5, 2)], // superfluous output
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
 
         let correct_latencies = [-1, -1, 1, 1, 0, 0, 0, 2];
 
-        let fanouts = convert_fanin_to_fanout(&fanins);
-
         let inputs = vec![0, 4];
         let outputs = vec![3, 6];
 
-        let found_latencies =
-            solve_latencies(&fanins, &fanouts, &inputs, &outputs, Vec::new()).unwrap();
+        let found_latencies = solve_latencies(&graph, &inputs, &outputs, Vec::new()).unwrap();
 
         assert!(
             latencies_equal(&found_latencies, &correct_latencies),
@@ -710,7 +948,6 @@ mod tests {
             /*5*/ &[mk_fan(4, 0), mk_fan(1, 1)],
             /*6*/ &[mk_fan(5, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
 
         let should_be_err = solve_latencies_infer_ports(&fanins, Vec::new());
 
@@ -731,7 +968,6 @@ mod tests {
             /*5*/ &[mk_fan(4, 0), mk_fan(1, 1)],
             /*6*/ &[mk_fan(5, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
 
         for starting_node in 0..7 {
             println!("starting_node: {starting_node}");
@@ -757,7 +993,6 @@ mod tests {
             /*5*/ &[mk_fan(4, 0), mk_fan(1, 1)],
             /*6*/ &[mk_fan(5, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
 
         let found_latencies = solve_latencies_infer_ports(
             &fanins,
@@ -790,7 +1025,6 @@ mod tests {
             /*5*/ &[mk_fan(4, 0), mk_fan(1, 1)],
             /*6*/ &[mk_fan(5, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
 
         let should_be_err = solve_latencies_infer_ports(
             &fanins,
@@ -828,7 +1062,6 @@ mod tests {
             /*5*/ &[mk_fan(4, 0), mk_fan(1, 1)],
             /*6*/ &[mk_fan(5, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
 
         let should_be_err = solve_latencies_infer_ports(
             &fanins,
@@ -861,7 +1094,6 @@ mod tests {
             /*1*/ &[mk_fan(2, 1)],
             /*2*/ &[mk_fan(0, 1)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
 
         let should_be_err = solve_latencies_infer_ports(
             &fanins,
@@ -903,7 +1135,6 @@ mod tests {
             /*5*/ &[mk_fan(4, 0)],
             /*6*/ &[mk_fan(5, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
 
         let partial_result = solve_latencies_infer_ports(
             &fanins,
@@ -917,6 +1148,75 @@ mod tests {
         assert_eq!(partial_result, &[0, 0, 3, 3, i64::MIN, i64::MIN, i64::MIN])
     }
 
+    #[test]
+    fn check_disjoint_both_specified() {
+        let fanins: [&[FanInOut]; 7] = [
+            /*0*/ &[],
+            /*1*/ &[mk_fan(0, 0)],
+            /*2*/ &[mk_fan(1, 3)],
+            /*3*/ &[mk_fan(2, 0)],
+            /*4*/ &[],
+            /*5*/ &[mk_fan(4, 2)],
+            /*6*/ &[mk_fan(5, 0)],
+        ];
+
+        let found_latencies = solve_latencies_infer_ports(
+            &fanins,
+            vec![
+                SpecifiedLatency {
+                    wire: 0,
+                    latency: 0,
+                },
+                SpecifiedLatency {
+                    wire: 6,
+                    latency: 10,
+                },
+            ],
+        )
+        .unwrap();
+
+        assert_eq!(found_latencies, &[0, 0, 3, 3, 8, 10, 10])
+    }
+
+    #[test]
+    fn check_disjoint_error_reports_original_wires() {
+        let fanins: [&[FanInOut]; 6] = [
+            /*0*/ &[],
+            /*1*/ &[mk_fan(0, 1)],
+            /*2*/ &[],
+            /*3*/ &[mk_fan(2, 0)],
+            /*4*/ &[mk_fan(3, 1)],
+            /*5*/ &[mk_fan(4, 0)],
+        ];
+
+        let should_be_err = solve_latencies_infer_ports(
+            &fanins,
+            vec![
+                SpecifiedLatency {
+                    wire: 0,
+                    latency: 0,
+                },
+                SpecifiedLatency {
+                    wire: 2,
+                    latency: 0,
+                },
+                SpecifiedLatency {
+                    wire: 5,
+                    latency: 0,
+                },
+            ],
+        );
+
+        let Err(LatencyCountingError::ConflictingSpecifiedLatencies { conflict_path }) =
+            should_be_err
+        else {
+            unreachable!("{should_be_err:?}")
+        };
+        assert!(conflict_path.iter().all(|spec| (2..6).contains(&spec.wire)));
+        assert_eq!(conflict_path.first().unwrap().wire, 2);
+        assert_eq!(conflict_path.last().unwrap().wire, 5);
+    }
+
     #[test]
     fn check_bad_cycle() {
         let fanins: [&[FanInOut]; 5] = [
@@ -926,7 +1226,6 @@ mod tests {
             /*3*/ &[mk_fan(2, 0)],
             /*4*/ &[mk_fan(2, 2)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
 
         let should_be_err = solve_latencies_infer_ports(&fanins, Vec::new());
 
@@ -948,10 +1247,9 @@ mod tests {
             /*2*/ &[mk_fan(1, 1)],
             /*3*/ &[mk_fan(2, 1)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
-        let fanouts = convert_fanin_to_fanout(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
 
-        let latencies = solve_latencies(&fanins, &fanouts, &[0, 1], &[3], Vec::new()).unwrap();
+        let latencies = solve_latencies(&graph, &[0, 1], &[3], Vec::new()).unwrap();
 
         assert_eq!(latencies, &[0, 1, 2, 3]);
     }
@@ -964,10 +1262,9 @@ mod tests {
             /*2*/ &[mk_fan(1, 1)],
             /*3*/ &[mk_fan(2, 1)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
-        let fanouts = convert_fanin_to_fanout(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
 
-        let latencies = solve_latencies(&fanins, &fanouts, &[0], &[2, 3], Vec::new()).unwrap();
+        let latencies = solve_latencies(&graph, &[0], &[2, 3], Vec::new()).unwrap();
 
         assert_eq!(latencies, &[0, 1, 2, 3]);
     }
@@ -988,13 +1285,12 @@ mod tests {
             /*8*/ &[mk_fan(6, 0), mk_fan(7, 0)],
             /*9*/ &[mk_fan(0, 0), mk_fan(6, 0)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
-        let fanouts = convert_fanin_to_fanout(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
         let inputs = vec![1, 2, 3];
         let outputs = vec![4, 5];
         let specified_latencies = vec![];
         let found_latencies =
-            solve_latencies(&fanins, &fanouts, &inputs, &outputs, specified_latencies).unwrap();
+            solve_latencies(&graph, &inputs, &outputs, specified_latencies).unwrap();
 
         assert_eq!(found_latencies, [0; 10]);
     }
@@ -1011,8 +1307,7 @@ mod tests {
             /*6*/ &[],
             /*7*/ &[],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
-        let fanouts = convert_fanin_to_fanout(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
         let inputs = vec![1, 2, 3];
         let outputs = vec![4, 5];
         let specified_latencies = vec![SpecifiedLatency {
@@ -1020,7 +1315,7 @@ mod tests {
             latency: 0,
         }];
         let found_latencies =
-            solve_latencies(&fanins, &fanouts, &inputs, &outputs, specified_latencies).unwrap();
+            solve_latencies(&graph, &inputs, &outputs, specified_latencies).unwrap();
 
         assert_eq!(found_latencies, [0; 8]);
     }
@@ -1034,8 +1329,7 @@ mod tests {
             /*3*/ &[],
             /*4*/ &[],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
-        let fanouts = convert_fanin_to_fanout(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
         let inputs = vec![0, 4];
         let outputs = vec![1, 2];
         let specified_latencies = vec![SpecifiedLatency {
@@ -1043,7 +1337,7 @@ mod tests {
             latency: 0,
         }];
         let found_latencies =
-            solve_latencies(&fanins, &fanouts, &inputs, &outputs, specified_latencies).unwrap();
+            solve_latencies(&graph, &inputs, &outputs, specified_latencies).unwrap();
 
         assert_eq!(found_latencies, [0; 5]);
     }
@@ -1062,8 +1356,7 @@ mod tests {
             /*8*/ &[mk_fan(1, 0)],
             /*9*/ &[mk_fan(7, -2), mk_fan(8, -2)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
-        let fanouts = convert_fanin_to_fanout(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
         let inputs = vec![];
         let outputs = vec![];
         let specified_latencies = vec![SpecifiedLatency {
@@ -1071,7 +1364,7 @@ mod tests {
             latency: 0,
         }];
         let _found_latencies =
-            solve_latencies(&fanins, &fanouts, &inputs, &outputs, specified_latencies).unwrap();
+            solve_latencies(&graph, &inputs, &outputs, specified_latencies).unwrap();
     }
 
     #[test]
@@ -1082,8 +1375,7 @@ mod tests {
             /*2*/ &[],
             /*3*/ &[mk_fan(1, -1), mk_fan(0, -2)],
         ];
-        let fanins = ListOfLists::from_slice_slice(&fanins);
-        let fanouts = convert_fanin_to_fanout(&fanins);
+        let graph = graph_from_slice_slice(&fanins);
         let inputs = vec![];
         let outputs = vec![];
         let specified_latencies = vec![SpecifiedLatency {
@@ -1091,6 +1383,6 @@ mod tests {
             latency: 0,
         }];
         let _found_latencies =
-            solve_latencies(&fanins, &fanouts, &inputs, &outputs, specified_latencies).unwrap();
+            solve_latencies(&graph, &inputs, &outputs, specified_latencies).unwrap();
     }
 }
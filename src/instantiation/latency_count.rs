@@ -4,12 +4,10 @@ use crate::prelude::*;
 
 use crate::{
     flattening::{Instruction, WriteModifiers},
-    instantiation::latency_algorithm::{
-        convert_fanin_to_fanout, solve_latencies, FanInOut, LatencyCountingError,
-    },
+    instantiation::latency_algorithm::{solve_latencies, FanInOut, LatencyCountingError},
 };
 
-use self::list_of_lists::ListOfLists;
+use self::list_of_lists::{CsrAdjacency, CsrGraph};
 
 use super::*;
 
@@ -260,26 +258,25 @@ impl InstantiationContext<'_, '_> {
         latency_node_mapper: &WireToLatencyMap,
         latency_node_to_wire_map: &[WireID],
         domain_id: DomainID,
-    ) -> ListOfLists<FanInOut> {
-        let mut fanins: ListOfLists<FanInOut> =
-            ListOfLists::new_with_groups_capacity(latency_node_to_wire_map.len());
+    ) -> CsrAdjacency {
+        let mut fanins = CsrAdjacency::new_with_nodes_capacity(latency_node_to_wire_map.len());
 
         // Wire to wire Fanin
         for wire_id in latency_node_to_wire_map {
-            fanins.new_group();
+            fanins.new_node();
 
             self.wires[*wire_id]
                 .source
                 .iter_sources_with_min_latency(|from, delta_latency| {
                     assert_eq!(self.wires[from].domain, domain_id);
-                    fanins.push_to_last_group(FanInOut {
+                    fanins.push_edge_to_last_node(FanInOut {
                         other: latency_node_mapper.map_wire_to_latency_node[from],
                         delta_latency,
                     });
                 });
 
             if let Some((from, delta_latency)) = latency_node_mapper.next_port_chain[*wire_id] {
-                fanins.push_to_last_group(FanInOut {
+                fanins.push_edge_to_last_node(FanInOut {
                     other: latency_node_mapper.map_wire_to_latency_node[from],
                     delta_latency,
                 })
@@ -323,12 +320,12 @@ impl InstantiationContext<'_, '_> {
                 domain_id,
             );
 
-            // Process fanouts
-            let fanouts = convert_fanin_to_fanout(&fanins);
+            // Also derives the fanouts
+            let graph = CsrGraph::from_fanins(fanins);
+            stats::count(|c| c.latency_edges += graph.fanins.num_edges());
 
             match solve_latencies(
-                &fanins,
-                &fanouts,
+                &graph,
                 &domain_info.input_ports,
                 &domain_info.output_ports,
                 domain_info.initial_values.clone(),
@@ -1,284 +1,261 @@
-use std::{
-    mem::MaybeUninit,
-    ops::{Index, IndexMut},
-};
+//! Compressed sparse row (CSR) graphs, for the latency counting graphs, and the dependency graphs of the lints
+
+/// A graph connection from (resp to) another node, which for latency counting specifies the minimal (resp maximal) difference in latency between them.
+///
+/// This is the unpacked form of an edge in a [CsrAdjacency]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct FanInOut {
+    pub other: usize,
+    pub delta_latency: i64,
+}
 
-/// Basically `Vec<Vec<T>>`, but reduces pointer chasing by laying the nested vectors all out sequentially. Read-only.
+/// One direction of the edges of a [CsrGraph]. Basically `Vec<Vec<FanInOut>>`, but with all edges laid out sequentially. Read-only.
+///
+/// Edges are stored as a struct of arrays of `u32` and `i64`, such that each edge only takes 12 bytes instead of the 16 of a [FanInOut].
+/// Latency differences stay 64 bits, they come straight from user-written latencies like `'3000000000`
 #[derive(Debug, Clone)]
-pub struct ListOfLists<T> {
-    buf: Vec<T>,
-    // A list of #groups+1 offsets in buf array. The end of each one is the start of the next one. They are laid out sequentially
-    start_ends: Vec<usize>,
+pub struct CsrAdjacency {
+    /// A list of #nodes+1 offsets in the edge arrays. The end of each one is the start of the next one
+    start_ends: Vec<u32>,
+    others: Vec<u32>,
+    delta_latencies: Vec<i64>,
 }
 
-impl<T> Default for ListOfLists<T> {
+impl Default for CsrAdjacency {
     fn default() -> Self {
         Self::new()
     }
 }
 
-impl<T> ListOfLists<T> {
+#[track_caller]
+fn to_u32(v: usize) -> u32 {
+    u32::try_from(v).expect("Graphs are limited to u32::MAX nodes and edges")
+}
+
+impl CsrAdjacency {
     pub fn new() -> Self {
-        Self::new_with_groups_capacity(0)
+        Self::new_with_nodes_capacity(0)
     }
 
-    pub fn new_with_groups_capacity(capacity: usize) -> Self {
+    pub fn new_with_nodes_capacity(capacity: usize) -> Self {
         let mut start_ends = Vec::with_capacity(capacity + 1);
         start_ends.push(0);
         Self {
-            buf: Vec::new(),
             start_ends,
+            others: Vec::new(),
+            delta_latencies: Vec::new(),
         }
     }
 
-    pub fn push_to_last_group(&mut self, item: T) {
-        let last_group_end = self.start_ends.last_mut().unwrap();
-        assert!(*last_group_end == self.buf.len());
-        *last_group_end += 1;
-        self.buf.push(item);
-    }
-    pub fn new_group(&mut self) {
-        let last_group_end = self.start_ends.last().unwrap();
-        self.start_ends.push(*last_group_end);
-    }
-
-    pub fn len(&self) -> usize {
-        self.start_ends.len() - 1
+    /// Edges pushed with [Self::push_edge_to_last_node] afterwards belong to this new node
+    pub fn new_node(&mut self) {
+        let last_node_end = *self.start_ends.last().unwrap();
+        self.start_ends.push(last_node_end);
     }
-    pub fn iter_flattened(&self) -> std::slice::Iter<'_, T> {
-        self.buf.iter()
+    pub fn push_edge_to_last_node(&mut self, edge: FanInOut) {
+        let last_node_end = self.start_ends.last_mut().unwrap();
+        assert!(*last_node_end as usize == self.others.len());
+        self.others.push(to_u32(edge.other));
+        self.delta_latencies.push(edge.delta_latency);
+        *last_node_end = to_u32(self.others.len());
     }
-    pub fn iter_flattened_mut(&mut self) -> std::slice::IterMut<'_, T> {
-        self.buf.iter_mut()
-    }
-    pub fn iter_flattened_by_bucket(&self) -> ListOfListsFlatOriginIter<'_, T> {
-        ListOfListsFlatOriginIter {
-            buf_iter: self.buf.iter().enumerate(),
-            ends: &self.start_ends[1..],
-            cur_slice_idx: 0,
-        }
-    }
-    pub fn iter_flattened_by_bucket_mut(&mut self) -> ListOfListsFlatOriginIterMut<'_, T> {
-        ListOfListsFlatOriginIterMut {
-            buf_iter: self.buf.iter_mut().enumerate(),
-            ends: &self.start_ends[1..],
-            cur_slice_idx: 0,
-        }
-    }
-    pub fn iter(&self) -> ListOfListsIter<'_, T> {
-        self.into_iter()
-    }
-    pub fn iter_mut(&mut self) -> ListOfListsIterMut<'_, T> {
-        self.into_iter()
-    }
-
-    /*
-        Takes an iterator that produces a stream of locations and the item to store there.
-        Runs through the entire iterator twice.
-        Once to collect the size for each target group, and once to place all the results
 
-        MUST pass a cloneable iterator that iterates through all elements you wish to add.
-        A clone of the iterator may not behave differently
-    */
-    pub fn from_random_access_iterator<IterT: Iterator<Item = (usize, T)> + Clone>(
-        num_groups: usize,
+    /// Takes an iterator that produces a stream of nodes and an edge to add to that node.
+    /// Runs through the entire iterator twice.
+    /// Once to count the edges of each node, and once to place them
+    ///
+    /// MUST pass a cloneable iterator, of which a clone doesn't behave differently
+    pub fn from_random_access_iterator<IterT: Iterator<Item = (usize, FanInOut)> + Clone>(
+        num_nodes: usize,
         iter: IterT,
     ) -> Self {
-        // We'll be reusing this vector for the resulting start_ends vector, so already have it at the right size
-        // First we use the memory to collect group sizes
-        let mut start_ends: Vec<usize> = vec![0; num_groups + 1];
-
-        for (to_idx, _) in iter.clone() {
-            start_ends[to_idx + 1] += 1;
+        // First we use start_ends to count the number of edges of each node
+        let mut start_ends: Vec<u32> = vec![0; num_nodes + 1];
+        for (node, _) in iter.clone() {
+            start_ends[node + 1] += 1;
         }
 
-        /*
-            Transforms the group sizes vector into storing basically the starts of each group in that group's end.
-            Once we finish adding the elements of each group, this vector will be a valid start_ends vector.
-            So starting with for example group sizes [0, 2, 3, 1], this converts the vector to [0, 0, 2, 5] with cumulative_sum = 6.
-            Finally adding all elements, this brings our vector to [0, 2, 5, 6], which is the correct start_end vector for this
-        */
-        let mut cumulative_sum = 0;
+        // Then turn it into the start of each node, stored at that node's end.
+        // Placing the edges brings the ends to where they should be
+        let mut cumulative_sum: u32 = 0;
         for s in &mut start_ends {
-            let found_value = *s;
+            let num_edges = *s;
             *s = cumulative_sum;
-            cumulative_sum += found_value;
+            cumulative_sum = cumulative_sum
+                .checked_add(num_edges)
+                .expect("Graphs are limited to u32::MAX edges");
         }
 
-        let mut partially_initialize_buf: Vec<MaybeUninit<T>> =
-            (0..cumulative_sum).map(|_| MaybeUninit::uninit()).collect();
+        let mut others = vec![0; cumulative_sum as usize];
+        let mut delta_latencies = vec![0; cumulative_sum as usize];
+        for (node, edge) in iter {
+            let found_idx = &mut start_ends[node + 1];
+            others[*found_idx as usize] = to_u32(edge.other);
+            delta_latencies[*found_idx as usize] = edge.delta_latency;
+            *found_idx += 1;
+        }
 
-        for (to_idx, data) in iter {
-            let found_idx = &mut start_ends[to_idx + 1];
+        Self {
+            start_ends,
+            others,
+            delta_latencies,
+        }
+    }
 
-            partially_initialize_buf[*found_idx].write(data);
-            *found_idx += 1;
+    /// The number of nodes
+    pub fn len(&self) -> usize {
+        self.start_ends.len() - 1
+    }
+    pub fn num_edges(&self) -> usize {
+        self.others.len()
+    }
+
+    #[track_caller]
+    pub fn edges(&self, node: usize) -> CsrEdges<'_> {
+        assert!(node < self.len());
+        let range = self.start_ends[node] as usize..self.start_ends[node + 1] as usize;
+        CsrEdges {
+            others: self.others[range.clone()].iter(),
+            delta_latencies: self.delta_latencies[range].iter(),
         }
+    }
 
-        /*
-            SAFETY:
-            Unless the user passes a ridiculous Iterator, where it's Clone-d version behaves differently,
-            both passes should yield the exact same sequence of elements. In that case, we've properly
-            reserved space in the buf vector for all of the elements, and thus every element got written to once.
-            Vec<MaybeUninit<T>> is also compatible to transmute to Vec<T>
-            (Caveat, nothing on DuckDuckGo I could find said anything about this)
-        */
-        let buf =
-            unsafe { std::mem::transmute::<Vec<MaybeUninit<T>>, Vec<T>>(partially_initialize_buf) };
+    /// Iterates over all edges, together with the node they belong to
+    pub fn iter_edges_by_node(&self) -> impl Iterator<Item = (usize, FanInOut)> + Clone + '_ {
+        (0..self.len()).flat_map(|node| self.edges(node).map(move |edge| (node, edge)))
+    }
 
-        Self { buf, start_ends }
+    /// Flips the direction of all edges, and negates their [FanInOut::delta_latency]. Turns fanins into fanouts and vice versa
+    pub fn reversed(&self) -> Self {
+        Self::from_random_access_iterator(
+            self.len(),
+            self.iter_edges_by_node().map(|(node, edge)| {
+                (
+                    edge.other,
+                    FanInOut {
+                        other: node,
+                        delta_latency: -edge.delta_latency,
+                    },
+                )
+            }),
+        )
     }
 }
 
-impl<T, ProducedIterators: IntoIterator<Item = T>> FromIterator<ProducedIterators>
-    for ListOfLists<T>
+impl<ProducedIterators: IntoIterator<Item = FanInOut>> FromIterator<ProducedIterators>
+    for CsrAdjacency
 {
     fn from_iter<IterT: IntoIterator<Item = ProducedIterators>>(iter: IterT) -> Self {
         let iter = iter.into_iter();
         let (lower, upper) = iter.size_hint();
-        let estimated_size = upper.unwrap_or(lower);
-        let mut result = ListOfLists::new_with_groups_capacity(estimated_size);
-        for v in iter {
-            result.new_group();
-            for vv in v.into_iter() {
-                result.push_to_last_group(vv)
+        let mut result = CsrAdjacency::new_with_nodes_capacity(upper.unwrap_or(lower));
+        for node_edges in iter {
+            result.new_node();
+            for edge in node_edges {
+                result.push_edge_to_last_node(edge)
             }
         }
         result
     }
 }
 
-impl<T: Clone> ListOfLists<T> {
-    pub fn from_slice_slice(slice_slice: &[&[T]]) -> Self {
-        slice_slice
-            .iter()
-            .map(|sub_slice| sub_slice.iter().cloned())
-            .collect()
-    }
-}
-
-impl<T> Index<usize> for ListOfLists<T> {
-    type Output = [T];
-
-    fn index(&self, index: usize) -> &[T] {
-        assert!(index < self.len());
-        &self.buf[self.start_ends[index]..self.start_ends[index + 1]]
-    }
-}
-
-impl<T> IndexMut<usize> for ListOfLists<T> {
-    fn index_mut(&mut self, index: usize) -> &mut [T] {
-        assert!(index < self.len());
-        &mut self.buf[self.start_ends[index]..self.start_ends[index + 1]]
-    }
-}
-
+/// The edges of a single node in a [CsrAdjacency]
 #[derive(Debug, Clone)]
-pub struct ListOfListsFlatOriginIter<'a, T> {
-    buf_iter: std::iter::Enumerate<std::slice::Iter<'a, T>>,
-    ends: &'a [usize],
-    cur_slice_idx: usize,
+pub struct CsrEdges<'g> {
+    others: std::slice::Iter<'g, u32>,
+    delta_latencies: std::slice::Iter<'g, i64>,
 }
 
-impl<'a, T> Iterator for ListOfListsFlatOriginIter<'a, T> {
-    type Item = (usize, &'a T);
-
-    fn next(&mut self) -> Option<(usize, &'a T)> {
-        let (idx, item) = self.buf_iter.next()?;
+impl Iterator for CsrEdges<'_> {
+    type Item = FanInOut;
 
-        // Skip through blocks of 0 size
-        while idx == self.ends[self.cur_slice_idx] {
-            self.cur_slice_idx += 1;
-        }
-        Some((self.cur_slice_idx, item))
+    fn next(&mut self) -> Option<FanInOut> {
+        let other = *self.others.next()?;
+        let delta_latency = *self.delta_latencies.next().unwrap();
+        Some(FanInOut {
+            other: other as usize,
+            delta_latency,
+        })
     }
-}
-
-#[derive(Debug)]
-pub struct ListOfListsFlatOriginIterMut<'a, T> {
-    buf_iter: std::iter::Enumerate<std::slice::IterMut<'a, T>>,
-    ends: &'a [usize],
-    cur_slice_idx: usize,
-}
-
-impl<'a, T> Iterator for ListOfListsFlatOriginIterMut<'a, T> {
-    type Item = (usize, &'a mut T);
-
-    fn next(&mut self) -> Option<(usize, &'a mut T)> {
-        let (idx, item) = self.buf_iter.next()?;
-
-        // Skip through blocks of 0 size
-        while idx == self.ends[self.cur_slice_idx] {
-            self.cur_slice_idx += 1;
-        }
-        Some((self.cur_slice_idx, item))
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.others.size_hint()
     }
 }
-
-// Basic iterators
-
-#[derive(Debug, Clone)]
-pub struct ListOfListsIter<'a, T> {
-    buf: &'a [T],
-    start: usize,
-    ends_iter: std::slice::Iter<'a, usize>,
-}
-
-impl<'a, T> Iterator for ListOfListsIter<'a, T> {
-    type Item = &'a [T];
-
-    fn next(&mut self) -> Option<Self::Item> {
-        let next_end = *self.ends_iter.next()?;
-        let result = &self.buf[self.start..next_end];
-        self.start = next_end;
-        Some(result)
+impl ExactSizeIterator for CsrEdges<'_> {
+    fn len(&self) -> usize {
+        self.others.len()
     }
 }
 
-#[derive(Debug)]
-pub struct ListOfListsIterMut<'a, T> {
-    buf: &'a mut [T],
-    start: usize,
-    ends_iter: std::slice::Iter<'a, usize>,
+/// A directed graph with both the fanins and fanouts of each node, such that it can be explored in both directions.
+///
+/// Built once from the fanins, see [CsrGraph::from_fanins]
+#[derive(Debug, Clone, Default)]
+pub struct CsrGraph {
+    pub fanins: CsrAdjacency,
+    pub fanouts: CsrAdjacency,
 }
 
-impl<'a, T> Iterator for ListOfListsIterMut<'a, T> {
-    type Item = &'a mut [T];
+impl CsrGraph {
+    /// The fanouts are the [CsrAdjacency::reversed] fanins
+    pub fn from_fanins(fanins: CsrAdjacency) -> Self {
+        let fanouts = fanins.reversed();
+        Self { fanins, fanouts }
+    }
 
-    fn next(&mut self) -> Option<Self::Item> {
-        let next_end = *self.ends_iter.next()?;
-        let result: *mut [T] = &mut self.buf[self.start..next_end];
-        self.start = next_end;
-        // SAFETY: Slices produced by this iterator don't overlap.
-        // Therefore we're allowed to cast away the self lifetime that attached itself to our mutable borrow
-        Some(unsafe { &mut *result })
+    /// The number of nodes
+    pub fn len(&self) -> usize {
+        self.fanins.len()
     }
 }
 
-impl<'a, T> IntoIterator for &'a ListOfLists<T> {
-    type Item = &'a [T];
+#[cfg(test)]
+mod tests {
+    use super::*;
 
-    type IntoIter = ListOfListsIter<'a, T>;
-
-    fn into_iter(self) -> Self::IntoIter {
-        ListOfListsIter {
-            buf: &self.buf,
-            start: 0,
-            ends_iter: self.start_ends[1..].iter(),
+    fn mk_fan(other: usize, delta_latency: i64) -> FanInOut {
+        FanInOut {
+            other,
+            delta_latency,
         }
     }
-}
 
-impl<'a, T> IntoIterator for &'a mut ListOfLists<T> {
-    type Item = &'a mut [T];
-
-    type IntoIter = ListOfListsIterMut<'a, T>;
+    #[test]
+    fn reversed_negates_and_flips() {
+        let fanins: CsrAdjacency = [
+            vec![],
+            vec![mk_fan(0, 1)],
+            vec![mk_fan(0, 2), mk_fan(1, -3)],
+        ]
+        .into_iter()
+        .collect();
+        let graph = CsrGraph::from_fanins(fanins);
+
+        assert_eq!(graph.len(), 3);
+        assert_eq!(graph.fanins.num_edges(), 3);
+        assert_eq!(graph.fanouts.num_edges(), 3);
+        assert_eq!(
+            graph.fanouts.edges(0).collect::<Vec<_>>(),
+            [mk_fan(1, -1), mk_fan(2, -2)]
+        );
+        assert_eq!(graph.fanouts.edges(1).collect::<Vec<_>>(), [mk_fan(2, 3)]);
+        assert_eq!(graph.fanouts.edges(2).len(), 0);
+    }
 
-    fn into_iter(self) -> Self::IntoIter {
-        ListOfListsIterMut {
-            buf: &mut self.buf,
-            start: 0,
-            ends_iter: self.start_ends[1..].iter(),
-        }
+    #[test]
+    fn latencies_beyond_i32_are_kept() {
+        let fanins: CsrAdjacency = [vec![], vec![mk_fan(0, 3_000_000_000)]]
+            .into_iter()
+            .collect();
+        let graph = CsrGraph::from_fanins(fanins);
+
+        assert_eq!(
+            graph.fanins.edges(1).collect::<Vec<_>>(),
+            [mk_fan(0, 3_000_000_000)]
+        );
+        assert_eq!(
+            graph.fanouts.edges(0).collect::<Vec<_>>(),
+            [mk_fan(1, -3_000_000_000)]
+        );
     }
 }
@@ -1,8 +1,9 @@
 mod concrete_typecheck;
+mod disk_cache;
 mod execute;
 mod latency_algorithm;
 mod latency_count;
-mod list_of_lists;
+pub mod list_of_lists;
 mod unique_names;
 
 use unique_names::UniqueNames;
@@ -11,18 +12,21 @@ use crate::prelude::*;
 use crate::typing::template::TVec;
 use crate::typing::type_inference::{ConcreteTypeVariableIDMarker, TypeSubstitutor};
 
-use std::cell::OnceCell;
-use std::{cell::RefCell, collections::HashMap, rc::Rc};
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex, OnceLock};
 
 use crate::flattening::{BinaryOperator, Module, UnaryOperator};
 use crate::{
     config,
     errors::{CompileError, ErrorStore},
+    stats,
+    symbol::Symbol,
     to_string::pretty_print_concrete_instance,
     value::Value,
 };
 
-use crate::typing::concrete_type::ConcreteType;
+use crate::typing::concrete_type::{ConcreteType, InstanceType, InternedConcreteType};
 
 use self::latency_algorithm::SpecifiedLatency;
 
@@ -99,8 +103,8 @@ pub struct RealWire {
     pub source: RealWireDataSource,
     /// If it's a port of a module, then this must be the submodule
     pub original_instruction: FlatID,
-    pub typ: ConcreteType,
-    pub name: String,
+    pub typ: InstanceType,
+    pub name: Symbol,
     pub domain: DomainID,
     /// non i64::MIN values specify specified latency
     pub specified_latency: i64,
@@ -127,12 +131,12 @@ pub struct SubModulePort {
 #[derive(Debug)]
 pub struct SubModule {
     pub original_instruction: FlatID,
-    pub instance: OnceCell<Rc<InstantiatedModule>>,
+    pub instance: OnceLock<Arc<InstantiatedModule>>,
     pub port_map: FlatAlloc<Option<SubModulePort>, PortIDMarker>,
     pub interface_call_sites: FlatAlloc<Vec<Span>, InterfaceIDMarker>,
-    pub name: String,
+    pub name: Symbol,
     pub module_uuid: ModuleUUID,
-    pub template_args: TVec<ConcreteType>,
+    pub template_args: TVec<InstanceType>,
 }
 
 /// Generated from [Module::ports]
@@ -141,7 +145,7 @@ pub struct InstantiatedPort {
     pub wire: WireID,
     pub is_input: bool,
     pub absolute_latency: i64,
-    pub typ: ConcreteType,
+    pub typ: InternedConcreteType,
     pub domain: DomainID,
 }
 
@@ -163,7 +167,97 @@ pub struct InstantiatedModule {
     pub wires: FlatAlloc<RealWire, WireIDMarker>,
     pub submodules: FlatAlloc<SubModule, SubModuleIDMarker>,
     /// See [GenerationState]
+    ///
+    /// Empty after [InstantiatedModule::compact]
     pub generation_state: FlatAlloc<SubModuleOrWire, FlatIDMarker>,
+    /// The key of this instance in the [disk_cache], when `--cache-dir` is used.
+    /// Code generation reuses it to find the output of a previous run, see [crate::codegen::CodeGenBackend::codegen_instance]
+    pub cache_key: Option<u64>,
+}
+
+impl InstantiatedModule {
+    /// Estimated number of bytes this instance owns on the heap, for `--time-passes`. Names and final types are interned, so they aren't counted
+    pub fn heap_size(&self) -> usize {
+        let wires_size: usize = self
+            .wires
+            .iter()
+            .map(|(_, w)| {
+                let source_size = match &w.source {
+                    RealWireDataSource::Multiplexer { is_state, sources } => {
+                        is_state.as_ref().map_or(0, Value::heap_size)
+                            + sources.capacity() * std::mem::size_of::<MultiplexerSource>()
+                            + sources
+                                .iter()
+                                .map(|s| {
+                                    s.to_path.capacity() * std::mem::size_of::<RealWirePathElem>()
+                                        + std::mem::size_of_val(&*s.condition)
+                                })
+                                .sum::<usize>()
+                    }
+                    RealWireDataSource::Select { path, .. } => {
+                        path.capacity() * std::mem::size_of::<RealWirePathElem>()
+                    }
+                    RealWireDataSource::Constant { value } => value.heap_size(),
+                    RealWireDataSource::ReadOnly
+                    | RealWireDataSource::UnaryOp { .. }
+                    | RealWireDataSource::BinaryOp { .. } => 0,
+                };
+                source_size + w.typ.heap_size()
+            })
+            .sum();
+        let submodules_size: usize = self
+            .submodules
+            .iter()
+            .map(|(_, sm)| {
+                sm.port_map.capacity() * std::mem::size_of::<Option<SubModulePort>>()
+                    + sm.interface_call_sites.capacity() * std::mem::size_of::<Vec<Span>>()
+                    + sm.template_args.capacity() * std::mem::size_of::<InstanceType>()
+                    + sm.template_args
+                        .iter()
+                        .map(|(_, arg)| arg.heap_size())
+                        .sum::<usize>()
+            })
+            .sum();
+        let generation_state_size: usize = self
+            .generation_state
+            .iter()
+            .map(|(_, v)| match v {
+                SubModuleOrWire::CompileTimeValue(v) => v.heap_size(),
+                _ => 0,
+            })
+            .sum();
+
+        self.name.capacity()
+            + self.mangled_name.capacity()
+            + self.errors.heap_size()
+            + self.interface_ports.capacity() * std::mem::size_of::<Option<InstantiatedPort>>()
+            + self.wires.capacity() * std::mem::size_of::<RealWire>()
+            + wires_size
+            + self.submodules.capacity() * std::mem::size_of::<SubModule>()
+            + submodules_size
+            + self.generation_state.capacity() * std::mem::size_of::<SubModuleOrWire>()
+            + generation_state_size
+    }
+
+    /// Drops the state that is only needed while executing and latency counting. Done with `--compact-instances`.
+    ///
+    /// Code generation only needs the wires, submodules and ports. The [GenerationState] is only used for hover info in the LSP.
+    /// All lists are shrunk to fit. The errors must stay, they are reported after compilation
+    pub fn compact(&mut self) {
+        self.generation_state = FlatAlloc::new();
+        for (_, w) in &mut self.wires {
+            match &mut w.source {
+                RealWireDataSource::Multiplexer { sources, .. } => sources.shrink_to_fit(),
+                RealWireDataSource::Select { path, .. } => path.shrink_to_fit(),
+                _ => {}
+            }
+        }
+        self.wires.shrink_to_fit();
+        self.submodules.shrink_to_fit();
+        self.errors.shrink_to_fit();
+        self.name.shrink_to_fit();
+        self.mangled_name.shrink_to_fit();
+    }
 }
 
 /// See [GenerationState]
@@ -204,10 +298,19 @@ impl SubModuleOrWire {
 /// With this you can instantiate a module for different sets of template arguments.
 /// It caches the instantiations that have been made, such that they need not be repeated.
 ///
+/// The cache is shared between threads. Each set of template arguments gets its own slot,
+/// so the lock on the map is only held to find the slot, never during the instantiation itself.
+/// Threads that request an instance that is still being made wait for it, instead of repeating the work.
+///
+/// With `--cache-dir`, instances are also persisted between compiler runs, see [disk_cache].
+///
 /// Also, with incremental builds (#49) this will be a prime area for investigation
 #[derive(Debug)]
 pub struct InstantiationCache {
-    cache: RefCell<HashMap<TVec<ConcreteType>, Rc<InstantiatedModule>>>,
+    /// Keyed by the interned template arguments, such that lookups don't hash and compare whole type trees
+    cache: Mutex<HashMap<Box<[InternedConcreteType]>, Arc<OnceLock<Arc<InstantiatedModule>>>>>,
+    /// See [disk_cache]. Depends on the module and the globals it references, so it is reset along with the instances
+    design_hash: OnceLock<u64>,
 }
 
 impl Default for InstantiationCache {
@@ -219,25 +322,49 @@ impl Default for InstantiationCache {
 impl InstantiationCache {
     pub fn new() -> Self {
         Self {
-            cache: RefCell::new(HashMap::new()),
+            cache: Mutex::new(HashMap::new()),
+            design_hash: OnceLock::new(),
         }
     }
 
+    /// Once `cancel` is set, no new instantiations are started, and running ones stop at their next instruction.
+    /// The instances that were cut short are removed from the cache again, such that a later call redoes them
     pub fn instantiate(
         &self,
         md: &Module,
         linker: &Linker,
-        template_args: TVec<ConcreteType>,
-    ) -> Option<Rc<InstantiatedModule>> {
-        let cache_borrow = self.cache.borrow();
-
-        // Temporary, no template arguments yet
-        let instance = if let Some(found) = cache_borrow.get(&template_args) {
-            found.clone()
-        } else {
-            std::mem::drop(cache_borrow);
+        template_args: TVec<InternedConcreteType>,
+        cancel: &AtomicBool,
+    ) -> Option<Arc<InstantiatedModule>> {
+        if cancel.load(Ordering::Relaxed) {
+            return None;
+        }
+        let key: Box<[InternedConcreteType]> =
+            template_args.iter().map(|(_, arg)| arg.clone()).collect();
+        let slot = {
+            let mut cache_lock = self.cache.lock().unwrap();
+            cache_lock.entry(key.clone()).or_default().clone()
+        };
 
-            let result = perform_instantiation(md, linker, &template_args);
+        let instance = slot.get_or_init(|| {
+            let template_args: TVec<ConcreteType> =
+                template_args.map(|(_, arg)| ConcreteType::clone(arg));
+            let timer = stats::ItemTimer::start("instantiate");
+            let mut result = match &config().cache_dir {
+                Some(cache_dir) => {
+                    disk_cache::load_or_instantiate(cache_dir, md, linker, &template_args, cancel)
+                }
+                None => perform_instantiation(md, linker, &template_args, cancel),
+            };
+            if config().compact_instances {
+                result.compact();
+            }
+            stats::count(|c| {
+                c.wires += result.wires.len();
+                c.submodules += result.submodules.len();
+                c.heap_bytes += result.heap_size();
+            });
+            timer.finish(|| result.name.clone());
 
             if config().should_print_for_debug(config().debug_print_module_contents, &result.name) {
                 println!("[[Instantiated {}]]", result.name);
@@ -249,44 +376,57 @@ impl InstantiationCache {
                 }
             }
 
-            let result_ref = Rc::new(result);
-            assert!(self
-                .cache
-                .borrow_mut()
-                .insert(template_args, result_ref.clone())
-                .is_none());
-            result_ref
-        };
+            Arc::new(result)
+        });
 
         if !instance.errors.did_error {
             Some(instance.clone())
         } else {
+            // May have errored only because it was cancelled
+            if cancel.load(Ordering::Relaxed) {
+                let mut cache_lock = self.cache.lock().unwrap();
+                if cache_lock
+                    .get(&key)
+                    .is_some_and(|found| Arc::ptr_eq(found, &slot))
+                {
+                    cache_lock.remove(&key);
+                }
+            }
             None
         }
     }
 
     pub fn for_each_error(&self, func: &mut impl FnMut(&CompileError)) {
-        let cache_borrow = self.cache.borrow();
-        for inst in cache_borrow.values() {
+        let cache_lock = self.cache.lock().unwrap();
+        for inst in cache_lock.values().filter_map(|slot| slot.get()) {
             for err in &inst.errors {
                 func(err)
             }
         }
     }
 
+    /// Modules that were never reached from the top module (see `--top`) have no instances
+    pub fn has_instances(&self) -> bool {
+        let cache_lock = self.cache.lock().unwrap();
+        cache_lock.values().any(|slot| slot.get().is_some())
+    }
+
     pub fn clear_instances(&mut self) {
-        self.cache.borrow_mut().clear()
+        self.cache.get_mut().unwrap().clear();
+        self.design_hash = OnceLock::new();
     }
 
     // Also passes over invalid instances. Instance validity should not be assumed!
     // Only used for things like syntax highlighting
     pub fn for_each_instance(
         &self,
-        mut f: impl FnMut(&TVec<ConcreteType>, &Rc<InstantiatedModule>),
+        mut f: impl FnMut(&[InternedConcreteType], &Arc<InstantiatedModule>),
     ) {
-        let borrow = self.cache.borrow();
-        for (k, v) in borrow.iter() {
-            f(k, v)
+        let cache_lock = self.cache.lock().unwrap();
+        for (k, slot) in cache_lock.iter() {
+            if let Some(v) = slot.get() {
+                f(&k[..], v)
+            }
         }
     }
 }
@@ -327,7 +467,7 @@ struct InstantiationContext<'fl, 'l> {
     type_substitutor: TypeSubstitutor<ConcreteType, ConcreteTypeVariableIDMarker>,
 
     // Used for Execution
-    unique_name_producer: UniqueNames,
+    unique_name_producer: UniqueNames<'l>,
     condition_stack: Vec<ConditionStackElem>,
 
     interface_ports: FlatAlloc<Option<InstantiatedPort>, PortIDMarker>,
@@ -336,6 +476,8 @@ struct InstantiationContext<'fl, 'l> {
     template_args: &'fl TVec<ConcreteType>,
     md: &'fl Module,
     linker: &'l Linker,
+    /// See [InstantiationCache::instantiate]
+    cancel: &'l AtomicBool,
 }
 
 /// Mangle the module name for use in code generation
@@ -360,6 +502,7 @@ impl InstantiationContext<'_, '_> {
             interface_ports: self.interface_ports,
             generation_state: self.generation_state.generation_state,
             errors: self.errors.into_storage(),
+            cache_key: None,
         }
     }
 }
@@ -368,6 +511,7 @@ fn perform_instantiation(
     md: &Module,
     linker: &Linker,
     template_args: &TVec<ConcreteType>,
+    cancel: &AtomicBool,
 ) -> InstantiatedModule {
     let mut context = InstantiationContext {
         name: pretty_print_concrete_instance(&md.link_info, template_args, &linker.types),
@@ -384,10 +528,11 @@ fn perform_instantiation(
         submodules: FlatAlloc::new(),
         interface_ports: md.ports.map(|_| None),
         errors: ErrorCollector::new_empty(md.link_info.file, &linker.files),
-        unique_name_producer: UniqueNames::new(),
+        unique_name_producer: UniqueNames::new(&linker.names),
         template_args,
         md,
         linker,
+        cancel,
     };
 
     // Don't instantiate modules that already errored. Otherwise instantiator may crash
@@ -420,9 +565,10 @@ fn perform_instantiation(
 
     println!("Concrete Typechecking {}", md.link_info.name);
     context.typecheck();
+    stats::count(|c| c.type_variables += context.type_substitutor.id_range().len());
 
     println!("Latency Counting {}", md.link_info.name);
-    context.compute_latencies();
+    stats::time_phase("latency counting", || context.compute_latencies());
 
     context.extract()
 }
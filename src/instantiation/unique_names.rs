@@ -1,5 +1,8 @@
 use std::collections::HashMap;
 
+use crate::interner::Interner;
+use crate::symbol::Symbol;
+
 /// Generates ascending IDs for locals, while keeping the name information as much as possible.
 ///
 /// For example, when generating multiple names for the string "beep" it returns:
@@ -7,26 +10,26 @@ use std::collections::HashMap;
 /// - beep_2
 /// - beep_3
 /// - ...
-pub struct UniqueNames {
-    name_map: HashMap<String, i64>,
+pub struct UniqueNames<'l> {
+    names: &'l Interner<str>,
+    name_map: HashMap<Symbol, i64>,
 }
 
-impl UniqueNames {
-    pub fn new() -> Self {
-        let mut name_map: HashMap<String, i64> = HashMap::new();
-        name_map.insert(String::new(), 1);
-        Self { name_map }
+impl<'l> UniqueNames<'l> {
+    pub fn new(names: &'l Interner<str>) -> Self {
+        let mut name_map: HashMap<Symbol, i64> = HashMap::new();
+        name_map.insert(Symbol::intern(names, ""), 1);
+        Self { names, name_map }
     }
-    pub fn get_unique_name<S: Into<String> + AsRef<str>>(&mut self, name: S) -> String {
-        let name_ref = name.as_ref();
-        if let Some(found_id) = self.name_map.get_mut(name_ref) {
-            let result = format!("{name_ref}_{found_id}");
+    pub fn get_unique_name(&mut self, name: &str) -> Symbol {
+        let name = Symbol::intern(self.names, name);
+        if let Some(found_id) = self.name_map.get_mut(&name) {
+            let result = Symbol::intern(self.names, &format!("{name}_{found_id}"));
             *found_id += 1;
             result
         } else {
-            let result: String = name.into();
-            self.name_map.insert(result.clone(), 2);
-            result
+            self.name_map.insert(name.clone(), 2);
+            name
         }
     }
 }
@@ -0,0 +1,145 @@
+//! Hash-consing for values that instantiation creates and compares very often, like concrete types.
+//!
+//! An [Interner] belongs to the [crate::linker::Linker], rather than to the whole program.
+//! [Interned] handles are reference counted, so [Interner::remove_unused] can drop the values that only the interner still holds.
+//! The linker does this whenever instances were thrown away, such that editing in the LSP or with `--watch`
+//! doesn't keep every type that was ever written.
+//!
+//! Values are spread over [NUM_SHARDS] shards by their hash, each behind its own [RwLock].
+//! Once a design is loaded most values already exist, and finding them only takes the read lock of one shard.
+//! The hash of a value is computed once, and is also used as its key within the shard.
+
+use std::collections::hash_map::RandomState;
+use std::collections::HashMap;
+use std::fmt;
+use std::hash::{BuildHasher, Hash, Hasher};
+use std::ops::Deref;
+use std::sync::{Arc, RwLock};
+
+const NUM_SHARDS: usize = 16;
+
+/// A value of an [Interner]. Equal values get the same handle, so comparing and hashing only look at the pointer
+pub struct Interned<T: ?Sized>(Arc<T>);
+
+impl<T: ?Sized> Clone for Interned<T> {
+    fn clone(&self) -> Self {
+        Self(self.0.clone())
+    }
+}
+impl<T: ?Sized> PartialEq for Interned<T> {
+    fn eq(&self, other: &Self) -> bool {
+        Arc::ptr_eq(&self.0, &other.0)
+    }
+}
+impl<T: ?Sized> Eq for Interned<T> {}
+impl<T: ?Sized> Hash for Interned<T> {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        Arc::as_ptr(&self.0).cast::<()>().hash(state)
+    }
+}
+impl<T: ?Sized> Deref for Interned<T> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        &self.0
+    }
+}
+impl<T: ?Sized + fmt::Debug> fmt::Debug for Interned<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        self.0.fmt(f)
+    }
+}
+impl<T: ?Sized + fmt::Display> fmt::Display for Interned<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        self.0.fmt(f)
+    }
+}
+
+type Shard<T> = RwLock<HashMap<u64, Vec<Arc<T>>>>;
+
+pub struct Interner<T: ?Sized> {
+    hash_builder: RandomState,
+    shards: [Shard<T>; NUM_SHARDS],
+}
+
+impl<T: ?Sized> Default for Interner<T> {
+    fn default() -> Self {
+        Self {
+            hash_builder: RandomState::new(),
+            shards: std::array::from_fn(|_| RwLock::default()),
+        }
+    }
+}
+
+impl<T: ?Sized> fmt::Debug for Interner<T> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("Interner").finish_non_exhaustive()
+    }
+}
+
+fn find_in_shard<T: ?Sized + Eq>(
+    shard: &HashMap<u64, Vec<Arc<T>>>,
+    hash: u64,
+    value: &T,
+) -> Option<Interned<T>> {
+    let found = shard.get(&hash)?.iter().find(|v| ***v == *value)?;
+    Some(Interned(found.clone()))
+}
+
+impl<T: ?Sized + Hash + Eq> Interner<T> {
+    /// `to_shared` makes the shared copy of `value`, only called if it wasn't interned yet
+    pub fn intern(&self, value: &T, to_shared: impl FnOnce(&T) -> Arc<T>) -> Interned<T> {
+        let hash = self.hash_builder.hash_one(value);
+        let shard = &self.shards[hash as usize % NUM_SHARDS];
+        if let Some(found) = find_in_shard(&shard.read().unwrap(), hash, value) {
+            return found;
+        }
+        let mut shard = shard.write().unwrap();
+        // Another thread may have interned it in between
+        if let Some(found) = find_in_shard(&shard, hash, value) {
+            return found;
+        }
+        let new_value = to_shared(value);
+        shard.entry(hash).or_default().push(new_value.clone());
+        Interned(new_value)
+    }
+
+    /// Drops the values that have no [Interned] handles left
+    pub fn remove_unused(&mut self) {
+        for shard in &mut self.shards {
+            shard.get_mut().unwrap().retain(|_hash, values| {
+                values.retain(|v| Arc::strong_count(v) > 1);
+                !values.is_empty()
+            });
+        }
+    }
+
+    /// The number of distinct values currently interned
+    pub fn len(&self) -> usize {
+        self.shards
+            .iter()
+            .map(|shard| shard.read().unwrap().values().map(Vec::len).sum::<usize>())
+            .sum()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn unused_values_are_removed() {
+        let mut interner: Interner<str> = Interner::default();
+        let a = interner.intern("a", |s| Arc::from(s));
+        assert_eq!(a, interner.intern(&String::from("a"), |s| Arc::from(s)));
+        assert_ne!(a, interner.intern("b", |s| Arc::from(s)));
+        assert_eq!(interner.len(), 2);
+
+        interner.remove_unused();
+        assert_eq!(interner.len(), 1, "Only 'a' still has a handle");
+        assert_eq!(a, interner.intern("a", |s| Arc::from(s)));
+        drop(a);
+        interner.remove_unused();
+        assert_eq!(interner.len(), 0);
+    }
+}
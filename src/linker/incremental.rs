@@ -0,0 +1,139 @@
+//! Dependency tracking for incremental compilation (#49)
+//!
+//! Every global records the globals it looked at in [ResolvedGlobals]. When a file changes, we use
+//! these references (in reverse) to find which globals may now compile differently.
+//! Only those are reset to [AFTER_INITIAL_PARSE_CP], all other globals keep their flattened,
+//! typechecked and linted state, as well as their cached instantiations.
+
+use std::collections::HashSet;
+
+use super::*;
+
+/// Everything that was removed or (re)declared in the [Linker] since the last compilation.
+///
+/// Filled by [Linker::remove_everything_in_file] and [Linker::with_file_builder].
+#[derive(Debug, Default)]
+pub struct ChangeSet {
+    /// Globals that no longer exist. Note that their UUIDs may already have been reused by new globals
+    removed_globals: HashSet<GlobalUUID>,
+    /// Names of globals that were removed or added. References to other globals by this name may now resolve differently
+    touched_names: HashSet<String>,
+}
+
+impl ChangeSet {
+    pub fn record_removed(&mut self, global: GlobalUUID, name: String) {
+        self.removed_globals.insert(global);
+        self.touched_names.insert(name);
+    }
+    pub fn record_added(&mut self, name: String) {
+        self.touched_names.insert(name);
+    }
+    pub fn clear(&mut self) {
+        self.removed_globals.clear();
+        self.touched_names.clear();
+    }
+}
+
+impl Linker {
+    fn all_global_uuids(&self) -> Vec<GlobalUUID> {
+        let mut result = Vec::new();
+        result.extend(self.modules.iter().map(|(id, _)| GlobalUUID::Module(id)));
+        result.extend(self.types.iter().map(|(id, _)| GlobalUUID::Type(id)));
+        result.extend(
+            self.constants
+                .iter()
+                .map(|(id, _)| GlobalUUID::Constant(id)),
+        );
+        result
+    }
+
+    /// Does this global have to be flattened again, solely because of the recorded [ChangeSet]?
+    fn is_directly_invalidated(&self, link_info: &LinkInfo, changes: &ChangeSet) -> bool {
+        // Fresh globals, they'll go through all stages anyway
+        if link_info.checkpoints.len() <= AFTER_FLATTEN_CP {
+            return true;
+        }
+        // Unresolved names may resolve now
+        if !link_info.resolved_globals.all_resolved() && !changes.touched_names.is_empty() {
+            return true;
+        }
+        link_info
+            .resolved_globals
+            .referenced_globals()
+            .iter()
+            .any(|referenced| {
+                // Check removed_globals first, removed globals can't be indexed anymore
+                changes.removed_globals.contains(referenced)
+                    || changes
+                        .touched_names
+                        .contains(&self.get_link_info(*referenced).name)
+            })
+    }
+
+    /// Uses the [ChangeSet] gathered since the last compilation to reset all globals that could be affected by it.
+    ///
+    /// Typechecking writes its results into [LinkInfo::instructions], so a global that must be re-typechecked
+    /// is also re-flattened. Globals that aren't affected keep their [LinkInfo::checkpoints] and instantiations,
+    /// such that the compilation stages skip them.
+    ///
+    /// Returns the globals that were reset
+    pub fn invalidate_changed_globals(&mut self) -> HashSet<GlobalUUID> {
+        let changes = std::mem::take(&mut self.changes);
+        let all_globals = self.all_global_uuids();
+
+        let mut invalidated: HashSet<GlobalUUID> = all_globals
+            .iter()
+            .copied()
+            .filter(|id| self.is_directly_invalidated(self.get_link_info(*id), &changes))
+            .collect();
+
+        // Propagate to everything that (transitively) depends on the invalidated globals.
+        // Instances contain the instances of their submodules, so these must be redone as well.
+        let mut dependents_to_check: Vec<GlobalUUID> = all_globals
+            .iter()
+            .copied()
+            .filter(|id| !invalidated.contains(id))
+            .collect();
+        loop {
+            let num_before = dependents_to_check.len();
+            dependents_to_check.retain(|id| {
+                let depends_on_invalidated = self
+                    .get_link_info(*id)
+                    .resolved_globals
+                    .referenced_globals()
+                    .iter()
+                    .any(|referenced| invalidated.contains(referenced));
+                if depends_on_invalidated {
+                    invalidated.insert(*id);
+                }
+                !depends_on_invalidated
+            });
+            if dependents_to_check.len() == num_before {
+                break;
+            }
+        }
+
+        for global in &invalidated {
+            match *global {
+                GlobalUUID::Module(md_id) => {
+                    let md = &mut self.modules[md_id];
+                    md.link_info.reset_to(AFTER_INITIAL_PARSE_CP);
+                    md.link_info.instructions.clear();
+                    md.instantiations.clear_instances();
+                }
+                GlobalUUID::Type(typ_id) => {
+                    self.types[typ_id]
+                        .link_info
+                        .reset_to(AFTER_INITIAL_PARSE_CP);
+                }
+                GlobalUUID::Constant(cst_id) => {
+                    self.constants[cst_id]
+                        .link_info
+                        .reset_to(AFTER_INITIAL_PARSE_CP);
+                }
+            }
+        }
+
+        invalidated
+    }
+}
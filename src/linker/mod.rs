@@ -7,8 +7,10 @@ use crate::{
 };
 
 pub mod checkpoint;
+mod incremental;
 mod resolver;
 use arrayvec::ArrayVec;
+pub use incremental::ChangeSet;
 pub use resolver::*;
 
 use std::{
@@ -23,6 +25,8 @@ use crate::{alloc::ArenaAllocator, file_position::FileText, flattening::Module};
 use crate::errors::{CompileError, ErrorInfo, ErrorLevel, ErrorStore};
 
 use crate::flattening::{StructType, TypingAllocator};
+use crate::interner::Interner;
+use crate::typing::concrete_type::ConcreteType;
 
 use self::checkpoint::CheckPoint;
 
@@ -99,11 +103,12 @@ pub struct LinkInfo {
     /// Created in Stage 2: Flattening. type data is filled out during Typechecking
     pub instructions: FlatAlloc<Instruction, FlatIDMarker>,
 
-    /// Reset checkpoints. These are to reset errors and resolved_globals for incremental compilation.
+    /// Reset checkpoints. These are to reset errors and resolved_globals for incremental compilation (#49).
     ///
-    /// TODO the system is there, just need to actually do incremental compilation (#49)
+    /// The number of checkpoints also tells which stages this global has already gone through.
+    /// Compilation stages skip globals that are already past them, see [Linker::invalidate_changed_globals]
     ///
-    /// Right now it already functions as a sanity check, to make sure no steps in building modules/types are skipped
+    /// It also functions as a sanity check, to make sure no steps in building modules/types are skipped
     pub checkpoints: ArrayVec<CheckPoint, 4>,
 }
 
@@ -212,6 +217,12 @@ pub struct Linker {
     pub constants: ArenaAllocator<NamedConstant, ConstantUUIDMarker>,
     pub files: ArenaAllocator<FileData, FileUUIDMarker>,
     global_namespace: HashMap<String, NamespaceElement>,
+    /// Globals that were added or removed since the last compilation. See [Linker::invalidate_changed_globals]
+    changes: ChangeSet,
+    /// The types of instance ports and instantiation template arguments. Unused types are dropped when instances are thrown away
+    pub interned_types: Interner<ConcreteType>,
+    /// The names of the wires and submodules of instances, see [crate::symbol::Symbol]
+    pub names: Interner<str>,
 }
 
 impl Default for Linker {
@@ -228,6 +239,9 @@ impl Linker {
             constants: ArenaAllocator::new(),
             files: ArenaAllocator::new(),
             global_namespace: HashMap::new(),
+            changes: ChangeSet::default(),
+            interned_types: Interner::default(),
+            names: Interner::default(),
         }
     }
 
@@ -324,26 +338,35 @@ impl Linker {
         self.for_all_errors_after_compile(file_uuid, &mut f);
     }
 
+    /// Reset the record of changes. Used when everything gets recompiled anyway
+    pub fn clear_changes(&mut self) {
+        self.changes.clear();
+    }
+
     pub fn remove_everything_in_file(&mut self, file_uuid: FileUUID) -> &mut FileData {
+        self.remove_globals_in_file_after(file_uuid, 0)
+    }
+
+    /// Removes all globals in this file, except for the first `num_to_keep` (in source file order)
+    pub fn remove_globals_in_file_after(
+        &mut self,
+        file_uuid: FileUUID,
+        num_to_keep: usize,
+    ) -> &mut FileData {
         // For quick lookup if a reference disappears
         let mut to_remove_set = HashSet::new();
 
         let file_data = &mut self.files[file_uuid];
         // Remove referenced data in file
-        for v in file_data.associated_values.drain(..) {
+        for v in file_data.associated_values.drain(num_to_keep..) {
             let was_new_item_in_set = to_remove_set.insert(v);
             assert!(was_new_item_in_set);
-            match v {
-                GlobalUUID::Module(id) => {
-                    self.modules.free(id);
-                }
-                GlobalUUID::Type(id) => {
-                    self.types.free(id);
-                }
-                GlobalUUID::Constant(id) => {
-                    self.constants.free(id);
-                }
-            }
+            let removed_name = match v {
+                GlobalUUID::Module(id) => self.modules.free(id).link_info.name,
+                GlobalUUID::Type(id) => self.types.free(id).link_info.name,
+                GlobalUUID::Constant(id) => self.constants.free(id).link_info.name,
+            };
+            self.changes.record_removed(v, removed_name);
         }
 
         // Remove from global namespace
@@ -361,14 +384,15 @@ impl Linker {
         file_data
     }
 
-    #[allow(dead_code)]
     pub fn remove_file(&mut self, file_uuid: FileUUID) {
         self.remove_everything_in_file(file_uuid);
         self.files.free(file_uuid);
     }
 
+    /// Globals already in [FileData::associated_values] are kept, the builder only adds the ones after them.
     pub fn with_file_builder(&mut self, file_id: FileUUID, f: impl FnOnce(FileBuilder<'_>)) {
-        let mut associated_values = Vec::new();
+        let mut associated_values = std::mem::take(&mut self.files[file_id].associated_values);
+        let num_kept_globals = associated_values.len();
         let mut parsing_errors =
             std::mem::replace(&mut self.files[file_id].parsing_errors, ErrorStore::new());
         let file_data = &self.files[file_id];
@@ -381,6 +405,7 @@ impl Linker {
             file_data,
             files: &self.files,
             other_parsing_errors: &other_parsing_errors,
+            num_kept_globals,
             associated_values: &mut associated_values,
             global_namespace: &mut self.global_namespace,
             types: &mut self.types,
@@ -388,6 +413,11 @@ impl Linker {
             constants: &mut self.constants,
         });
 
+        for new_global in &associated_values[num_kept_globals..] {
+            let name = self.get_link_info(*new_global).name.clone();
+            self.changes.record_added(name);
+        }
+
         let parsing_errors = other_parsing_errors.into_storage();
         let file_data = &mut self.files[file_id];
         file_data.parsing_errors = parsing_errors;
@@ -402,6 +432,7 @@ pub struct FileBuilder<'linker> {
     pub file_data: &'linker FileData,
     pub files: &'linker ArenaAllocator<FileData, FileUUIDMarker>,
     pub other_parsing_errors: &'linker ErrorCollector<'linker>,
+    num_kept_globals: usize,
     associated_values: &'linker mut Vec<GlobalUUID>,
     global_namespace: &'linker mut HashMap<String, NamespaceElement>,
     modules: &'linker mut ArenaAllocator<Module, ModuleUUIDMarker>,
@@ -410,6 +441,19 @@ pub struct FileBuilder<'linker> {
 }
 
 impl FileBuilder<'_> {
+    /// The first globals of the file may have been kept from the previous parse. See [Linker::add_or_update_file]
+    pub fn num_kept_globals(&self) -> usize {
+        self.num_kept_globals
+    }
+    pub fn kept_global_span(&self, idx: usize) -> Span {
+        assert!(idx < self.num_kept_globals);
+        match self.associated_values[idx] {
+            GlobalUUID::Module(id) => self.modules[id].link_info.span,
+            GlobalUUID::Type(id) => self.types[id].link_info.span,
+            GlobalUUID::Constant(id) => self.constants[id].link_info.span,
+        }
+    }
+
     fn add_name(&mut self, name: String, new_obj_id: GlobalUUID) {
         match self.global_namespace.entry(name) {
             std::collections::hash_map::Entry::Occupied(mut occ) => {
@@ -35,6 +35,13 @@ impl ResolvedGlobals {
     pub fn checkpoint(&self) -> ResolvedGlobalsCheckpoint {
         ResolvedGlobalsCheckpoint(self.referenced_globals.len(), self.all_resolved)
     }
+    /// May contain duplicates
+    pub fn referenced_globals(&self) -> &[GlobalUUID] {
+        &self.referenced_globals
+    }
+    pub fn all_resolved(&self) -> bool {
+        self.all_resolved
+    }
 }
 
 struct LinkingErrorLocation {
@@ -44,7 +51,7 @@ struct LinkingErrorLocation {
 }
 
 /// This struct encapsulates the concept of name resolution. It reports name-not-found errors,
-/// and remembers all of the requested globals in preparation for #49
+/// and remembers all of the requested globals for incremental compilation (#49)
 pub struct GlobalResolver<'linker> {
     linker: &'linker Linker,
     pub file_data: &'linker FileData,
@@ -9,8 +9,12 @@ mod errors;
 mod file_position;
 mod flattening;
 mod instantiation;
+mod interner;
 mod prelude;
+mod stats;
+mod symbol;
 mod to_string;
+mod tree_sitter_alloc;
 mod typing;
 mod value;
 
@@ -34,6 +38,7 @@ use instantiation::InstantiatedModule;
 
 fn main() -> Result<(), Box<dyn Error + Sync + Send>> {
     let config = config();
+    tree_sitter_alloc::install();
 
     let file_paths = config.files.clone();
 
@@ -52,17 +57,61 @@ fn main() -> Result<(), Box<dyn Error + Sync + Send>> {
         panic!("LSP not enabled!")
     }
 
-    let (linker, mut paths_arena) = compile_all(file_paths);
+    let (linker, mut paths_arena) = match compile_all(file_paths) {
+        Ok(compiled) => compiled,
+        Err(err) => {
+            let mut err_lock = std::io::stderr().lock();
+            writeln!(err_lock, "{err}").unwrap();
+            std::process::exit(1);
+        }
+    };
+    // Also prints the statistics when exiting early below
+    let _stats_report = stats::ReportOnDrop;
     print_all_errors(&linker, &mut paths_arena.file_sources);
 
-    if config.early_exit != EarlyExitUpTo::CodeGen {
-        return Ok(());
+    if config.early_exit == EarlyExitUpTo::CodeGen {
+        if let Err(err) = generate_outputs(&linker, &*codegen_backend, |_md| true) {
+            let mut err_lock = std::io::stderr().lock();
+            writeln!(err_lock, "{err}").unwrap();
+            std::process::exit(1);
+        }
+    }
+
+    if config.watch {
+        return dev_aid::watch::watch_main(linker, paths_arena, &*codegen_backend);
     }
 
+    Ok(())
+}
+
+/// The modules that get an output file with `--codegen`
+fn modules_with_output_files(linker: &Linker) -> impl Iterator<Item = &Module> {
+    linker
+        .modules
+        .iter()
+        .map(|(_id, md)| md)
+        // With --top, don't create empty files for modules that weren't reached
+        .filter(|md| config().top_module.is_none() || md.instantiations.has_instances())
+}
+
+/// Writes the files of `--codegen` and `--standalone`.
+///
+/// `should_generate` selects the modules for `--codegen`, such that `--watch` only rewrites the modules that were recompiled.
+/// The `--standalone` file is always written
+fn generate_outputs(
+    linker: &Linker,
+    codegen_backend: &dyn CodeGenBackend,
+    should_generate: impl Fn(&Module) -> bool,
+) -> Result<(), String> {
+    let config = config();
+
     if config.codegen {
-        for (_id, md) in &linker.modules {
-            codegen_backend.codegen_to_file(md, &linker);
-        }
+        let modules_to_generate: Vec<&Module> = modules_with_output_files(linker)
+            .filter(|md| should_generate(md))
+            .collect();
+        stats::time_phase("codegen", || {
+            codegen_backend.codegen_to_files(&modules_to_generate, linker)
+        });
     }
 
     if let Some(md_name) = &config.codegen_module_and_dependencies_one_file {
@@ -71,12 +120,16 @@ fn main() -> Result<(), Box<dyn Error + Sync + Send>> {
             .iter()
             .find(|(_, md)| &md.link_info.name == md_name)
         else {
-            let mut err_lock = std::io::stderr().lock();
-            writeln!(err_lock, "Unknown module {md_name}").unwrap();
-            std::process::exit(1);
+            return Err(format!("Unknown module {md_name}"));
         };
 
-        codegen_backend.codegen_with_dependencies(&linker, md.1, &format!("{md_name}_standalone"));
+        stats::time_phase("codegen", || {
+            codegen_backend.codegen_with_dependencies(
+                linker,
+                md.1,
+                &format!("{md_name}_standalone"),
+            )
+        });
     }
 
     Ok(())
@@ -0,0 +1,446 @@
+//! Timings and counters of the compilation phases, for `--time-passes` and `--stats-json`
+//!
+//! Phases are timed with [time_phase]. Individual globals, instances and generated files are timed with an [ItemTimer].
+//! Item timings are exclusive: an instance that instantiates a submodule on demand doesn't get billed for that submodule.
+//! Counters such as [Counters::latency_edges] are added with [count], and go to the innermost running [ItemTimer].
+//!
+//! Phases that run on multiple threads (see [crate::config::ConfigStruct::jobs]) were timed on the thread that started them,
+//! so they show wall time. Phases that run inside of items, like `latency counting`, add up the time of all threads.
+//!
+//! Each phase also records the resident memory of the process after it last ran, and the peak so far (only on Linux).
+//! The memory held by each instance is estimated with [crate::instantiation::InstantiatedModule::heap_size].
+//! The parse tree memory of each file is measured by [crate::tree_sitter_alloc].
+//!
+//! When neither flag is given nothing is recorded, and all of this boils down to a check of [enabled].
+
+use std::{
+    cell::RefCell,
+    fmt::Write as _,
+    io::Write as _,
+    sync::Mutex,
+    time::{Duration, Instant},
+};
+
+use crate::config::config;
+
+/// The number of items that `--time-passes` prints. `--stats-json` contains all of them
+const NUM_ITEMS_TO_PRINT: usize = 20;
+
+#[derive(Debug, Clone, Copy, Default)]
+pub struct Counters {
+    pub instructions: usize,
+    pub wires: usize,
+    pub submodules: usize,
+    pub type_variables: usize,
+    pub latency_edges: usize,
+    /// Estimated heap memory held by instances, after `--compact-instances` if given
+    pub heap_bytes: usize,
+}
+
+impl Counters {
+    const ZERO: Counters = Counters {
+        instructions: 0,
+        wires: 0,
+        submodules: 0,
+        type_variables: 0,
+        latency_edges: 0,
+        heap_bytes: 0,
+    };
+
+    fn add(&mut self, other: &Counters) {
+        self.instructions += other.instructions;
+        self.wires += other.wires;
+        self.submodules += other.submodules;
+        self.type_variables += other.type_variables;
+        self.latency_edges += other.latency_edges;
+        self.heap_bytes += other.heap_bytes;
+    }
+
+    fn fields(&self) -> [(&'static str, usize); 6] {
+        [
+            ("instructions", self.instructions),
+            ("wires", self.wires),
+            ("submodules", self.submodules),
+            ("type_variables", self.type_variables),
+            ("latency_edges", self.latency_edges),
+            ("heap_bytes", self.heap_bytes),
+        ]
+    }
+}
+
+#[derive(Debug)]
+struct PhaseStats {
+    name: &'static str,
+    time: Duration,
+    runs: usize,
+    /// In bytes, see [process_memory]
+    memory_after: Option<ProcessMemory>,
+}
+
+#[derive(Debug)]
+struct ItemStats {
+    /// The phase this item was part of, such as `typecheck` or `instantiate`
+    kind: &'static str,
+    name: String,
+    /// Excluding the time of nested items
+    self_time: Duration,
+    counters: Counters,
+}
+
+#[derive(Debug)]
+struct Stats {
+    /// In the order that the phases first ran in
+    phases: Vec<PhaseStats>,
+    items: Vec<ItemStats>,
+    totals: Counters,
+}
+
+static STATS: Mutex<Stats> = Mutex::new(Stats {
+    phases: Vec::new(),
+    items: Vec::new(),
+    totals: Counters::ZERO,
+});
+
+/// An [ItemTimer] that is currently running on this thread
+struct ItemFrame {
+    start: Instant,
+    /// Total time of the items that ran inside of this one
+    nested: Duration,
+    counters: Counters,
+}
+
+thread_local! {
+    static ITEM_STACK: RefCell<Vec<ItemFrame>> = const { RefCell::new(Vec::new()) };
+}
+
+#[derive(Debug, Clone, Copy)]
+struct ProcessMemory {
+    resident: usize,
+    peak_resident: usize,
+}
+
+/// Reads `VmRSS` and `VmHWM` from `/proc/self/status`. [None] on other platforms
+fn process_memory() -> Option<ProcessMemory> {
+    let status = std::fs::read_to_string("/proc/self/status").ok()?;
+    let read_kb = |key: &str| -> Option<usize> {
+        let line = status.lines().find(|line| line.starts_with(key))?;
+        let kb: usize = line[key.len()..]
+            .trim()
+            .trim_end_matches("kB")
+            .trim()
+            .parse()
+            .ok()?;
+        Some(kb * 1024)
+    };
+    Some(ProcessMemory {
+        resident: read_kb("VmRSS:")?,
+        peak_resident: read_kb("VmHWM:")?,
+    })
+}
+
+pub fn enabled() -> bool {
+    config().time_passes || config().stats_json.is_some()
+}
+
+/// Runs `f`, and adds its wall time to the phase called `phase`
+pub fn time_phase<R>(phase: &'static str, f: impl FnOnce() -> R) -> R {
+    if !enabled() {
+        return f();
+    }
+    let start = Instant::now();
+    let result = f();
+    let time = start.elapsed();
+    let memory_after = process_memory();
+
+    let mut stats = STATS.lock().unwrap();
+    if let Some(found) = stats.phases.iter_mut().find(|p| p.name == phase) {
+        found.time += time;
+        found.runs += 1;
+        found.memory_after = memory_after;
+    } else {
+        stats.phases.push(PhaseStats {
+            name: phase,
+            time,
+            runs: 1,
+            memory_after,
+        });
+    }
+    result
+}
+
+/// Adds to the counters of the innermost [ItemTimer] on this thread. Counters outside of items only go to the totals
+pub fn count(f: impl FnOnce(&mut Counters)) {
+    if !enabled() {
+        return;
+    }
+    let mut delta = Counters::default();
+    f(&mut delta);
+    let is_in_item = ITEM_STACK.with_borrow_mut(|stack| match stack.last_mut() {
+        Some(frame) => {
+            frame.counters.add(&delta);
+            true
+        }
+        None => false,
+    });
+    if !is_in_item {
+        STATS.lock().unwrap().totals.add(&delta);
+    }
+}
+
+/// Times a single global, instance or generated file. Started with [ItemTimer::start], recorded by [ItemTimer::finish].
+///
+/// Must be finished on the thread it was started on, and in the reverse order of starting.
+/// A timer that is dropped without being finished (for instance when unwinding) is discarded.
+#[must_use]
+pub struct ItemTimer {
+    kind: &'static str,
+    is_running: bool,
+}
+
+impl ItemTimer {
+    pub fn start(kind: &'static str) -> Self {
+        let is_running = enabled();
+        if is_running {
+            ITEM_STACK.with_borrow_mut(|stack| {
+                stack.push(ItemFrame {
+                    start: Instant::now(),
+                    nested: Duration::ZERO,
+                    counters: Counters::default(),
+                })
+            });
+        }
+        Self { kind, is_running }
+    }
+
+    /// The name is only produced when statistics are enabled
+    pub fn finish(mut self, name: impl FnOnce() -> String) {
+        let Some((frame, total_time)) = self.pop_frame() else {
+            return;
+        };
+        let item = ItemStats {
+            kind: self.kind,
+            name: name(),
+            self_time: total_time.saturating_sub(frame.nested),
+            counters: frame.counters,
+        };
+
+        let mut stats = STATS.lock().unwrap();
+        stats.totals.add(&item.counters);
+        stats.items.push(item);
+    }
+
+    /// Also bills the time of this item to the item it is nested in
+    fn pop_frame(&mut self) -> Option<(ItemFrame, Duration)> {
+        if !std::mem::replace(&mut self.is_running, false) {
+            return None;
+        }
+        ITEM_STACK.with_borrow_mut(|stack| {
+            let frame = stack
+                .pop()
+                .expect("ItemTimers must be finished in reverse order");
+            let total_time = frame.start.elapsed();
+            if let Some(parent) = stack.last_mut() {
+                parent.nested += total_time;
+            }
+            Some((frame, total_time))
+        })
+    }
+}
+
+impl Drop for ItemTimer {
+    fn drop(&mut self) {
+        self.pop_frame();
+    }
+}
+
+fn as_millis(d: Duration) -> f64 {
+    d.as_secs_f64() * 1000.0
+}
+
+fn as_mib(bytes: usize) -> f64 {
+    bytes as f64 / (1024.0 * 1024.0)
+}
+
+fn print_table(stats: &Stats, items_by_time: &[&ItemStats]) {
+    println!("===== Compilation statistics =====");
+    println!(
+        "{:<24} {:>12} {:>6} {:>10} {:>10}",
+        "Phase", "Time (ms)", "Runs", "RSS (MiB)", "Peak (MiB)"
+    );
+    for phase in &stats.phases {
+        let (rss, peak_rss) = match phase.memory_after {
+            Some(mem) => (
+                format!("{:.1}", as_mib(mem.resident)),
+                format!("{:.1}", as_mib(mem.peak_resident)),
+            ),
+            None => ("?".to_owned(), "?".to_owned()),
+        };
+        println!(
+            "{:<24} {:>12.3} {:>6} {rss:>10} {peak_rss:>10}",
+            phase.name,
+            as_millis(phase.time),
+            phase.runs
+        );
+    }
+
+    let total_item_time: Duration = stats.items.iter().map(|item| item.self_time).sum();
+    println!();
+    println!(
+        "{:<12} {:<40} {:>12} {:>7} {:>8} {:>8} {:>8} {:>8} {:>8} {:>10}",
+        "Kind",
+        "Name",
+        "Self (ms)",
+        "%",
+        "Instrs",
+        "Wires",
+        "Submods",
+        "TypeVars",
+        "LatEdges",
+        "Heap (KiB)"
+    );
+    for item in items_by_time.iter().take(NUM_ITEMS_TO_PRINT) {
+        let percentage = if total_item_time.is_zero() {
+            0.0
+        } else {
+            item.self_time.as_secs_f64() * 100.0 / total_item_time.as_secs_f64()
+        };
+        let c = &item.counters;
+        println!(
+            "{:<12} {:<40} {:>12.3} {:>6.1}% {:>8} {:>8} {:>8} {:>8} {:>8} {:>10.1}",
+            item.kind,
+            item.name,
+            as_millis(item.self_time),
+            percentage,
+            c.instructions,
+            c.wires,
+            c.submodules,
+            c.type_variables,
+            c.latency_edges,
+            c.heap_bytes as f64 / 1024.0
+        );
+    }
+    if items_by_time.len() > NUM_ITEMS_TO_PRINT {
+        println!(
+            "... and {} more, see --stats-json",
+            items_by_time.len() - NUM_ITEMS_TO_PRINT
+        );
+    }
+
+    println!();
+    for (name, value) in stats.totals.fields() {
+        println!("Total {name}: {value}");
+    }
+}
+
+fn push_json_string(out: &mut String, s: &str) {
+    out.push('"');
+    for c in s.chars() {
+        match c {
+            '"' => out.push_str("\\\""),
+            '\\' => out.push_str("\\\\"),
+            '\n' => out.push_str("\\n"),
+            c if (c as u32) < 0x20 => write!(out, "\\u{:04x}", c as u32).unwrap(),
+            c => out.push(c),
+        }
+    }
+    out.push('"');
+}
+
+fn push_json_counters(out: &mut String, counters: &Counters) {
+    for (name, value) in counters.fields() {
+        write!(out, ",\"{name}\":{value}").unwrap();
+    }
+}
+
+/// Hand-written, as `serde_json` is only available with the `lsp` feature
+fn to_json(stats: &Stats, items_by_time: &[&ItemStats]) -> String {
+    let mut out = String::from("{\"phases\":[");
+    for (idx, phase) in stats.phases.iter().enumerate() {
+        if idx != 0 {
+            out.push(',');
+        }
+        out.push_str("{\"name\":");
+        push_json_string(&mut out, phase.name);
+        write!(
+            out,
+            ",\"time_ms\":{},\"runs\":{}",
+            as_millis(phase.time),
+            phase.runs
+        )
+        .unwrap();
+        if let Some(mem) = phase.memory_after {
+            write!(
+                out,
+                ",\"rss_after_bytes\":{},\"peak_rss_bytes\":{}",
+                mem.resident, mem.peak_resident
+            )
+            .unwrap();
+        }
+        out.push('}');
+    }
+    out.push_str("],\"items\":[");
+    for (idx, item) in items_by_time.iter().enumerate() {
+        if idx != 0 {
+            out.push(',');
+        }
+        out.push_str("{\"kind\":");
+        push_json_string(&mut out, item.kind);
+        out.push_str(",\"name\":");
+        push_json_string(&mut out, &item.name);
+        write!(out, ",\"self_time_ms\":{}", as_millis(item.self_time)).unwrap();
+        push_json_counters(&mut out, &item.counters);
+        out.push('}');
+    }
+    out.push_str("],\"totals\":{\"items\":");
+    write!(out, "{}", stats.items.len()).unwrap();
+    push_json_counters(&mut out, &stats.totals);
+    out.push_str("}}\n");
+    out
+}
+
+/// Prints the table for `--time-passes`, and writes the file for `--stats-json`
+pub fn report() {
+    if !enabled() {
+        return;
+    }
+    let stats = STATS.lock().unwrap();
+    let mut items_by_time: Vec<&ItemStats> = stats.items.iter().collect();
+    items_by_time.sort_by(|a, b| b.self_time.cmp(&a.self_time));
+
+    if config().time_passes {
+        print_table(&stats, &items_by_time);
+    }
+    if let Some(path) = &config().stats_json {
+        let json = to_json(&stats, &items_by_time);
+        if let Err(reason) = std::fs::write(path, json) {
+            let mut err_lock = std::io::stderr().lock();
+            writeln!(
+                err_lock,
+                "Could not write statistics to '{}' because {reason}",
+                path.display()
+            )
+            .unwrap();
+        }
+    }
+}
+
+/// Calls [report] when dropped, such that the statistics are also reported on early returns
+pub struct ReportOnDrop;
+
+impl Drop for ReportOnDrop {
+    fn drop(&mut self) {
+        report();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn json_strings_are_escaped() {
+        let mut out = String::new();
+        push_json_string(&mut out, "a\"b\\c\nd\u{1}");
+        assert_eq!(out, "\"a\\\"b\\\\c\\nd\\u0001\"");
+    }
+}
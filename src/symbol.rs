@@ -0,0 +1,42 @@
+//! Names of the wires and submodules of instances.
+//!
+//! Instantiation generates a name for every wire, and every instance of a module generates the same names again.
+//! So they are interned on [crate::linker::Linker::names], and an instance only holds handles to them.
+//! Equal names share one allocation, and comparing or hashing a [Symbol] doesn't look at the characters.
+
+use std::sync::Arc;
+
+use crate::interner::{Interned, Interner};
+
+pub type Symbol = Interned<str>;
+
+impl Symbol {
+    pub fn intern(names: &Interner<str>, name: &str) -> Symbol {
+        names.intern(name, |name| Arc::from(name))
+    }
+
+    pub fn as_str(&self) -> &str {
+        self
+    }
+}
+
+impl PartialEq<str> for Symbol {
+    fn eq(&self, other: &str) -> bool {
+        self.as_str() == other
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn equal_names_intern_to_the_same_symbol() {
+        let names = Interner::default();
+        let a = Symbol::intern(&names, "a_wire");
+        assert_eq!(a, Symbol::intern(&names, &String::from("a_wire")));
+        assert_ne!(a, Symbol::intern(&names, "another_wire"));
+        assert!(a == *"a_wire");
+        assert_eq!(a.to_string(), "a_wire");
+    }
+}
@@ -13,6 +13,7 @@ use crate::typing::{
 };
 
 use std::{
+    borrow::Borrow,
     fmt::{Display, Formatter},
     ops::Index,
 };
@@ -174,9 +175,9 @@ impl Display for Value {
         match self {
             Value::Bool(b) => b.fmt(f),
             Value::Integer(i) => i.fmt(f),
-            Value::Array(arr_box) => {
+            Value::Array(_) | Value::BoolArray(_) | Value::IntArray(_) => {
                 f.write_str("[")?;
-                let mut iter = arr_box.iter();
+                let mut iter = self.array_iter();
                 if let Some(v) = iter.next() {
                     v.fmt(f)?;
 
@@ -294,7 +295,7 @@ impl Module {
 
 pub fn pretty_print_concrete_instance(
     target_link_info: &LinkInfo,
-    given_template_args: &TVec<ConcreteType>,
+    given_template_args: &TVec<impl Borrow<ConcreteType>>,
     linker_types: &impl Index<TypeUUID, Output = StructType>,
 ) -> String {
     assert!(given_template_args.len() == target_link_info.template_parameters.len());
@@ -305,6 +306,7 @@ pub fn pretty_print_concrete_instance(
 
     let mut result = format!("{object_full_name} #(\n");
     for (id, arg) in given_template_args {
+        let arg: &ConcreteType = arg.borrow();
         let arg_in_target = &target_link_info.template_parameters[id];
         write!(result, "    {}: ", arg_in_target.name).unwrap();
         match arg {
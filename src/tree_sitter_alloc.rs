@@ -0,0 +1,225 @@
+//! The allocator of tree-sitter's parse trees, installed with [install] through [tree_sitter::set_allocator].
+//!
+//! Parse trees consist of many small subtree nodes, which the system allocator allocates and frees one by one.
+//! With `--pool-parse-trees`, small blocks are pooled per size class instead: freed blocks go to a free list of the freeing thread,
+//! and are reused by the next parse on that thread. Pooled memory is only returned when its thread exits.
+//! A per-parse arena is not possible, because incremental parses share subtrees with the previous tree of the file.
+//!
+//! The allocator also keeps track of the bytes that are live on each thread, such that [measure_allocated]
+//! can report the parse tree memory of each file for `--time-passes` and `--stats-json`.
+//!
+//! Only installed when one of these flags is given. Otherwise tree-sitter keeps using the system allocator.
+
+use std::alloc::{alloc, dealloc, handle_alloc_error, realloc, Layout};
+use std::cell::{Cell, RefCell};
+use std::ffi::c_void;
+use std::sync::atomic::{AtomicBool, Ordering};
+
+use crate::config::config;
+use crate::stats;
+
+/// Every block starts with its size, such that [ts_free] and [ts_realloc] know its layout. Also keeps the blocks 16-byte aligned, like malloc
+const HEADER_SIZE: usize = 16;
+const SIZE_CLASS_STEP: usize = 16;
+/// Blocks of up to `NUM_SIZE_CLASSES * SIZE_CLASS_STEP` bytes are pooled, this covers the subtree nodes
+const NUM_SIZE_CLASSES: usize = 16;
+const MAX_POOLED_SIZE: usize = NUM_SIZE_CLASSES * SIZE_CLASS_STEP;
+
+static USE_POOL: AtomicBool = AtomicBool::new(false);
+
+/// Free blocks per size class. The blocks are deallocated when the thread exits
+struct FreeLists([Vec<*mut u8>; NUM_SIZE_CLASSES]);
+
+impl Drop for FreeLists {
+    fn drop(&mut self) {
+        for (class_idx, blocks) in self.0.iter().enumerate() {
+            let layout = block_layout(size_class_payload(class_idx));
+            for block in blocks {
+                unsafe { dealloc(*block, layout) };
+            }
+        }
+    }
+}
+
+thread_local! {
+    static FREE_LISTS: RefCell<FreeLists> = const { RefCell::new(FreeLists([const { Vec::new() }; NUM_SIZE_CLASSES])) };
+    /// Allocated minus freed on this thread. Trees are often freed on another thread than they were parsed on, so this may go negative
+    static LIVE_BYTES: Cell<isize> = const { Cell::new(0) };
+}
+
+fn size_class_payload(class_idx: usize) -> usize {
+    (class_idx + 1) * SIZE_CLASS_STEP
+}
+
+/// Aborts for sizes that can't be allocated at all, as unwinding into C is not allowed
+fn block_layout(payload: usize) -> Layout {
+    match HEADER_SIZE
+        .checked_add(payload)
+        .and_then(|size| Layout::from_size_align(size, HEADER_SIZE).ok())
+    {
+        Some(layout) => layout,
+        None => std::process::abort(),
+    }
+}
+
+/// Small sizes are rounded up to their size class, such that any block of the class can be reused for them
+fn payload_for(size: usize) -> usize {
+    if size <= MAX_POOLED_SIZE {
+        size.max(1).div_ceil(SIZE_CLASS_STEP) * SIZE_CLASS_STEP
+    } else {
+        size
+    }
+}
+
+fn add_live_bytes(delta: isize) {
+    // Allocations made while the thread is shutting down aren't counted
+    let _ = LIVE_BYTES.try_with(|live| live.set(live.get() + delta));
+}
+
+/// Must not panic, these are called from C. Tree-sitter doesn't check for null either, so failing allocations abort
+unsafe extern "C" fn ts_malloc(size: usize) -> *mut c_void {
+    let payload = payload_for(size);
+    let reused = if payload <= MAX_POOLED_SIZE && USE_POOL.load(Ordering::Relaxed) {
+        let class_idx = payload / SIZE_CLASS_STEP - 1;
+        FREE_LISTS
+            .try_with(|lists| lists.try_borrow_mut().ok()?.0[class_idx].pop())
+            .ok()
+            .flatten()
+    } else {
+        None
+    };
+    let block = match reused {
+        Some(block) => block,
+        None => {
+            let layout = block_layout(payload);
+            let block = alloc(layout);
+            if block.is_null() {
+                handle_alloc_error(layout);
+            }
+            block
+        }
+    };
+    block.cast::<usize>().write(payload);
+    add_live_bytes(payload as isize);
+    block.add(HEADER_SIZE).cast()
+}
+
+unsafe extern "C" fn ts_calloc(count: usize, size: usize) -> *mut c_void {
+    let Some(total) = count.checked_mul(size) else {
+        std::process::abort();
+    };
+    let result = ts_malloc(total);
+    // Pooled blocks still contain their previous contents
+    result.cast::<u8>().write_bytes(0, total);
+    result
+}
+
+unsafe extern "C" fn ts_free(ptr: *mut c_void) {
+    if ptr.is_null() {
+        return;
+    }
+    let block = ptr.cast::<u8>().sub(HEADER_SIZE);
+    let payload = block.cast::<usize>().read();
+    add_live_bytes(-(payload as isize));
+    if payload <= MAX_POOLED_SIZE && USE_POOL.load(Ordering::Relaxed) {
+        let class_idx = payload / SIZE_CLASS_STEP - 1;
+        let is_pooled = FREE_LISTS
+            .try_with(|lists| match lists.try_borrow_mut() {
+                Ok(mut lists) => {
+                    lists.0[class_idx].push(block);
+                    true
+                }
+                Err(_) => false,
+            })
+            .unwrap_or(false);
+        if is_pooled {
+            return;
+        }
+    }
+    dealloc(block, block_layout(payload));
+}
+
+unsafe extern "C" fn ts_realloc(ptr: *mut c_void, size: usize) -> *mut c_void {
+    if ptr.is_null() {
+        return ts_malloc(size);
+    }
+    let block = ptr.cast::<u8>().sub(HEADER_SIZE);
+    let old_payload = block.cast::<usize>().read();
+    let new_payload = payload_for(size);
+    if new_payload == old_payload {
+        return ptr;
+    }
+    if old_payload > MAX_POOLED_SIZE && new_payload > MAX_POOLED_SIZE {
+        // Neither is pooled, so the system allocator may be able to grow the block in place
+        let new_layout = block_layout(new_payload);
+        let new_block = realloc(block, block_layout(old_payload), new_layout.size());
+        if new_block.is_null() {
+            handle_alloc_error(new_layout);
+        }
+        new_block.cast::<usize>().write(new_payload);
+        add_live_bytes(new_payload as isize - old_payload as isize);
+        return new_block.add(HEADER_SIZE).cast();
+    }
+    let result = ts_malloc(size);
+    std::ptr::copy_nonoverlapping(
+        ptr.cast::<u8>(),
+        result.cast::<u8>(),
+        usize::min(old_payload, size),
+    );
+    ts_free(ptr);
+    result
+}
+
+/// Must be called before anything is parsed, because tree-sitter's existing allocations can't be freed by this allocator
+pub fn install() {
+    if !config().pool_parse_trees && !stats::enabled() {
+        return;
+    }
+    USE_POOL.store(config().pool_parse_trees, Ordering::Relaxed);
+    unsafe {
+        tree_sitter::set_allocator(
+            Some(ts_malloc),
+            Some(ts_calloc),
+            Some(ts_realloc),
+            Some(ts_free),
+        );
+    }
+}
+
+/// Runs `f`, and returns how many more bytes tree-sitter holds on this thread afterwards.
+/// For a parse, that is the size of its tree, excluding the subtrees reused from the old tree
+pub fn measure_allocated<R>(f: impl FnOnce() -> R) -> (R, usize) {
+    let before = LIVE_BYTES.get();
+    let result = f();
+    let allocated = LIVE_BYTES.get() - before;
+    (result, allocated.max(0) as usize)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn blocks_are_reused_and_zeroed() {
+        USE_POOL.store(true, Ordering::Relaxed);
+        unsafe {
+            let (first, allocated) = measure_allocated(|| ts_malloc(40));
+            assert_eq!(allocated, 48);
+            first.cast::<u8>().write_bytes(0xff, 40);
+            ts_free(first);
+            let second = ts_calloc(10, 4);
+            assert_eq!(first, second);
+            assert!(std::slice::from_raw_parts(second.cast::<u8>(), 40)
+                .iter()
+                .all(|b| *b == 0));
+
+            second.cast::<u8>().write(7);
+            let grown = ts_realloc(second, 1000);
+            assert_eq!(grown.cast::<u8>().read(), 7);
+            let (grown_again, allocated) = measure_allocated(|| ts_realloc(grown, 5000));
+            assert_eq!(allocated, 4000);
+            assert_eq!(grown_again.cast::<u8>().read(), 7);
+            ts_free(grown_again);
+        }
+    }
+}
@@ -214,7 +214,7 @@ impl TypeUnifier {
                 self.type_substitutor
                     .unify_report_error(typ, &INT_TYPE, value_span, "int constant")
             }
-            Value::Array(arr) => {
+            Value::Array(_) | Value::BoolArray(_) | Value::IntArray(_) => {
                 let arr_content_variable = AbstractType::Unknown(self.alloc_typ_variable());
                 self.type_substitutor.unify_report_error(
                     typ,
@@ -223,8 +223,8 @@ impl TypeUnifier {
                     "array constant",
                 );
 
-                for v in arr.deref() {
-                    self.unify_with_constant(&arr_content_variable, v, value_span);
+                for v in value.array_iter() {
+                    self.unify_with_constant(&arr_content_variable, &v, value_span);
                 }
             }
             Value::Error | Value::Unset => {} // Already an error, don't unify
@@ -1,14 +1,19 @@
-use num::BigInt;
 use sus_proc_macro::get_builtin_type;
 
 use crate::prelude::*;
+use std::borrow::Borrow;
 use std::ops::Deref;
+use std::sync::Arc;
 
-use crate::value::Value;
+use crate::interner::{Interned, Interner};
+
+use crate::value::{IntValue, Value};
 
 use super::template::TVec;
 
-use super::type_inference::ConcreteTypeVariableID;
+use super::type_inference::{
+    ConcreteTypeVariableID, ConcreteTypeVariableIDMarker, HindleyMilner, TypeSubstitutor,
+};
 
 pub const BOOL_CONCRETE_TYPE: ConcreteType = ConcreteType::Named(ConcreteGlobalReference {
     id: get_builtin_type!("bool"),
@@ -54,6 +59,27 @@ impl ConcreteType {
         };
         v
     }
+    /// Estimated number of bytes this type owns on the heap. Used by [crate::instantiation::InstantiatedModule::heap_size]
+    pub fn heap_size(&self) -> usize {
+        match self {
+            ConcreteType::Named(global_ref) => {
+                global_ref.template_args.capacity() * std::mem::size_of::<ConcreteType>()
+                    + global_ref
+                        .template_args
+                        .iter()
+                        .map(|(_, arg)| arg.heap_size())
+                        .sum::<usize>()
+            }
+            ConcreteType::Value(v) => v.heap_size(),
+            ConcreteType::Array(arr_box) => {
+                let (content, size) = arr_box.deref();
+                std::mem::size_of::<(ConcreteType, ConcreteType)>()
+                    + content.heap_size()
+                    + size.heap_size()
+            }
+            ConcreteType::Unknown(_) => 0,
+        }
+    }
     pub fn contains_unknown(&self) -> bool {
         match self {
             ConcreteType::Named(global_ref) => global_ref
@@ -71,22 +97,20 @@ impl ConcreteType {
     /// Returns the size of this type in *wires*. So int #(MAX: 255) would return '8'
     ///
     /// If it contains any Unknowns, then returns None
-    pub fn sizeof(&self) -> Option<BigInt> {
+    pub fn sizeof(&self) -> Option<IntValue> {
         match self {
             ConcreteType::Named(reference) => Some(Self::sizeof_named(reference).into()),
             ConcreteType::Value(_value) => unreachable!("Root of ConcreteType cannot be a value"),
             ConcreteType::Array(arr_box) => {
                 let (typ, size) = arr_box.deref();
 
-                let mut typ_sz = typ.sizeof()?;
+                let typ_sz = typ.sizeof()?;
 
                 let ConcreteType::Value(arr_sz) = size else {
                     return None;
                 };
 
-                typ_sz *= arr_sz.unwrap_integer();
-
-                Some(typ_sz)
+                Some(&typ_sz * arr_sz.unwrap_integer())
             }
             ConcreteType::Unknown(_uuid) => None,
         }
@@ -104,3 +128,105 @@ impl ConcreteType {
         }
     }
 }
+
+/// A hash-consed [ConcreteType]. Equal types in the same [Interner] always get the same handle,
+/// so equality and hashing are O(1) pointer operations instead of walks over the type tree.
+///
+/// Created with [ConcreteType::intern] on [Linker::interned_types].
+///
+/// Only intern types that are final, [ConcreteType::Unknown]s belong to a specific [crate::typing::type_inference::TypeSubstitutor]
+pub type InternedConcreteType = Interned<ConcreteType>;
+
+impl ConcreteType {
+    pub fn intern(&self, interner: &Interner<ConcreteType>) -> InternedConcreteType {
+        interner.intern(self, |typ| Arc::new(typ.clone()))
+    }
+}
+
+/// The type of a wire or submodule template argument of an instance.
+///
+/// Concrete typechecking still needs to unify and substitute the full tree ([Self::Inferring]).
+/// Once it is fully substituted it is interned ([Self::Final]), so finished instances share their types through [Linker::interned_types].
+#[derive(Debug, Clone)]
+pub enum InstanceType {
+    Inferring(ConcreteType),
+    Final(InternedConcreteType),
+}
+
+impl Deref for InstanceType {
+    type Target = ConcreteType;
+
+    fn deref(&self) -> &ConcreteType {
+        match self {
+            InstanceType::Inferring(typ) => typ,
+            InstanceType::Final(typ) => typ,
+        }
+    }
+}
+
+impl Borrow<ConcreteType> for InstanceType {
+    fn borrow(&self) -> &ConcreteType {
+        self
+    }
+}
+
+impl From<ConcreteType> for InstanceType {
+    fn from(typ: ConcreteType) -> Self {
+        InstanceType::Inferring(typ)
+    }
+}
+
+impl InstanceType {
+    /// Substitutes and interns the type. If it still contains unknowns, it stays [Self::Inferring] and false is returned
+    pub fn finalize(
+        &mut self,
+        substitutor: &TypeSubstitutor<ConcreteType, ConcreteTypeVariableIDMarker>,
+        interner: &Interner<ConcreteType>,
+    ) -> bool {
+        if let InstanceType::Inferring(typ) = self {
+            if !typ.fully_substitute(substitutor) {
+                return false;
+            }
+            let interned = typ.intern(interner);
+            *self = InstanceType::Final(interned);
+        }
+        true
+    }
+    #[track_caller]
+    pub fn unwrap_final(&self) -> &InternedConcreteType {
+        let InstanceType::Final(typ) = self else {
+            unreachable!("unwrap_final on {self:?}")
+        };
+        typ
+    }
+    /// Final types are shared in the [Interner], so only types that are still [Self::Inferring] are counted
+    pub fn heap_size(&self) -> usize {
+        match self {
+            InstanceType::Inferring(typ) => typ.heap_size(),
+            InstanceType::Final(_) => 0,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn equal_types_intern_to_the_same_handle() {
+        let mk_arr = |sz: usize| {
+            ConcreteType::Array(Box::new((
+                BOOL_CONCRETE_TYPE,
+                ConcreteType::Value(Value::Integer(sz.into())),
+            )))
+        };
+        let interner = Interner::default();
+        assert_eq!(mk_arr(3).intern(&interner), mk_arr(3).intern(&interner));
+        assert_ne!(mk_arr(3).intern(&interner), mk_arr(4).intern(&interner));
+        assert_ne!(
+            mk_arr(3).intern(&interner),
+            BOOL_CONCRETE_TYPE.intern(&interner)
+        );
+        assert_eq!(*mk_arr(5).intern(&interner), mk_arr(5));
+    }
+}
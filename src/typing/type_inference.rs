@@ -1,12 +1,12 @@
 //! Implements the Hindley-Milner algorithm for Type Inference.
 
-use std::cell::{OnceCell, RefCell};
+use std::cell::{Cell, OnceCell, RefCell};
 use std::fmt::Debug;
 use std::marker::PhantomData;
 use std::ops::{BitAnd, Deref, DerefMut, Index};
 use std::thread::panicking;
 
-use crate::block_vector::{BlockVec, BlockVecIter};
+use crate::block_vector::BlockVec;
 use crate::errors::ErrorInfo;
 use crate::prelude::*;
 
@@ -46,36 +46,52 @@ pub struct FailedUnification<MyType> {
 /// Pretty big block size so for most typing needs we only need one
 const BLOCK_SIZE: usize = 512;
 
+/// A type variable in the union-find forest of [TypeSubstitutor]
+///
+/// Only the representative (root) of each set of unified variables stores a type.
+struct UnionFindNode<MyType> {
+    /// Points to itself for representatives
+    parent: Cell<usize>,
+    /// Upper bound on the height of the tree below this node
+    rank: Cell<u32>,
+    /// Only meaningful for representatives
+    typ: OnceCell<MyType>,
+}
+
+impl<MyType> UnionFindNode<MyType> {
+    fn new(id: usize) -> Self {
+        Self {
+            parent: Cell::new(id),
+            rank: Cell::new(0),
+            typ: OnceCell::new(),
+        }
+    }
+}
+
 /// Implements Hindley-Milner type inference
 ///
 /// It actually already does eager inference where possible (through [Self::unify])
 ///
 /// When eager inference is not possible, [DelayedConstraintsList] should be used
+///
+/// Type variables are kept in a union-find forest with union by rank and path compression.
+/// Unifying two variables merges their sets, instead of substituting one variable for the other,
+/// so there are no chains of variables to follow. The substitution of a set is stored only once, at its representative.
+/// Substitutions never are a bare type variable.
 pub struct TypeSubstitutor<MyType: HindleyMilner<VariableIDMarker>, VariableIDMarker: UUIDMarker> {
-    substitution_map: BlockVec<OnceCell<MyType>, BLOCK_SIZE>,
+    nodes: BlockVec<UnionFindNode<MyType>, BLOCK_SIZE>,
     failed_unifications: RefCell<Vec<FailedUnification<MyType>>>,
     _ph: PhantomData<VariableIDMarker>,
 }
 
-impl<'v, MyType: HindleyMilner<VariableIDMarker> + 'v, VariableIDMarker: UUIDMarker> IntoIterator
-    for &'v TypeSubstitutor<MyType, VariableIDMarker>
-{
-    type Item = &'v OnceCell<MyType>;
-
-    type IntoIter = BlockVecIter<'v, OnceCell<MyType>, BLOCK_SIZE>;
-
-    fn into_iter(self) -> Self::IntoIter {
-        self.substitution_map.iter()
-    }
-}
-
 impl<MyType: HindleyMilner<VariableIDMarker>, VariableIDMarker: UUIDMarker>
     Index<UUID<VariableIDMarker>> for TypeSubstitutor<MyType, VariableIDMarker>
 {
     type Output = OnceCell<MyType>;
 
+    /// The substitution of the set this variable belongs to
     fn index(&self, index: UUID<VariableIDMarker>) -> &Self::Output {
-        &self.substitution_map[index.get_hidden_value()]
+        &self.nodes[self.find(index.get_hidden_value())].typ
     }
 }
 
@@ -120,12 +136,51 @@ impl<MyType: HindleyMilner<VariableIDMarker> + Clone + Debug, VariableIDMarker:
     }
 }
 
+impl<MyType: HindleyMilner<VariableIDMarker>, VariableIDMarker: UUIDMarker>
+    TypeSubstitutor<MyType, VariableIDMarker>
+{
+    /// Finds the representative of the set `var` belongs to. Compresses the path along the way
+    fn find(&self, var: usize) -> usize {
+        let mut root = var;
+        loop {
+            let parent = self.nodes[root].parent.get();
+            if parent == root {
+                break;
+            }
+            root = parent;
+        }
+        let mut cur = var;
+        while cur != root {
+            cur = self.nodes[cur].parent.replace(root);
+        }
+        root
+    }
+
+    /// Makes `new_root` the representative of `child`'s set. Both must be representatives
+    fn link_under(&self, child: usize, new_root: usize) {
+        debug_assert!(self.nodes[child].parent.get() == child);
+        debug_assert!(self.nodes[new_root].parent.get() == new_root);
+        self.nodes[child].parent.set(new_root);
+        let root_rank = &self.nodes[new_root].rank;
+        root_rank.set(root_rank.get().max(self.nodes[child].rank.get() + 1));
+    }
+
+    /// Union by rank of two representatives
+    fn link_by_rank(&self, a: usize, b: usize) {
+        if self.nodes[a].rank.get() < self.nodes[b].rank.get() {
+            self.link_under(a, b);
+        } else {
+            self.link_under(b, a);
+        }
+    }
+}
+
 impl<MyType: HindleyMilner<VariableIDMarker> + Clone + Debug, VariableIDMarker: UUIDMarker>
     TypeSubstitutor<MyType, VariableIDMarker>
 {
     pub fn new() -> Self {
         Self {
-            substitution_map: BlockVec::new(),
+            nodes: BlockVec::new(),
             failed_unifications: RefCell::new(Vec::new()),
             _ph: PhantomData,
         }
@@ -133,9 +188,9 @@ impl<MyType: HindleyMilner<VariableIDMarker> + Clone + Debug, VariableIDMarker:
 
     pub fn init(variable_alloc: &UUIDAllocator<VariableIDMarker>) -> Self {
         Self {
-            substitution_map: variable_alloc
+            nodes: variable_alloc
                 .into_iter()
-                .map(|_| OnceCell::new())
+                .map(|id| UnionFindNode::new(id.get_hidden_value()))
                 .collect(),
             failed_unifications: RefCell::new(Vec::new()),
             _ph: PhantomData,
@@ -143,23 +198,27 @@ impl<MyType: HindleyMilner<VariableIDMarker> + Clone + Debug, VariableIDMarker:
     }
 
     pub fn alloc(&self) -> UUID<VariableIDMarker> {
-        UUID::from_hidden_value(self.substitution_map.alloc(OnceCell::new()))
+        let id = self.nodes.len();
+        assert_eq!(self.nodes.alloc(UnionFindNode::new(id)), id);
+        UUID::from_hidden_value(id)
     }
 
     pub fn id_range(&self) -> UUIDRange<VariableIDMarker> {
-        UUIDRange::new_with_length(self.substitution_map.len())
+        UUIDRange::new_with_length(self.nodes.len())
     }
 
+    /// `reference_this` must be a representative
     fn does_typ_reference_var_recurse_with_substitution(
         &self,
         does_this: &MyType,
-        reference_this: UUID<VariableIDMarker>,
+        reference_this: usize,
     ) -> bool {
         let mut does_it_reference_it = false;
         does_this.for_each_unknown(&mut |v: UUID<VariableIDMarker>| {
-            if v == reference_this {
+            let v_root = self.find(v.get_hidden_value());
+            if v_root == reference_this {
                 does_it_reference_it = true;
-            } else if let Some(found_substitution) = self[v].get() {
+            } else if let Some(found_substitution) = self.nodes[v_root].typ.get() {
                 does_it_reference_it |= self.does_typ_reference_var_recurse_with_substitution(
                     found_substitution,
                     reference_this,
@@ -169,29 +228,23 @@ impl<MyType: HindleyMilner<VariableIDMarker> + Clone + Debug, VariableIDMarker:
         does_it_reference_it
     }
 
-    fn try_fill_empty_var<'s>(
-        &'s self,
-        empty_var: UUID<VariableIDMarker>,
-        mut replace_with: &'s MyType,
-    ) -> UnifyResult {
-        assert!(self[empty_var].get().is_none());
-
-        // 1-deep Unknowns should be dug out, becuase they don't create infinite types
-        while let HindleyMilnerInfo::TypeVar(unknown_synonym) = replace_with.get_hm_info() {
-            if let Some(found_subst) = self[unknown_synonym].get() {
-                replace_with = found_subst;
-            } else if unknown_synonym == empty_var {
-                return UnifyResult::Success;
-            } else {
-                assert!(self[empty_var].set(replace_with.clone()).is_ok());
-                return UnifyResult::Success;
-            }
+    /// `empty_root` must be a representative without a substitution, and `replace_with` a [HindleyMilnerInfo::TypeFunc]
+    fn try_fill_empty_var(&self, empty_root: usize, replace_with: &MyType) -> UnifyResult {
+        if self.does_typ_reference_var_recurse_with_substitution(replace_with, empty_root) {
+            UnifyResult::NoInfiniteTypes
+        } else {
+            assert!(self.nodes[empty_root].typ.set(replace_with.clone()).is_ok());
+            UnifyResult::Success
         }
+    }
 
-        if self.does_typ_reference_var_recurse_with_substitution(replace_with, empty_var) {
+    /// Merges the sets of two variables. `filled_root` keeps its substitution, `empty_root` has none
+    fn try_merge_into_filled(&self, empty_root: usize, filled_root: usize) -> UnifyResult {
+        let filled_with = self.nodes[filled_root].typ.get().unwrap();
+        if self.does_typ_reference_var_recurse_with_substitution(filled_with, empty_root) {
             UnifyResult::NoInfiniteTypes
         } else {
-            assert!(self[empty_var].set(replace_with.clone()).is_ok());
+            self.link_under(empty_root, filled_root);
             UnifyResult::Success
         }
     }
@@ -200,22 +253,36 @@ impl<MyType: HindleyMilner<VariableIDMarker> + Clone + Debug, VariableIDMarker:
     /// Unification is loosely based on this video: https://www.youtube.com/watch?v=KNbRLTLniZI
     ///
     /// The main change is that I don't keep a substitution list,
-    /// but immediately apply substitutions to [Self::substitution_map]
+    /// but immediately apply substitutions to the union-find forest
     #[must_use]
     fn unify(&self, a: &MyType, b: &MyType) -> UnifyResult {
         let result = match (a.get_hm_info(), b.get_hm_info(), a, b) {
             (HindleyMilnerInfo::TypeVar(a_var), HindleyMilnerInfo::TypeVar(b_var), _, _) => {
-                if a_var == b_var {
-                    UnifyResult::Success // Same var, all ok
+                let a_root = self.find(a_var.get_hidden_value());
+                let b_root = self.find(b_var.get_hidden_value());
+                if a_root == b_root {
+                    UnifyResult::Success // Same set, all ok
                 } else {
-                    match (self[a_var].get(), self[b_var].get()) {
+                    match (self.nodes[a_root].typ.get(), self.nodes[b_root].typ.get()) {
                         (None, None) => {
-                            assert!(self[a_var].set(b.clone()).is_ok());
+                            self.link_by_rank(a_root, b_root);
                             UnifyResult::Success
                         }
-                        (None, Some(subs_b)) => self.try_fill_empty_var(a_var, subs_b),
-                        (Some(subs_a), None) => self.try_fill_empty_var(b_var, subs_a),
-                        (Some(subs_a), Some(subs_b)) => self.unify(subs_a, subs_b),
+                        (None, Some(_)) => self.try_merge_into_filled(a_root, b_root),
+                        (Some(_), None) => self.try_merge_into_filled(b_root, a_root),
+                        (Some(subs_a), Some(subs_b)) => {
+                            let result = self.unify(subs_a, subs_b);
+                            if result == UnifyResult::Success {
+                                // The recursive unify may have linked either root under another one
+                                let a_root = self.find(a_root);
+                                let b_root = self.find(b_root);
+                                if a_root != b_root {
+                                    // Either substitution is fine, they're equal now
+                                    self.link_by_rank(a_root, b_root);
+                                }
+                            }
+                            result
+                        }
                     }
                 }
             }
@@ -228,10 +295,11 @@ impl<MyType: HindleyMilner<VariableIDMarker> + Clone + Debug, VariableIDMarker:
             }
             (HindleyMilnerInfo::TypeFunc(_), HindleyMilnerInfo::TypeVar(v), tf, _)
             | (HindleyMilnerInfo::TypeVar(v), HindleyMilnerInfo::TypeFunc(_), _, tf) => {
-                if let Some(subs) = self[v].get() {
+                let v_root = self.find(v.get_hidden_value());
+                if let Some(subs) = self.nodes[v_root].typ.get() {
                     self.unify(subs, tf)
                 } else {
-                    self.try_fill_empty_var(v, tf)
+                    self.try_fill_empty_var(v_root, tf)
                 }
             }
         };
@@ -276,8 +344,9 @@ impl<MyType: HindleyMilner<VariableIDMarker> + Clone + Debug, VariableIDMarker:
         self.failed_unifications.replace(Vec::new())
     }
 
-    pub fn iter(&self) -> BlockVecIter<'_, OnceCell<MyType>, BLOCK_SIZE> {
-        self.into_iter()
+    /// The substitution of the set of each variable, in order of the variables
+    pub fn iter(&self) -> impl Iterator<Item = &OnceCell<MyType>> {
+        self.id_range().into_iter().map(|id| &self[id])
     }
 
     /// Used for sanity-checking. The graph of Unknown nodes must be non-cyclical, such that we don't create infinite types
@@ -327,7 +396,7 @@ impl<MyType: HindleyMilner<VariableIDMarker> + Clone + Debug, VariableIDMarker:
         }
 
         let mut node_in_path: FlatAlloc<NodeInfo, VariableIDMarker> = FlatAlloc::with_size(
-            self.substitution_map.len(),
+            self.nodes.len(),
             NodeInfo {
                 is_not_part_of_loop: false,
                 is_part_of_stack: false,
@@ -473,8 +542,7 @@ impl HindleyMilner<TypeVariableIDMarker> for AbstractType {
             AbstractType::Named(_) | AbstractType::Template(_) => true, // Template Name & Name is included in get_hm_info
             AbstractType::Array(arr_typ) => arr_typ.fully_substitute(substitutor),
             AbstractType::Unknown(var) => {
-                let Some(replacement) = substitutor.substitution_map[var.get_hidden_value()].get()
-                else {
+                let Some(replacement) = substitutor[*var].get() else {
                     return false;
                 };
                 assert!(!std::ptr::eq(self, replacement));
@@ -521,7 +589,7 @@ impl HindleyMilner<DomainVariableIDMarker> for DomainType {
         match self {
             DomainType::Generative | DomainType::Physical(_) => true, // Do nothing, These are done already
             DomainType::Unknown(var) => {
-                *self = *substitutor.substitution_map[var.get_hidden_value()].get().expect("It's impossible for domain variables to remain, as any unset domain variable would have been replaced with a new physical domain");
+                *self = *substitutor[*var].get().expect("It's impossible for domain variables to remain, as any unset domain variable would have been replaced with a new physical domain");
                 self.fully_substitute(substitutor)
             }
         }
@@ -591,8 +659,7 @@ impl HindleyMilner<ConcreteTypeVariableIDMarker> for ConcreteType {
                 arr_typ.fully_substitute(substitutor) && arr_sz.fully_substitute(substitutor)
             }
             ConcreteType::Unknown(var) => {
-                let Some(replacement) = substitutor.substitution_map[var.get_hidden_value()].get()
-                else {
+                let Some(replacement) = substitutor[*var].get() else {
                     return false;
                 };
                 *self = replacement.clone();
@@ -690,3 +757,44 @@ impl<T> Drop for DelayedConstraintsList<T> {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn long_variable_chains_resolve() {
+        let substitutor: TypeSubstitutor<DomainType, DomainVariableIDMarker> =
+            TypeSubstitutor::new();
+        let vars: Vec<DomainType> = (0..10000)
+            .map(|_| DomainType::Unknown(substitutor.alloc()))
+            .collect();
+        for pair in vars.windows(2) {
+            substitutor.unify_must_succeed(&pair[0], &pair[1]);
+        }
+        let domain = DomainType::Physical(DomainID::from_hidden_value(3));
+        substitutor.unify_must_succeed(vars.last().unwrap(), &domain);
+
+        for mut v in vars {
+            assert!(v.fully_substitute(&substitutor));
+            assert_eq!(v, domain);
+        }
+        substitutor.check_no_unknown_loop();
+    }
+
+    #[test]
+    fn infinite_types_are_rejected() {
+        let substitutor: TypeSubstitutor<AbstractType, TypeVariableIDMarker> =
+            TypeSubstitutor::new();
+        let a = AbstractType::Unknown(substitutor.alloc());
+        let b = AbstractType::Unknown(substitutor.alloc());
+        substitutor.unify_must_succeed(&a, &b);
+
+        let array_of_a = AbstractType::Array(Box::new(a.clone()));
+        assert_eq!(
+            substitutor.unify(&b, &array_of_a),
+            UnifyResult::NoInfiniteTypes
+        );
+        substitutor.check_no_unknown_loop();
+    }
+}
@@ -1,6 +1,11 @@
+use std::borrow::Cow;
+use std::cmp::Ordering;
+use std::fmt;
+use std::hash::{Hash, Hasher};
 use std::ops::Deref;
+use std::str::FromStr;
 
-use num::BigInt;
+use num::{BigInt, ToPrimitive};
 
 use crate::flattening::{BinaryOperator, UnaryOperator};
 
@@ -9,20 +14,385 @@ use crate::typing::{
     type_inference::{ConcreteTypeVariableIDMarker, TypeSubstitutor},
 };
 
+/// A compile-time integer.
+///
+/// Integers that fit in an [i64] are stored inline, such that the common case doesn't go through [BigInt] arithmetic.
+/// Operations switch over to [IntValue::Big] when they overflow.
+///
+/// Invariant: [IntValue::Big] never holds a value that fits in an [i64], which keeps the derived [PartialEq] and [Hash] correct.
+/// Always construct through [From] to uphold it.
+#[derive(Clone, PartialEq, Eq, Hash)]
+pub enum IntValue {
+    Small(i64),
+    Big(BigInt),
+}
+
+impl IntValue {
+    pub const ZERO: IntValue = IntValue::Small(0);
+
+    pub fn is_zero(&self) -> bool {
+        *self == Self::ZERO
+    }
+    pub fn to_i64(&self) -> Option<i64> {
+        match self {
+            IntValue::Small(v) => Some(*v),
+            IntValue::Big(_) => None,
+        }
+    }
+    pub fn to_usize(&self) -> Option<usize> {
+        match self {
+            IntValue::Small(v) => usize::try_from(*v).ok(),
+            IntValue::Big(v) => v.to_usize(),
+        }
+    }
+    pub fn to_big(&self) -> Cow<'_, BigInt> {
+        match self {
+            IntValue::Small(v) => Cow::Owned(BigInt::from(*v)),
+            IntValue::Big(v) => Cow::Borrowed(v),
+        }
+    }
+    /// The number of bits needed to represent the magnitude of this integer. See [BigInt::bits]
+    pub fn bits(&self) -> u64 {
+        match self {
+            IntValue::Small(v) => (i64::BITS - v.unsigned_abs().leading_zeros()) as u64,
+            IntValue::Big(v) => v.bits(),
+        }
+    }
+}
+
+impl From<BigInt> for IntValue {
+    fn from(v: BigInt) -> Self {
+        match v.to_i64() {
+            Some(small) => IntValue::Small(small),
+            None => IntValue::Big(v),
+        }
+    }
+}
+impl From<i64> for IntValue {
+    fn from(v: i64) -> Self {
+        IntValue::Small(v)
+    }
+}
+impl From<u64> for IntValue {
+    fn from(v: u64) -> Self {
+        match i64::try_from(v) {
+            Ok(small) => IntValue::Small(small),
+            Err(_) => IntValue::Big(v.into()),
+        }
+    }
+}
+impl From<usize> for IntValue {
+    fn from(v: usize) -> Self {
+        IntValue::from(v as u64)
+    }
+}
+
+impl FromStr for IntValue {
+    type Err = num::bigint::ParseBigIntError;
+
+    fn from_str(s: &str) -> Result<Self, Self::Err> {
+        match s.parse::<i64>() {
+            Ok(small) => Ok(IntValue::Small(small)),
+            Err(_) => Ok(IntValue::from(BigInt::from_str(s)?)),
+        }
+    }
+}
+
+impl Ord for IntValue {
+    fn cmp(&self, other: &Self) -> Ordering {
+        match (self, other) {
+            (IntValue::Small(l), IntValue::Small(r)) => l.cmp(r),
+            _ => self.to_big().cmp(&other.to_big()),
+        }
+    }
+}
+impl PartialOrd for IntValue {
+    fn partial_cmp(&self, other: &Self) -> Option<Ordering> {
+        Some(self.cmp(other))
+    }
+}
+
+/// Implements `&IntValue op &IntValue` and `&IntValue op i64`, with a checked [i64] fast path
+macro_rules! impl_int_value_binop {
+    ($Trait:ident, $method:ident, $checked_method:ident) => {
+        impl std::ops::$Trait<&IntValue> for &IntValue {
+            type Output = IntValue;
+
+            fn $method(self, rhs: &IntValue) -> IntValue {
+                if let (IntValue::Small(l), IntValue::Small(r)) = (self, rhs) {
+                    if let Some(result) = l.$checked_method(*r) {
+                        return IntValue::Small(result);
+                    }
+                }
+                IntValue::from(std::ops::$Trait::$method(
+                    self.to_big().as_ref(),
+                    rhs.to_big().as_ref(),
+                ))
+            }
+        }
+        impl std::ops::$Trait<i64> for &IntValue {
+            type Output = IntValue;
+
+            fn $method(self, rhs: i64) -> IntValue {
+                std::ops::$Trait::$method(self, &IntValue::Small(rhs))
+            }
+        }
+    };
+}
+impl_int_value_binop!(Add, add, checked_add);
+impl_int_value_binop!(Sub, sub, checked_sub);
+impl_int_value_binop!(Mul, mul, checked_mul);
+impl_int_value_binop!(Div, div, checked_div);
+impl_int_value_binop!(Rem, rem, checked_rem);
+
+impl std::ops::Neg for &IntValue {
+    type Output = IntValue;
+
+    fn neg(self) -> IntValue {
+        match self {
+            IntValue::Small(v) => match v.checked_neg() {
+                Some(result) => IntValue::Small(result),
+                None => IntValue::from(-BigInt::from(*v)),
+            },
+            IntValue::Big(v) => IntValue::from(-v),
+        }
+    }
+}
+
+impl fmt::Display for IntValue {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            IntValue::Small(v) => v.fmt(f),
+            IntValue::Big(v) => v.fmt(f),
+        }
+    }
+}
+impl fmt::Debug for IntValue {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        fmt::Display::fmt(self, f)
+    }
+}
+
+/// Fixed-size list of bits, for the packed array [Value]s
+#[derive(Clone, PartialEq, Eq)]
+pub struct BitVec {
+    /// Bits past `len` are always 0
+    words: Box<[u64]>,
+    len: usize,
+}
+
+impl BitVec {
+    pub fn new(len: usize, value: bool) -> Self {
+        let mut words = vec![if value { u64::MAX } else { 0 }; len.div_ceil(64)];
+        if value && len % 64 != 0 {
+            *words.last_mut().unwrap() = (1 << (len % 64)) - 1;
+        }
+        Self {
+            words: words.into_boxed_slice(),
+            len,
+        }
+    }
+    pub fn len(&self) -> usize {
+        self.len
+    }
+    #[track_caller]
+    pub fn get(&self, idx: usize) -> bool {
+        assert!(idx < self.len);
+        self.words[idx / 64] & (1 << (idx % 64)) != 0
+    }
+    #[track_caller]
+    pub fn set(&mut self, idx: usize, value: bool) {
+        assert!(idx < self.len);
+        let word = &mut self.words[idx / 64];
+        if value {
+            *word |= 1 << (idx % 64);
+        } else {
+            *word &= !(1 << (idx % 64));
+        }
+    }
+    pub fn count_ones(&self) -> usize {
+        self.words.iter().map(|w| w.count_ones() as usize).sum()
+    }
+    fn heap_size(&self) -> usize {
+        std::mem::size_of_val(&*self.words)
+    }
+}
+
+/// Packed `bool[N]`, 2 bits per element instead of a whole [Value]
+///
+/// Invariant: unset elements have their bit in `values` cleared, such that the derived [PartialEq] is correct
+#[derive(Clone, PartialEq, Eq)]
+pub struct PackedBools {
+    values: BitVec,
+    is_set: BitVec,
+}
+
+impl PackedBools {
+    pub fn new_unset(len: usize) -> Self {
+        Self {
+            values: BitVec::new(len, false),
+            is_set: BitVec::new(len, false),
+        }
+    }
+    pub fn len(&self) -> usize {
+        self.values.len()
+    }
+    /// [None] if the element is unset
+    pub fn get(&self, idx: usize) -> Option<bool> {
+        self.is_set.get(idx).then(|| self.values.get(idx))
+    }
+    pub fn set(&mut self, idx: usize, value: Option<bool>) {
+        self.is_set.set(idx, value.is_some());
+        self.values.set(idx, value.unwrap_or(false));
+    }
+    pub fn all_set(&self) -> bool {
+        self.is_set.count_ones() == self.len()
+    }
+    pub fn count_true(&self) -> usize {
+        self.values.count_ones()
+    }
+    fn heap_size(&self) -> usize {
+        std::mem::size_of::<Self>() + self.values.heap_size() + self.is_set.heap_size()
+    }
+}
+
+/// Packed `int[N]` of integers that fit in an [i64], instead of a whole [Value] per element
+///
+/// Invariant: unset elements are stored as 0, such that the derived [PartialEq] is correct
+#[derive(Clone, PartialEq, Eq)]
+pub struct PackedInts {
+    values: Box<[i64]>,
+    is_set: BitVec,
+}
+
+impl PackedInts {
+    pub fn new_unset(len: usize) -> Self {
+        Self {
+            values: vec![0; len].into_boxed_slice(),
+            is_set: BitVec::new(len, false),
+        }
+    }
+    pub fn len(&self) -> usize {
+        self.values.len()
+    }
+    /// [None] if the element is unset
+    pub fn get(&self, idx: usize) -> Option<i64> {
+        self.is_set.get(idx).then(|| self.values[idx])
+    }
+    pub fn set(&mut self, idx: usize, value: Option<i64>) {
+        self.is_set.set(idx, value.is_some());
+        self.values[idx] = value.unwrap_or(0);
+    }
+    fn heap_size(&self) -> usize {
+        std::mem::size_of::<Self>() + std::mem::size_of_val(&*self.values) + self.is_set.heap_size()
+    }
+}
+
+impl fmt::Debug for PackedBools {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_list()
+            .entries((0..self.len()).map(|idx| self.get(idx)))
+            .finish()
+    }
+}
+impl fmt::Debug for PackedInts {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_list()
+            .entries((0..self.len()).map(|idx| self.get(idx)))
+            .finish()
+    }
+}
+
 /// Top type for any kind of compiletime value while executing.
 ///
 /// These are used during execution ([crate::instantiation::execute])
-#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+///
+/// Arrays have multiple representations. [Value::BoolArray] and [Value::IntArray] are packed forms of [Value::Array],
+/// and compare and hash equal to the [Value::Array] with the same elements. Use [Value::array_get] and [Value::array_set]
+/// to work with any of them.
+#[derive(Debug, Clone)]
 pub enum Value {
     Bool(bool),
-    Integer(BigInt),
+    Integer(IntValue),
     Array(Box<[Value]>),
+    BoolArray(Box<PackedBools>),
+    IntArray(Box<PackedInts>),
     /// The initial [Value] a variable has, before it's been set. (translates to `'x` don't care)
     Unset,
     Error,
 }
 
+impl PartialEq for Value {
+    fn eq(&self, other: &Self) -> bool {
+        match (self, other) {
+            (Value::Bool(l), Value::Bool(r)) => l == r,
+            (Value::Integer(l), Value::Integer(r)) => l == r,
+            (Value::Array(l), Value::Array(r)) => l == r,
+            (Value::BoolArray(l), Value::BoolArray(r)) => l == r,
+            (Value::IntArray(l), Value::IntArray(r)) => l == r,
+            (Value::Unset, Value::Unset) | (Value::Error, Value::Error) => true,
+            // Different array representations
+            _ => match (self.array_len(), other.array_len()) {
+                (Some(l_len), Some(r_len)) => {
+                    l_len == r_len && self.array_iter().eq(other.array_iter())
+                }
+                _ => false,
+            },
+        }
+    }
+}
+impl Eq for Value {}
+
+impl Hash for Value {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        match self {
+            Value::Bool(b) => {
+                0u8.hash(state);
+                b.hash(state);
+            }
+            Value::Integer(v) => {
+                1u8.hash(state);
+                v.hash(state);
+            }
+            // Must hash the same regardless of representation
+            Value::Array(_) | Value::BoolArray(_) | Value::IntArray(_) => {
+                2u8.hash(state);
+                self.array_len().unwrap().hash(state);
+                for elem in self.array_iter() {
+                    elem.hash(state);
+                }
+            }
+            Value::Unset => 3u8.hash(state),
+            Value::Error => 4u8.hash(state),
+        }
+    }
+}
+
+impl From<Option<bool>> for Value {
+    fn from(v: Option<bool>) -> Self {
+        v.map_or(Value::Unset, Value::Bool)
+    }
+}
+impl From<Option<i64>> for Value {
+    fn from(v: Option<i64>) -> Self {
+        v.map_or(Value::Unset, |v| Value::Integer(IntValue::Small(v)))
+    }
+}
+
 impl Value {
+    /// Estimated number of bytes this value owns on the heap. Used by [crate::instantiation::InstantiatedModule::heap_size]
+    pub fn heap_size(&self) -> usize {
+        match self {
+            Value::Integer(IntValue::Big(v)) => v.bits().div_ceil(8) as usize,
+            Value::Array(arr) => {
+                std::mem::size_of_val(&**arr) + arr.iter().map(Value::heap_size).sum::<usize>()
+            }
+            Value::BoolArray(packed) => packed.heap_size(),
+            Value::IntArray(packed) => packed.heap_size(),
+            Value::Bool(_) | Value::Integer(IntValue::Small(_)) | Value::Unset | Value::Error => 0,
+        }
+    }
+
     /// Traverses the Value, to create a best-effort [ConcreteType] for it.
     /// So '1' becomes [INT_CONCRETE_TYPE],
     /// but `Value::Array([])` becomes `ConcreteType::Array(ConcreteType::Unknown)`
@@ -52,6 +422,14 @@ impl Value {
                     ConcreteType::Value(Value::Integer(arr.len().into())),
                 )))
             }
+            Value::BoolArray(arr) => ConcreteType::Array(Box::new((
+                BOOL_CONCRETE_TYPE,
+                ConcreteType::Value(Value::Integer(arr.len().into())),
+            ))),
+            Value::IntArray(arr) => ConcreteType::Array(Box::new((
+                INT_CONCRETE_TYPE,
+                ConcreteType::Value(Value::Integer(arr.len().into())),
+            ))),
             Value::Unset | Value::Error => unreachable!(),
         }
     }
@@ -71,14 +449,105 @@ impl Value {
                 }
                 true
             }
+            (Self::BoolArray(arr), ConcreteType::Array(arr_typ_box)) => {
+                let (arr_content_typ, arr_size_typ) = arr_typ_box.deref();
+                *arr_content_typ == BOOL_CONCRETE_TYPE
+                    && arr.len() == arr_size_typ.unwrap_value().unwrap_usize()
+            }
+            (Self::IntArray(arr), ConcreteType::Array(arr_typ_box)) => {
+                let (arr_content_typ, arr_size_typ) = arr_typ_box.deref();
+                *arr_content_typ == INT_CONCRETE_TYPE
+                    && arr.len() == arr_size_typ.unwrap_value().unwrap_usize()
+            }
             (Self::Unset, _) => true,
             (Self::Error, _) => true,
             _other => false,
         }
     }
 
+    /// The number of elements, if this is an array in any of its representations
+    pub fn array_len(&self) -> Option<usize> {
+        match self {
+            Value::Array(arr) => Some(arr.len()),
+            Value::BoolArray(arr) => Some(arr.len()),
+            Value::IntArray(arr) => Some(arr.len()),
+            _ => None,
+        }
+    }
+
+    /// Reads one element of an array. Packed arrays don't store [Value]s, so for these an owned [Value] is returned.
+    ///
+    /// Returns [None] if the index is out of bounds
+    pub fn array_get(&self, idx: usize) -> Option<Cow<'_, Value>> {
+        match self {
+            Value::Array(arr) => arr.get(idx).map(Cow::Borrowed),
+            Value::BoolArray(arr) => (idx < arr.len()).then(|| Cow::Owned(arr.get(idx).into())),
+            Value::IntArray(arr) => (idx < arr.len()).then(|| Cow::Owned(arr.get(idx).into())),
+            _ => panic!("{:?} is not an array!", self),
+        }
+    }
+
+    /// Iterates over the elements of an array in any of its representations
+    pub fn array_iter(&self) -> impl Iterator<Item = Cow<'_, Value>> {
+        let len = self.array_len().expect("Not an array!");
+        (0..len).map(|idx| self.array_get(idx).unwrap())
+    }
+
+    /// Writes one element of an array.
+    /// Packed arrays stay packed if the new element fits, otherwise they are first unpacked into a [Value::Array].
+    ///
+    /// Returns false if the index is out of bounds
+    pub fn array_set(&mut self, idx: usize, new_val: Value) -> bool {
+        if idx >= self.array_len().expect("Not an array!") {
+            return false;
+        }
+        let stays_packed = match (&mut *self, &new_val) {
+            (Value::BoolArray(arr), Value::Bool(b)) => {
+                arr.set(idx, Some(*b));
+                true
+            }
+            (Value::IntArray(arr), Value::Integer(IntValue::Small(v))) => {
+                arr.set(idx, Some(*v));
+                true
+            }
+            (Value::BoolArray(arr), Value::Unset) => {
+                arr.set(idx, None);
+                true
+            }
+            (Value::IntArray(arr), Value::Unset) => {
+                arr.set(idx, None);
+                true
+            }
+            _ => false,
+        };
+        if !stays_packed {
+            *self.array_get_mut(idx).unwrap() = new_val;
+        }
+        true
+    }
+
+    /// Mutable access to one element of an array. As packed arrays don't store [Value]s, they are unpacked first.
+    /// Prefer [Self::array_set] when possible.
+    ///
+    /// Returns [None] if the index is out of bounds
+    pub fn array_get_mut(&mut self, idx: usize) -> Option<&mut Value> {
+        self.unpack_array();
+        let Value::Array(arr) = self else {
+            panic!("{:?} is not an array!", self)
+        };
+        arr.get_mut(idx)
+    }
+
+    /// Converts the packed array representations to a regular [Value::Array]
+    fn unpack_array(&mut self) {
+        if let Value::BoolArray(_) | Value::IntArray(_) = self {
+            let unpacked: Box<[Value]> = self.array_iter().map(Cow::into_owned).collect();
+            *self = Value::Array(unpacked);
+        }
+    }
+
     #[track_caller]
-    pub fn unwrap_integer(&self) -> &BigInt {
+    pub fn unwrap_integer(&self) -> &IntValue {
         let Self::Integer(i) = self else {
             panic!("{:?} is not an integer!", self)
         };
@@ -90,7 +559,6 @@ impl Value {
         let Self::Integer(i) = self else {
             panic!("{:?} is not an integer!", self)
         };
-        use num::ToPrimitive;
         i.to_usize().expect("Integer too large? Program crash")
     }
 
@@ -103,33 +571,69 @@ impl Value {
     }
 }
 
+/// Reduces a `bool[]` for the unary `|`, `&` and `^` operators. Uses popcount on [Value::BoolArray]s.
+///
+/// Returns [Value::Unset] if any of the elements is unset
+fn reduce_bool_array(op: UnaryOperator, arr: &Value) -> Value {
+    let (len, num_true) = match arr {
+        Value::BoolArray(packed) => {
+            if !packed.all_set() {
+                return Value::Unset;
+            }
+            (packed.len(), packed.count_true())
+        }
+        _ => {
+            let mut num_true = 0;
+            for elem in arr.array_iter() {
+                match elem.as_ref() {
+                    Value::Bool(b) => num_true += *b as usize,
+                    Value::Unset => return Value::Unset,
+                    _ => unreachable!("Should be caught by abstract typecheck"),
+                }
+            }
+            (arr.array_len().unwrap(), num_true)
+        }
+    };
+    Value::Bool(match op {
+        UnaryOperator::Or => num_true != 0,
+        UnaryOperator::And => num_true == len,
+        UnaryOperator::Xor => num_true % 2 == 1,
+        _ => unreachable!(),
+    })
+}
+
+/// Reduces an `int[]` for the unary `+` and `*` operators.
+///
+/// Returns [Value::Unset] if any of the elements is unset
+fn reduce_int_array(op: UnaryOperator, arr: &Value) -> Value {
+    let mut result = IntValue::Small(if op == UnaryOperator::Sum { 0 } else { 1 });
+    for elem in arr.array_iter() {
+        let Value::Integer(v) = elem.as_ref() else {
+            return Value::Unset;
+        };
+        result = match op {
+            UnaryOperator::Sum => &result + v,
+            UnaryOperator::Product => &result * v,
+            _ => unreachable!(),
+        };
+    }
+    Value::Integer(result)
+}
+
 pub fn compute_unary_op(op: UnaryOperator, v: &Value) -> Value {
     if *v == Value::Error {
         unreachable!("unary op on Value::Error!")
         //return Value::Error
     }
     match op {
-        UnaryOperator::Or => {
-            todo!("Array Values")
-        }
-        UnaryOperator::And => {
-            todo!("Array Values")
-        }
-        UnaryOperator::Xor => {
-            todo!("Array Values")
-        }
+        UnaryOperator::Or | UnaryOperator::And | UnaryOperator::Xor => reduce_bool_array(op, v),
         UnaryOperator::Not => {
             let Value::Bool(b) = v else {
                 unreachable!("Only not bool supported, should be caught by abstract typecheck")
             };
             Value::Bool(!*b)
         }
-        UnaryOperator::Sum => {
-            todo!("Array Values")
-        }
-        UnaryOperator::Product => {
-            todo!("Array Values")
-        }
+        UnaryOperator::Sum | UnaryOperator::Product => reduce_int_array(op, v),
         UnaryOperator::Negate => {
             let Value::Integer(v) = v else { panic!() };
             Value::Integer(-v)
@@ -155,20 +659,27 @@ pub fn compute_binary_op(left: &Value, op: BinaryOperator, right: &Value) -> Val
         BinaryOperator::Divide => Value::Integer(left.unwrap_integer() / right.unwrap_integer()),
         BinaryOperator::Modulo => Value::Integer(left.unwrap_integer() % right.unwrap_integer()),
         BinaryOperator::And => Value::Bool(left.unwrap_bool() & right.unwrap_bool()),
-        BinaryOperator::Or => Value::Bool(left.unwrap_bool() & right.unwrap_bool()),
-        BinaryOperator::Xor => Value::Bool(left.unwrap_bool() & right.unwrap_bool()),
+        BinaryOperator::Or => Value::Bool(left.unwrap_bool() | right.unwrap_bool()),
+        BinaryOperator::Xor => Value::Bool(left.unwrap_bool() ^ right.unwrap_bool()),
         //BinaryOperator::ShiftLeft => todo!(), // Still a bit iffy about shift operator inclusion
         //BinaryOperator::ShiftRight => todo!()
     }
 }
 
 impl ConcreteType {
+    /// Arrays of `bool` and `int` start out in their packed form
     pub fn get_initial_val(&self) -> Value {
         match self {
             ConcreteType::Named(_name) => Value::Unset,
             ConcreteType::Array(arr) => {
                 let (arr_typ, arr_size) = arr.deref();
                 let arr_size = arr_size.unwrap_value().unwrap_usize();
+                if *arr_typ == BOOL_CONCRETE_TYPE {
+                    return Value::BoolArray(Box::new(PackedBools::new_unset(arr_size)));
+                }
+                if *arr_typ == INT_CONCRETE_TYPE {
+                    return Value::IntArray(Box::new(PackedInts::new_unset(arr_size)));
+                }
                 let mut arr = Vec::new();
                 if arr_size > 0 {
                     let content_typ = arr_typ.get_initial_val();
@@ -180,3 +691,85 @@ impl ConcreteType {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn int_value_overflows_into_bigint() {
+        let max = IntValue::from(i64::MAX);
+        let sum = &max + 1;
+        assert!(matches!(sum, IntValue::Big(_)));
+        assert_eq!(sum.to_string(), "9223372036854775808");
+        // And back down again
+        assert_eq!(&sum - 1, max);
+        assert_eq!(-&IntValue::from(i64::MIN), &max + 1);
+        assert!(IntValue::Small(-5) < sum);
+    }
+
+    #[test]
+    fn packed_arrays_equal_unpacked() {
+        let mut packed = Value::BoolArray(Box::new(PackedBools::new_unset(70)));
+        let mut unpacked = Value::Array(vec![Value::Unset; 70].into_boxed_slice());
+        for idx in [0, 3, 64, 69] {
+            assert!(packed.array_set(idx, Value::Bool(idx % 2 == 1)));
+            assert!(unpacked.array_set(idx, Value::Bool(idx % 2 == 1)));
+        }
+        assert!(!packed.array_set(70, Value::Bool(true)));
+        assert!(matches!(packed, Value::BoolArray(_)));
+        assert_eq!(packed, unpacked);
+
+        let hash = |v: &Value| {
+            let mut hasher = std::collections::hash_map::DefaultHasher::new();
+            v.hash(&mut hasher);
+            hasher.finish()
+        };
+        assert_eq!(hash(&packed), hash(&unpacked));
+
+        // Writing values that don't fit the packed form unpacks the array
+        let mut ints = Value::IntArray(Box::new(PackedInts::new_unset(2)));
+        ints.array_set(0, Value::Integer(IntValue::Small(3)));
+        assert!(matches!(ints, Value::IntArray(_)));
+        ints.array_set(1, Value::Integer(&IntValue::from(i64::MAX) + 1));
+        assert!(matches!(ints, Value::Array(_)));
+        assert_eq!(
+            *ints.array_get(0).unwrap(),
+            Value::Integer(IntValue::Small(3))
+        );
+    }
+
+    #[test]
+    fn array_reductions() {
+        let mut bools = Value::BoolArray(Box::new(PackedBools::new_unset(3)));
+        assert_eq!(compute_unary_op(UnaryOperator::Or, &bools), Value::Unset);
+        for idx in 0..3 {
+            bools.array_set(idx, Value::Bool(idx != 1));
+        }
+        assert_eq!(
+            compute_unary_op(UnaryOperator::Or, &bools),
+            Value::Bool(true)
+        );
+        assert_eq!(
+            compute_unary_op(UnaryOperator::And, &bools),
+            Value::Bool(false)
+        );
+        assert_eq!(
+            compute_unary_op(UnaryOperator::Xor, &bools),
+            Value::Bool(false)
+        );
+
+        let mut ints = Value::IntArray(Box::new(PackedInts::new_unset(3)));
+        for idx in 0..3 {
+            ints.array_set(idx, Value::Integer(IntValue::from(idx + 2)));
+        }
+        assert_eq!(
+            compute_unary_op(UnaryOperator::Sum, &ints),
+            Value::Integer(IntValue::Small(9))
+        );
+        assert_eq!(
+            compute_unary_op(UnaryOperator::Product, &ints),
+            Value::Integer(IntValue::Small(24))
+        );
+    }
+}